@@ -0,0 +1,256 @@
+/*
+Microbenchmarks for the hot paths of the polling cycle.
+
+Runs the main module's own code on the host, against simulated modules on the
+virtual I2C bus (see native/), and reports the time and heap allocations per
+operation of:
+	parser_frame, parser_text  getSensorModuleReading() on one module
+	fetch                      fetchData() over 1 to 32 modules
+	serialize                  rendering a snapshot into currentJSONReply
+	settings_save, settings_load
+	ssdp_match, ssdp_ignore    M-SEARCH matching on an answered and an ignored packet
+
+Every result is printed as one JSON object per line, so runs can be diffed
+or fed to a script:
+	{"benchmark":"fetch","modules":8,"readings":2,"iterations":1000,"ns_per_op":5210.4,"allocs_per_op":12.00}
+
+Build with: pio run -e bench
+Run with:   .pio/build/bench/program [-m modules] [-p readings per module] [-i iterations]
+
+Allocations are counted through operator new, which is where String and the
+rest of the C++ heap use ends up.
+*/
+
+#include <chrono>
+#include <new>
+#include <Arduino.h>
+#include <Wire.h>
+#include <FS.h>
+#include "protocol.h"
+#include "SenseStackFrame.h"
+#include "ModuleRegistry.h"
+#include "Sampling.h"
+#include "ReplySerializer.h"
+#include "Settings.h"
+#include "Discovery.h"
+#include "SimulatedModule.h"
+
+#define BENCH_MAX_MODULES 32
+#define BENCH_FIRST_ADDRESS 0x08
+#define DEFAULT_ITERATIONS 1000
+#define DEFAULT_READINGS 2
+
+static unsigned long allocations = 0;
+
+void *operator new(size_t size)
+{
+  allocations++;
+  void *block = malloc(size ? size : 1);
+  if (block == NULL)
+  {
+    throw std::bad_alloc();
+  }
+  return block;
+}
+
+void operator delete(void *block) noexcept
+{
+  free(block);
+}
+
+void operator delete(void *block, size_t size) noexcept
+{
+  free(block);
+}
+
+struct BenchConfig {
+  int modules;
+  int readings;
+  long iterations;
+};
+
+SimulatedModule *modules[BENCH_MAX_MODULES];
+SensorSnapshot snapshot;
+ReplySerializer serializer;
+char currentJSONReply[MAX_JSON_REPLY];
+fs::FS flash;
+
+const char searchPacket[] =
+  "M-SEARCH * HTTP/1.1\r\n"
+  "HOST: 239.255.255.250:1900\r\n"
+  "MAN: \"ssdp:discover\"\r\n"
+  "MX: 1\r\n"
+  "ST: urn:schemas-upnp-org:device:basic:1\r\n"
+  "\r\n";
+const char notifyPacket[] =
+  "NOTIFY * HTTP/1.1\r\n"
+  "HOST: 239.255.255.250:1900\r\n"
+  "CACHE-CONTROL: max-age=1800\r\n"
+  "NT: urn:schemas-upnp-org:service:ContentDirectory:1\r\n"
+  "NTS: ssdp:alive\r\n"
+  "\r\n";
+
+// helper function to give each module a distinct address, stepping over the reserved one
+byte moduleAddress(int index)
+{
+  byte address = BENCH_FIRST_ADDRESS + index;
+  return address >= RESERVED_ADDRESS ? address + 1 : address;
+}
+
+// helper function to run an operation and print its cost per call as one JSON line
+template <typename Operation>
+void measure(const char *name, int moduleCount, int readings, long iterations, Operation operation)
+{
+  operation(); // warm up, the first call may fill caches and lazy buffers
+
+  unsigned long allocationsBefore = allocations;
+  std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; i++)
+  {
+    operation();
+  }
+  double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+  unsigned long allocated = allocations - allocationsBefore;
+
+  Serial.mute(false);
+  Serial.printf("{\"benchmark\":\"%s\",\"modules\":%d,\"readings\":%d,\"iterations\":%ld,\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f}\n",
+                name, moduleCount, readings, iterations, elapsed / iterations, (double)allocated / iterations);
+  Serial.mute(true);
+}
+
+// helper function to plug in the first count modules and unplug the rest
+void plugModules(int count)
+{
+  for (int i = 0; i < BENCH_MAX_MODULES; i++)
+  {
+    if (i < count)
+    {
+      modules[i]->plug();
+    }
+    else
+    {
+      modules[i]->unplug();
+    }
+  }
+}
+
+void benchParser(const BenchConfig &config)
+{
+  SimulatedModule frameModule(BENCH_FIRST_ADDRESS);
+  SimulatedModule textModule(BENCH_FIRST_ADDRESS + 1, true);
+  for (int i = 0; i < config.readings; i++)
+  {
+    uint8_t channel = 1 + i % (CHANNEL_COUNT - 1);
+    frameModule.setReading(i, channel, UNIT_NONE, 12.5 + i);
+    textModule.setReading(i, channel, UNIT_NONE, 12.5 + i);
+  }
+  frameModule.publish();
+  textModule.publish();
+  plugModules(0);
+  frameModule.plug();
+  textModule.plug();
+
+  measure("parser_frame", 1, config.readings, config.iterations, [&]() {
+    snapshot.clear();
+    getSensorModuleReading(frameModule.address(), snapshot);
+  });
+  measure("parser_text", 1, config.readings, config.iterations, [&]() {
+    snapshot.clear();
+    getSensorModuleReading(textModule.address(), snapshot);
+  });
+
+  frameModule.unplug();
+  textModule.unplug();
+}
+
+void benchFetch(const BenchConfig &config)
+{
+  // double the module count each round, finishing on the configured count
+  for (int count = 1; ; count = min(count * 2, config.modules))
+  {
+    ModuleRegistry registry;
+    plugModules(count);
+    registry.scan();
+    measure("fetch", count, config.readings, config.iterations, [&]() {
+      fetchData(registry, snapshot);
+    });
+    if (count >= config.modules)
+    {
+      break;
+    }
+  }
+}
+
+void benchSerialize(const BenchConfig &config)
+{
+  ModuleRegistry registry;
+  plugModules(config.modules);
+  registry.scan();
+  fetchData(registry, snapshot);
+  serializer.setNode(nodeUUID, nodeName, nodeLat, nodeLong);
+
+  measure("serialize", config.modules, config.readings, config.iterations, [&]() {
+    serializer.render(snapshot, currentJSONReply, sizeof(currentJSONReply));
+  });
+}
+
+void benchSettings(const BenchConfig &config)
+{
+  measure("settings_save", 0, 0, config.iterations, [&]() {
+    saveSettings(flash);
+  });
+  measure("settings_load", 0, 0, config.iterations, [&]() {
+    loadSettings(flash);
+  });
+}
+
+void benchDiscovery(const BenchConfig &config)
+{
+  measure("ssdp_match", 0, 0, config.iterations, [&]() {
+    isSearchRequest(searchPacket);
+  });
+  measure("ssdp_ignore", 0, 0, config.iterations, [&]() {
+    isSearchRequest(notifyPacket);
+  });
+}
+
+int main(int argc, char **argv)
+{
+  BenchConfig config = {BENCH_MAX_MODULES, DEFAULT_READINGS, DEFAULT_ITERATIONS};
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "-m") == 0)
+    {
+      config.modules = atoi(argv[i + 1]);
+    }
+    else if (strcmp(argv[i], "-p") == 0)
+    {
+      config.readings = atoi(argv[i + 1]);
+    }
+    else if (strcmp(argv[i], "-i") == 0)
+    {
+      config.iterations = atol(argv[i + 1]);
+    }
+  }
+  config.modules = constrain(config.modules, 1, min(BENCH_MAX_MODULES, MAX_SENSORS));
+  config.readings = constrain(config.readings, 1, SIMULATED_MAX_READINGS);
+  config.iterations = max(config.iterations, 1L);
+
+  for (int i = 0; i < BENCH_MAX_MODULES; i++)
+  {
+    modules[i] = new SimulatedModule(moduleAddress(i));
+    for (int j = 0; j < config.readings; j++)
+    {
+      modules[i]->setReading(j, 1 + (i + j) % (CHANNEL_COUNT - 1), UNIT_NONE, i + 0.25 * j);
+    }
+    modules[i]->publish();
+  }
+
+  Serial.mute(true);
+  benchParser(config);
+  benchFetch(config);
+  benchSerialize(config);
+  benchSettings(config);
+  benchDiscovery(config);
+  return 0;
+}
@@ -0,0 +1,239 @@
+/*
+Host stand-in for the Arduino core.
+See Arduino.h for what is covered.
+*/
+
+#include <chrono>
+#include <ctype.h>
+#include <stdarg.h>
+#include "Arduino.h"
+
+HardwareSerial Serial;
+
+static unsigned long skippedMicros = 0; // time skipped by delay()
+
+static unsigned long hostMicros()
+{
+  static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+unsigned long micros()
+{
+  return hostMicros() + skippedMicros;
+}
+
+unsigned long millis()
+{
+  return micros() / 1000;
+}
+
+void delay(unsigned long ms)
+{
+  skippedMicros += ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  skippedMicros += us;
+}
+
+void noInterrupts() {}
+void interrupts() {}
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {}
+int digitalRead(uint8_t pin) { return HIGH; }
+int analogRead(uint8_t pin) { return 0; }
+
+char *dtostrf(double value, signed char width, unsigned char precision, char *buffer)
+{
+  sprintf(buffer, "%*.*f", width, precision, value);
+  return buffer;
+}
+
+// -------------- Print -------------- //
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t written = 0;
+  while (size--)
+  {
+    written += write(*buffer++);
+  }
+  return written;
+}
+
+size_t Print::printf(const char *format, ...)
+{
+  char text[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  return length > 0 ? write(text) : 0;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  if (muted)
+  {
+    return size;
+  }
+  return fwrite(buffer, 1, size, stdout);
+}
+
+// -------------- Stream -------------- //
+
+String Stream::readStringUntil(char terminator)
+{
+  String text;
+  int c = read();
+  while (c >= 0 && c != terminator)
+  {
+    text += (char)c;
+    c = read();
+  }
+  return text;
+}
+
+// -------------- String -------------- //
+
+static std::string formatInteger(unsigned long value, unsigned char base, bool negative)
+{
+  if (base < 2 || base > 36)
+  {
+    base = 10;
+  }
+  std::string digits;
+  do
+  {
+    unsigned long digit = value % base;
+    digits.insert(digits.begin(), (char)(digit < 10 ? '0' + digit : 'A' + digit - 10));
+    value /= base;
+  } while (value > 0);
+  if (negative)
+  {
+    digits.insert(digits.begin(), '-');
+  }
+  return digits;
+}
+
+String::String(int value, unsigned char base) : String((long)value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long)value, base) {}
+
+String::String(long value, unsigned char base)
+{
+  if (base == 10 && value < 0)
+  {
+    text = formatInteger(-(unsigned long)value, base, true);
+  }
+  else
+  {
+    text = formatInteger((unsigned long)value, base, false);
+  }
+}
+
+String::String(unsigned long value, unsigned char base)
+{
+  text = formatInteger(value, base, false);
+}
+
+String::String(double value, unsigned char decimals)
+{
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+  text = buffer;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+  return text.length() >= suffix.text.length() && text.compare(text.length() - suffix.text.length(), std::string::npos, suffix.text) == 0;
+}
+
+int String::indexOf(char value, unsigned int from) const
+{
+  size_t index = text.find(value, from);
+  return index == std::string::npos ? -1 : (int)index;
+}
+
+int String::indexOf(const String &value, unsigned int from) const
+{
+  size_t index = text.find(value.text, from);
+  return index == std::string::npos ? -1 : (int)index;
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+  if (from > to)
+  {
+    unsigned int swap = from;
+    from = to;
+    to = swap;
+  }
+  if (from >= text.length())
+  {
+    return String();
+  }
+  return String(text.substr(from, to - from));
+}
+
+void String::trim()
+{
+  size_t start = text.find_first_not_of(" \t\r\n");
+  if (start == std::string::npos)
+  {
+    text.clear();
+    return;
+  }
+  size_t end = text.find_last_not_of(" \t\r\n");
+  text = text.substr(start, end - start + 1);
+}
+
+void String::toLowerCase()
+{
+  for (size_t i = 0; i < text.length(); i++)
+  {
+    text[i] = tolower(text[i]);
+  }
+}
+
+void String::toUpperCase()
+{
+  for (size_t i = 0; i < text.length(); i++)
+  {
+    text[i] = toupper(text[i]);
+  }
+}
+
+String operator+(const String &left, const String &right)
+{
+  String result(left);
+  result += right;
+  return result;
+}
+
+String operator+(const String &left, const char *right)
+{
+  String result(left);
+  result += right;
+  return result;
+}
+
+String operator+(const char *left, const String &right)
+{
+  String result(left);
+  result += right;
+  return result;
+}
+
+String operator+(const String &left, char right)
+{
+  String result(left);
+  result += right;
+  return result;
+}
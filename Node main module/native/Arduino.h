@@ -0,0 +1,112 @@
+/*
+Host stand-in for the Arduino core, enough of it to build and run the polling
+cycle and the shared protocol library on a Linux box (see Simulator.cpp).
+
+Time is virtual: millis() follows the host clock plus everything delay() has
+skipped, so firmware waits cost nothing at host speed.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "WString.h"
+#include "FreeRTOS.h" // the ESP32 core brings in FreeRTOS with Arduino.h
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+
+// program memory is ordinary memory on the host
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_ptr(address) (*(const void * const *)(address))
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strcmp_P strcmp
+
+#ifndef constrain
+#define constrain(amount, low, high) ((amount) < (low) ? (low) : ((amount) > (high) ? (high) : (amount)))
+#endif
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void noInterrupts();
+void interrupts();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+char *dtostrf(double value, signed char width, unsigned char precision, char *buffer);
+
+class Print {
+	public:
+		virtual ~Print() {}
+		virtual size_t write(uint8_t c) = 0;
+		virtual size_t write(const uint8_t *buffer, size_t size);
+		size_t write(const char *text) { return text ? write((const uint8_t *)text, strlen(text)) : 0; }
+
+		size_t print(const char *text) { return write(text); }
+		size_t print(const String &text) { return write((const uint8_t *)text.c_str(), text.length()); }
+		size_t print(char c) { return write((uint8_t)c); }
+		size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+		size_t print(int value, int base = DEC) { return print((long)value, base); }
+		size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+		size_t print(long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+		size_t print(unsigned long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+		size_t print(double value, int decimals = 2) { return print(String(value, (unsigned char)decimals)); }
+
+		size_t println() { return write("\r\n"); }
+		template <typename T> size_t println(const T &value) { size_t n = print(value); return n + println(); }
+		template <typename T> size_t println(const T &value, int format) { size_t n = print(value, format); return n + println(); }
+		size_t printf(const char *format, ...);
+};
+
+class Stream : public Print {
+	public:
+		virtual int available() = 0;
+		virtual int read() = 0;
+		virtual int peek() = 0;
+		String readStringUntil(char terminator);
+};
+
+// writes to stdout unless muted, benchmarks mute it to keep output machine readable
+class HardwareSerial : public Print {
+	private:
+		bool muted;
+	public:
+		HardwareSerial() : muted(false) {}
+		void begin(unsigned long baud) {}
+		void mute(bool state) { muted = state; }
+		operator bool() const { return true; }
+		using Print::write;
+		size_t write(uint8_t c);
+		size_t write(const uint8_t *buffer, size_t size);
+		int availableForWrite() { return 4096; }  // the host console never makes the caller wait
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,65 @@
+/*
+Host stand-in for the ESP32 filesystem API, kept in memory.
+See FS.h for what is covered.
+*/
+
+#include "FS.h"
+
+namespace fs {
+
+size_t File::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t File::write(const uint8_t *buffer, size_t size)
+{
+  if (content == NULL || !writable)
+  {
+    return 0;
+  }
+  content->append((const char *)buffer, size);
+  return size;
+}
+
+int File::available()
+{
+  return content ? content->size() - position : 0;
+}
+
+int File::read()
+{
+  return content && position < content->size() ? (uint8_t)(*content)[position++] : -1;
+}
+
+size_t File::read(uint8_t *buffer, size_t size)
+{
+  size_t count = 0;
+  while (count < size && available() > 0)
+  {
+    buffer[count++] = read();
+  }
+  return count;
+}
+
+int File::peek()
+{
+  return content && position < content->size() ? (uint8_t)(*content)[position] : -1;
+}
+
+File FS::open(const char *path, const char *mode)
+{
+  if (mode[0] == 'r')
+  {
+    std::map<std::string, std::string>::iterator file = files.find(path);
+    return file == files.end() ? File() : File(&file->second, false);
+  }
+  std::string &content = files[path];
+  if (mode[0] == 'w')
+  {
+    content.clear();
+  }
+  return File(&content, true);
+}
+
+}
@@ -0,0 +1,57 @@
+/*
+Host stand-in for the ESP32 filesystem API, kept in memory.
+
+Covers open() with the "r", "w" and "a" modes, exists() and remove(), which is
+what the firmware does with SPIFFS. Files written through one File are seen
+by every File opened afterwards.
+*/
+
+#ifndef FS_H
+#define FS_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+class File : public Stream {
+	private:
+		std::string *content;  // NULL for a file that failed to open
+		size_t position;
+		bool writable;
+	public:
+		File() : content(NULL), position(0), writable(false) {}
+		File(std::string *fileContent, bool write) : content(fileContent), position(0), writable(write) {}
+		operator bool() const { return content != NULL; }
+		void close() { content = NULL; }
+		size_t size() const { return content ? content->size() : 0; }
+
+		using Print::write;
+		size_t write(uint8_t c);
+		size_t write(const uint8_t *buffer, size_t size);
+		int available();
+		int read();
+		size_t read(uint8_t *buffer, size_t size);
+		int peek();
+};
+
+class FS {
+	private:
+		std::map<std::string, std::string> files;
+	public:
+		File open(const char *path, const char *mode = FILE_READ);
+		bool exists(const char *path) const { return files.count(path) > 0; }
+		bool remove(const char *path) { return files.erase(path) > 0; }
+};
+
+}
+
+using fs::FS;
+using fs::File;
+
+#endif
@@ -0,0 +1,73 @@
+/*
+Host stand-in for the FreeRTOS task API.
+See FreeRTOS.h for how tasks map to host threads.
+*/
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "FreeRTOS.h"
+
+struct TaskControl {
+  std::mutex lock;
+  std::condition_variable notified;
+  uint32_t notifications;
+};
+
+// task the calling thread runs, NULL for the main thread
+static thread_local TaskControl *currentTask = NULL;
+static TaskControl mainTask;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameter,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+  // never freed, a task runs until the process exits
+  TaskControl *task = new TaskControl();
+  task->notifications = 0;
+  if (handle != NULL)
+  {
+    *handle = task;
+  }
+  std::thread([task, code, parameter]() {
+    currentTask = task;
+    code(parameter);
+  }).detach();
+  return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  {
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notifications++;
+  }
+  task->notified.notify_one();
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+  TaskControl *task = currentTask != NULL ? currentTask : &mainTask;
+  std::unique_lock<std::mutex> guard(task->lock);
+  if (ticks == portMAX_DELAY)
+  {
+    task->notified.wait(guard, [task]() { return task->notifications > 0; });
+  }
+  else
+  {
+    task->notified.wait_for(guard, std::chrono::milliseconds(ticks * portTICK_PERIOD_MS),
+                            [task]() { return task->notifications > 0; });
+  }
+  uint32_t count = task->notifications;
+  if (count > 0)
+  {
+    task->notifications = clearOnExit ? 0 : count - 1;
+  }
+  return count;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
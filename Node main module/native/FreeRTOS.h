@@ -0,0 +1,34 @@
+/*
+Host stand-in for the FreeRTOS task API the firmware uses, which the ESP32
+core brings in with Arduino.h.
+
+Tasks are host threads, started detached and running until the process exits.
+Notifications count like xTaskNotifyGive() and ulTaskNotifyTake(). Unlike
+delay(), vTaskDelay() really sleeps, so the caller gives the other tasks a
+chance to run.
+*/
+
+#ifndef FreeRTOS_h
+#define FreeRTOS_h
+
+#include <stdint.h>
+
+typedef struct TaskControl *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define portTICK_PERIOD_MS 1
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stackDepth, void *parameter,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+void vTaskDelay(TickType_t ticks);
+
+#endif
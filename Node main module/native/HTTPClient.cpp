@@ -0,0 +1,83 @@
+/*
+Host stand-in for the ESP32 HTTPClient.
+See HTTPClient.h for how the virtual endpoint answers.
+*/
+
+#include "HTTPClient.h"
+
+VirtualEndpoint endpoint;
+
+// accepts the URLs HTTPClient does, anything that is not http or https fails like a bad URL
+bool HTTPClient::begin(WiFiClient &connection, const String &endpointURL)
+{
+  if (!endpointURL.startsWith("http://") && !endpointURL.startsWith("https://"))
+  {
+    return false;
+  }
+  client = &connection;
+  url = endpointURL;
+  contentType = String();
+  authorization = String();
+  return true;
+}
+
+void HTTPClient::addHeader(const String &name, const String &value)
+{
+  if (name == "Content-Type")
+  {
+    contentType = value;
+  }
+  else if (name == "Authorization")
+  {
+    authorization = value;
+  }
+}
+
+int HTTPClient::POST(uint8_t *payload, size_t size)
+{
+  if (client == NULL)
+  {
+    return HTTPC_ERROR_NOT_CONNECTED;
+  }
+  if (!client->connected())
+  {
+    client->connect();
+    endpoint.connections++;
+  }
+  endpoint.requests++;
+  endpoint.url = url;
+  endpoint.contentType = contentType;
+  endpoint.authorization = authorization;
+  endpoint.body.assign((const char *)payload, size);
+  if (endpoint.code < 0)
+  {
+    // the connection is gone, the next POST opens a new one
+    client->stop();
+    response = String();
+  }
+  else
+  {
+    response = endpoint.reply;
+  }
+  return endpoint.code;
+}
+
+// same texts as the ESP32 HTTPClient, HTTP status codes have none
+String HTTPClient::errorToString(int error)
+{
+  switch (error)
+  {
+    case HTTPC_ERROR_CONNECTION_REFUSED: return "connection refused";
+    case HTTPC_ERROR_SEND_HEADER_FAILED: return "send header failed";
+    case HTTPC_ERROR_SEND_PAYLOAD_FAILED: return "send payload failed";
+    case HTTPC_ERROR_NOT_CONNECTED: return "not connected";
+    case HTTPC_ERROR_CONNECTION_LOST: return "connection lost";
+    case HTTPC_ERROR_NO_STREAM: return "no stream";
+    case HTTPC_ERROR_NO_HTTP_SERVER: return "no HTTP server";
+    case HTTPC_ERROR_TOO_LESS_RAM: return "too less ram";
+    case HTTPC_ERROR_ENCODING: return "Transfer-Encoding not supported";
+    case HTTPC_ERROR_STREAM_WRITE: return "Stream write error";
+    case HTTPC_ERROR_READ_TIMEOUT: return "read Timeout";
+    default: return String();
+  }
+}
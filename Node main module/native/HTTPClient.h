@@ -0,0 +1,70 @@
+/*
+Host stand-in for the ESP32 HTTPClient, posting to a virtual endpoint.
+
+Every POST is recorded by the global endpoint and answered with the code it
+is set to: an HTTP status, or a negative HTTPC_ERROR_* code to fail the way
+HTTPClient does when the server cannot be reached. The Uplink task runs
+unchanged against it, so uploads can be checked on the host:
+
+	endpoint.code = 503;
+	uplink.post(body, length, "http://example.com/readings", token);
+	...
+	endpoint.requests, endpoint.contentType, endpoint.body
+*/
+
+#ifndef HTTPClient_h
+#define HTTPClient_h
+
+#include <Arduino.h>
+#include <string>
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED  (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED  (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED       (-4)
+#define HTTPC_ERROR_CONNECTION_LOST     (-5)
+#define HTTPC_ERROR_NO_STREAM           (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER      (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM        (-8)
+#define HTTPC_ERROR_ENCODING            (-9)
+#define HTTPC_ERROR_STREAM_WRITE        (-10)
+#define HTTPC_ERROR_READ_TIMEOUT        (-11)
+
+class VirtualEndpoint {
+	public:
+		int code;              // answer to every POST
+		String reply;          // body sent back with it
+		uint32_t requests;     // POSTs received, failed ones included
+		uint32_t connections;  // connections opened, fewer than requests while keep-alive works
+		String url;            // of the last POST
+		String contentType;
+		String authorization;
+		std::string body;
+
+		VirtualEndpoint() : code(200), reply("{}"), requests(0), connections(0) {}
+};
+
+extern VirtualEndpoint endpoint;
+
+class HTTPClient {
+	private:
+		WiFiClient *client;
+		String url;
+		String contentType;
+		String authorization;
+		String response;
+	public:
+		HTTPClient() : client(NULL) {}
+		bool begin(WiFiClient &connection, const String &endpointURL);
+		void end() {}
+		void setReuse(bool reuse) {}
+		void setConnectTimeout(int32_t timeout) {}
+		void setTimeout(uint16_t timeout) {}
+		void addHeader(const String &name, const String &value);
+		int POST(uint8_t *payload, size_t size);
+		String getString() { return response; }
+		static String errorToString(int error);
+};
+
+#endif
@@ -0,0 +1,66 @@
+/*
+A sensor module on the virtual I2C bus.
+See SimulatedModule.h for usage.
+*/
+
+#include "SimulatedModule.h"
+
+SimulatedModule::SimulatedModule(uint8_t address, bool legacyText) : selfAddress(address), legacy(legacyText), readingCount(0) {}
+
+void SimulatedModule::setReading(uint8_t index, uint8_t channel, uint8_t unit, float value, uint8_t decimals)
+{
+  if (index >= SIMULATED_MAX_READINGS)
+  {
+    return;
+  }
+  readings[index].channel = channel;
+  readings[index].unit = unit;
+  readings[index].value = value;
+  readings[index].decimals = decimals;
+  if (index >= readingCount)
+  {
+    readingCount = index + 1;
+  }
+}
+
+// describe the readings set so far, each packed as a 32 bit integer with its decimals
+void SimulatedModule::describe(uint8_t moduleType)
+{
+  reply.describe(moduleType, 1);
+  for (uint8_t i = 0; i < readingCount; i++)
+  {
+    reply.describeChannel(readings[i].channel, readings[i].unit, VALUE_INT32, readings[i].decimals);
+  }
+}
+
+// encode the readings into the reply, same as publishReading() on the firmware
+bool SimulatedModule::publish()
+{
+  if (!reply.begin())
+  {
+    return false;
+  }
+  for (uint8_t i = 0; i < readingCount; i++)
+  {
+    reply.add(readings[i].channel, readings[i].unit, readings[i].value, readings[i].decimals);
+  }
+  reply.publish();
+  return true;
+}
+
+void SimulatedModule::receive(const uint8_t *data, uint8_t length)
+{
+  if (legacy)
+  {
+    return;
+  }
+  for (uint8_t i = 0; i < length; i++)
+  {
+    reply.command(data[i]);
+  }
+}
+
+void SimulatedModule::request()
+{
+  reply.send();
+}
@@ -0,0 +1,54 @@
+/*
+A sensor module on the virtual I2C bus.
+
+Serves its readings through the same SensorReply the sensor firmware uses, so
+the main module is polled against the real reply state machine. A legacy
+module ignores commands and only ever answers with text fragments, like
+firmware built before the binary frame protocol.
+
+Usage:
+	SimulatedModule co(SENSOR_CO);
+	co.setReading(0, CHANNEL_CO_DENSITY, UNIT_PPM, 1.5);
+	co.describe(MODULE_CO);     // optional, describes the readings set so far
+	co.publish();
+	co.plug();
+*/
+
+#ifndef SimulatedModule_h
+#define SimulatedModule_h
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "SensorReply.h"
+
+#define SIMULATED_MAX_READINGS 8
+
+class SimulatedModule : public I2CSlave {
+	private:
+		struct Reading {
+			uint8_t channel;
+			uint8_t unit;
+			float value;
+			uint8_t decimals;
+		};
+
+		uint8_t selfAddress;
+		bool legacy;
+		Reading readings[SIMULATED_MAX_READINGS];
+		uint8_t readingCount;
+		SensorReply reply;
+	public:
+		SimulatedModule(uint8_t address, bool legacyText = false);
+		void setReading(uint8_t index, uint8_t channel, uint8_t unit, float value, uint8_t decimals = 2);
+		void describe(uint8_t moduleType);
+		bool publish();
+		void setTiming(uint16_t minInterval, uint16_t preferredInterval) { reply.setTiming(minInterval, preferredInterval); }
+		void plug() { Wire.attach(selfAddress, this); }
+		void unplug() { Wire.detach(selfAddress); }
+		uint8_t address() const { return selfAddress; }
+
+		void receive(const uint8_t *data, uint8_t length);
+		void request();
+};
+
+#endif
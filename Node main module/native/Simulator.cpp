@@ -0,0 +1,178 @@
+/*
+Host simulator for the main module's polling cycle.
+
+Attaches simulated sensor modules to the virtual I2C bus, each serving the
+readings its firmware publishes, then runs the main module's own scan, fetch
+and serialize code against them and prints the resulting JSON along with the
+time and bus traffic of every cycle. Halfway through, one module is unplugged
+and plugged back in to exercise the registry's hot-plug handling.
+
+Every reply is uploaded by the Uplink task to the virtual endpoint of
+HTTPClient.h, which fails some of the uploads on purpose. At the end the
+readings and the embedded web assets are requested through the WebServer
+stand-in, as a browser would.
+
+Build and run with: pio run -e native -t exec
+Pass "-q" to silence the module's debug log and only keep the report.
+*/
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "protocol.h"
+#include "SenseStackFrame.h"
+#include "ModuleRegistry.h"
+#include "Sampling.h"
+#include "ReplySerializer.h"
+#include "Uplink.h"
+#include "WebAssets.h"
+#include "SimulatedModule.h"
+#include "Log.h"
+
+#define SIMULATED_CYCLES 8
+
+SimulatedModule coModule(SENSOR_CO);
+SimulatedModule uvModule(SENSOR_LIGHT_UV);
+SimulatedModule pmModule(SENSOR_PM25);
+SimulatedModule tempHumModule(SENSOR_TEMP_HUM);
+SimulatedModule baseModule(126, true); // text-only, like firmware without frame support
+
+ModuleRegistry registry;
+SensorSnapshot snapshot;
+ReplySerializer serializer;
+char reply[MAX_JSON_REPLY];
+Uplink uplink;
+WebServer server;
+
+// endpoint answer for every cycle, a server error and a dropped connection on the way
+int endpointCode(int cycle)
+{
+  if (cycle == 2)
+  {
+    return 503;
+  }
+  if (cycle == 5)
+  {
+    return HTTPC_ERROR_CONNECTION_LOST;
+  }
+  return 200;
+}
+
+// upload a reply the way loop() does and wait for the uplink task to finish it
+void uploadReply(int cycle, size_t length)
+{
+  String status;
+  endpoint.code = endpointCode(cycle);
+  if (!uplink.post(reply, length, "http://endpoint.local/readings", "simulator-token"))
+  {
+    Serial.println("upload: uplink busy");
+    return;
+  }
+  while (!uplink.collect(status))
+  {
+    vTaskDelay(1);
+  }
+  Serial.printf("upload: %s, %lu requests over %lu connections\n",
+                status.c_str(), (unsigned long)endpoint.requests, (unsigned long)endpoint.connections);
+}
+
+// request the readings and the viewer script like a browser, then revalidate the script
+void browse()
+{
+  server.on("/getJSON", []() {
+    server.send_P(200, "application/json", reply, strlen(reply));
+  });
+  serveWebAssets(server);
+
+  const WebAsset *script = findWebAsset("/sensorviewer.js");
+  server.request(HTTP_GET, "/getJSON");
+  Serial.printf("GET /getJSON: %d %s, %u bytes\n", server.responseCode, server.responseType.c_str(), (unsigned)server.responseBody.size());
+  server.request(HTTP_GET, "/sensorviewer.js");
+  Serial.printf("GET /sensorviewer.js: %d %s, %u bytes\n%s", server.responseCode, server.responseType.c_str(),
+                (unsigned)server.responseBody.size(), server.responseHeaders.c_str());
+  server.request(HTTP_GET, "/sensorviewer.js", "If-None-Match", script->etag);
+  Serial.printf("GET /sensorviewer.js with If-None-Match: %d, %u bytes\n", server.responseCode, (unsigned)server.responseBody.size());
+}
+
+// new readings for every module, following the same publishReading() each firmware runs
+void sampleSensors(int cycle)
+{
+  coModule.setReading(0, CHANNEL_CO_DENSITY, UNIT_PPM, 1.2 + 0.1 * (cycle % 5));
+  coModule.publish();
+  uvModule.setReading(0, CHANNEL_UV_INTENSITY, UNIT_MW_PER_CM2, 0.35 + 0.05 * (cycle % 3));
+  uvModule.publish();
+  pmModule.setReading(0, CHANNEL_PM1, UNIT_UG_PER_M3, 8 + cycle % 4, 0);
+  pmModule.setReading(1, CHANNEL_PM2_5, UNIT_UG_PER_M3, 14 + cycle % 6, 0);
+  pmModule.setReading(2, CHANNEL_PM10, UNIT_UG_PER_M3, 21 + cycle % 7, 0);
+  pmModule.publish();
+  tempHumModule.setReading(0, CHANNEL_TEMPERATURE, UNIT_CELSIUS, 29.5 + 0.25 * (cycle % 4));
+  tempHumModule.setReading(1, CHANNEL_HUMIDITY, UNIT_PERCENT, 61.0 - 0.5 * (cycle % 4));
+  tempHumModule.publish();
+  baseModule.setReading(0, CHANNEL_TEST, UNIT_NONE, 0);
+  baseModule.publish();
+}
+
+int main(int argc, char **argv)
+{
+  bool quiet = argc > 1 && strcmp(argv[1], "-q") == 0;
+
+  coModule.plug();
+  uvModule.plug();
+  pmModule.plug();
+  tempHumModule.plug();
+  baseModule.plug();
+  sampleSensors(0);
+  // described modules are polled for values frames, the UV module keeps sending full frames
+  coModule.describe(MODULE_CO);
+  pmModule.describe(MODULE_AIR_QUALITY);
+  tempHumModule.describe(MODULE_TEMP_HUMIDITY);
+
+  Serial.mute(quiet);
+  serializer.setNode("00000000-0000-0000-0000-000000000000", "simulator", "13.7563", "100.5018");
+  registry.scan();
+  uplink.begin();
+
+  for (int cycle = 0; cycle < SIMULATED_CYCLES; cycle++)
+  {
+    if (cycle == SIMULATED_CYCLES / 2)
+    {
+      // pull a module, it is detached once it misses enough polls
+      tempHumModule.unplug();
+    }
+    if (cycle == SIMULATED_CYCLES / 2 + MODULE_MISSED_POLLS)
+    {
+      // plug it back in, the next scan finds it again
+      tempHumModule.plug();
+      registry.scan();
+    }
+    sampleSensors(cycle);
+
+    Wire.resetStats();
+    unsigned long started = micros();
+    fetchData(registry, snapshot);
+    snapshot.sequence = cycle + 1;
+    snapshot.takenAt = millis();
+    size_t length = serializer.render(snapshot, reply, sizeof(reply));
+    unsigned long elapsed = micros() - started;
+    logFlush(Serial);
+    Serial.mute(false);
+
+    const I2CStats &bus = Wire.stats();
+    Serial.printf("cycle %d: %u modules, %u readings, %lu us, %lu transactions, %lu bytes read, %lu bytes written, %lu nacks\n",
+                  cycle, snapshot.moduleCount, snapshot.readingCount, elapsed,
+                  bus.transactions, bus.bytesRead, bus.bytesWritten, bus.nacks);
+    if (length > 0)
+    {
+      Serial.println(reply);
+      uploadReply(cycle, length);
+    }
+    else
+    {
+      Serial.println("Reply did not fit in MAX_JSON_REPLY.");
+    }
+    Serial.mute(quiet);
+  }
+
+  Serial.mute(false);
+  browse();
+  return 0;
+}
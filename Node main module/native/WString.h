@@ -0,0 +1,73 @@
+/*
+Host stand-in for the Arduino String class, backed by std::string.
+Covers the part of the API the firmware uses.
+*/
+
+#ifndef WString_h
+#define WString_h
+
+#include <stdlib.h>
+#include <string>
+
+class String {
+	private:
+		std::string text;
+	public:
+		String() {}
+		String(const char *value) : text(value ? value : "") {}
+		String(const std::string &value) : text(value) {}
+		String(char value) : text(1, value) {}
+		explicit String(int value, unsigned char base = 10);
+		explicit String(unsigned int value, unsigned char base = 10);
+		explicit String(long value, unsigned char base = 10);
+		explicit String(unsigned long value, unsigned char base = 10);
+		explicit String(unsigned char value, unsigned char base = 10) : String((unsigned long)value, base) {}
+		explicit String(float value, unsigned char decimals = 2) : String((double)value, decimals) {}
+		explicit String(double value, unsigned char decimals = 2);
+
+		unsigned int length() const { return text.length(); }
+		const char *c_str() const { return text.c_str(); }
+		bool reserve(unsigned int size) { text.reserve(size); return true; }
+		char operator[](unsigned int index) const { return index < text.length() ? text[index] : 0; }
+		char charAt(unsigned int index) const { return (*this)[index]; }
+
+		String &operator+=(const String &value) { text += value.text; return *this; }
+		String &operator+=(const char *value) { text += value; return *this; }
+		String &operator+=(char value) { text += value; return *this; }
+		String &operator+=(int value) { return *this += String(value); }
+		String &operator+=(unsigned int value) { return *this += String(value); }
+		String &operator+=(long value) { return *this += String(value); }
+		String &operator+=(unsigned long value) { return *this += String(value); }
+		String &operator+=(double value) { return *this += String(value); }
+		bool concat(const String &value) { text += value.text; return true; }
+		bool concat(const char *value) { text += value; return true; }
+		bool concat(char value) { text += value; return true; }
+
+		bool operator==(const String &other) const { return text == other.text; }
+		bool operator==(const char *other) const { return text == (other ? other : ""); }
+		bool operator!=(const String &other) const { return text != other.text; }
+		bool operator!=(const char *other) const { return !(*this == other); }
+		bool equals(const String &other) const { return text == other.text; }
+		bool startsWith(const String &prefix) const { return text.compare(0, prefix.text.length(), prefix.text) == 0; }
+		bool endsWith(const String &suffix) const;
+		int indexOf(char value, unsigned int from = 0) const;
+		int indexOf(const String &value, unsigned int from = 0) const;
+		String substring(unsigned int from) const { return from < text.length() ? String(text.substr(from)) : String(); }
+		String substring(unsigned int from, unsigned int to) const;
+
+		void remove(unsigned int index) { if (index < text.length()) text.erase(index); }
+		void remove(unsigned int index, unsigned int count) { if (index < text.length()) text.erase(index, count); }
+		void trim();
+		void toLowerCase();
+		void toUpperCase();
+		long toInt() const { return strtol(text.c_str(), NULL, 10); }
+		float toFloat() const { return strtof(text.c_str(), NULL); }
+		double toDouble() const { return strtod(text.c_str(), NULL); }
+};
+
+String operator+(const String &left, const String &right);
+String operator+(const String &left, const char *right);
+String operator+(const char *left, const String &right);
+String operator+(const String &left, char right);
+
+#endif
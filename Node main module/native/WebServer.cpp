@@ -0,0 +1,112 @@
+/*
+Host stand-in for the ESP32 WebServer.
+See WebServer.h for how requests are played on the host.
+*/
+
+#include "WebServer.h"
+
+void WebServer::on(const String &uri, HTTPMethod method, THandlerFunction handler)
+{
+  Route route;
+  route.uri = uri;
+  route.method = method;
+  route.handler = handler;
+  routes.push_back(route);
+}
+
+// like the ESP32 WebServer, only the headers asked for here are kept for the handlers
+void WebServer::collectHeaders(const char *headerKeys[], const size_t headerKeysCount)
+{
+  collectedHeaders.clear();
+  for (size_t i = 0; i < headerKeysCount; i++)
+  {
+    collectedHeaders.push_back(headerKeys[i]);
+  }
+}
+
+String WebServer::arg(const String &name) const
+{
+  std::map<std::string, String>::const_iterator found = requestArgs.find(name.c_str());
+  return found != requestArgs.end() ? found->second : String();
+}
+
+String WebServer::header(const String &name) const
+{
+  std::map<std::string, String>::const_iterator found = requestHeaders.find(name.c_str());
+  return found != requestHeaders.end() ? found->second : String();
+}
+
+void WebServer::sendHeader(const String &name, const String &value, bool first)
+{
+  String line = name + ": " + value + "\r\n";
+  pendingHeaders = first ? line + pendingHeaders : pendingHeaders + line;
+}
+
+void WebServer::send(int code, const char *contentType, const String &content)
+{
+  send_P(code, contentType, content.c_str(), content.length());
+}
+
+void WebServer::send_P(int code, PGM_P contentType, PGM_P content, size_t contentLength)
+{
+  responseCode = code;
+  responseType = contentType;
+  responseHeaders = pendingHeaders;
+  pendingHeaders = String();
+  responseBody.assign(content, contentLength);
+}
+
+/*
+Run the handler for a request, as if a client had sent it.
+
+@return the response code, 0 if the handler sent nothing
+*/
+int WebServer::request(HTTPMethod method, const char *uri, const char *headerName, const char *headerValue)
+{
+  responseCode = 0;
+  responseType = String();
+  responseHeaders = String();
+  responseBody.clear();
+  pendingHeaders = String();
+
+  // split "path?a=1&b=2" into the path and its arguments, values are taken as they are
+  String path = uri;
+  requestArgs.clear();
+  int query = path.indexOf('?');
+  if (query >= 0)
+  {
+    String args = path.substring(query + 1);
+    path = path.substring(0, query);
+    while (args.length() > 0)
+    {
+      int end = args.indexOf('&');
+      String pair = end >= 0 ? args.substring(0, end) : args;
+      args = end >= 0 ? args.substring(end + 1) : String();
+      int equals = pair.indexOf('=');
+      requestArgs[(equals >= 0 ? pair.substring(0, equals) : pair).c_str()] = equals >= 0 ? pair.substring(equals + 1) : String();
+    }
+  }
+
+  requestHeaders.clear();
+  for (size_t i = 0; headerName != NULL && i < collectedHeaders.size(); i++)
+  {
+    if (collectedHeaders[i] == headerName)
+    {
+      requestHeaders[headerName] = headerValue;
+    }
+  }
+
+  for (size_t i = 0; i < routes.size(); i++)
+  {
+    if (routes[i].uri == path && (routes[i].method == HTTP_ANY || routes[i].method == method))
+    {
+      routes[i].handler();
+      return responseCode;
+    }
+  }
+  if (notFoundHandler)
+  {
+    notFoundHandler();
+  }
+  return responseCode;
+}
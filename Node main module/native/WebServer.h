@@ -0,0 +1,77 @@
+/*
+Host stand-in for the ESP32 WebServer, without sockets.
+
+Handlers are registered with on() as on the node. request() plays the part
+of a client: it parses the query, keeps the headers collectHeaders() asked for,
+runs the matching handler (or the onNotFound handler) and records the reply:
+
+	server.on("/getJSON", handle_getSensorJSON);
+	server.request(HTTP_GET, "/getJSON");
+	server.responseCode, server.responseType, server.responseBody
+*/
+
+#ifndef WebServer_h
+#define WebServer_h
+
+#include <Arduino.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "WiFiClient.h"
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+
+class WebServer {
+	public:
+		typedef std::function<void(void)> THandlerFunction;
+	private:
+		struct Route {
+			String uri;
+			HTTPMethod method;
+			THandlerFunction handler;
+		};
+
+		std::vector<Route> routes;
+		THandlerFunction notFoundHandler;
+		std::vector<String> collectedHeaders;
+		std::map<std::string, String> requestArgs;
+		std::map<std::string, String> requestHeaders;
+		String pendingHeaders;   // from sendHeader(), sent with the next reply
+		WiFiClient currentClient;
+	public:
+		int responseCode;        // of the last request, 0 if no handler replied
+		String responseType;
+		String responseHeaders;  // "Name: value\r\n" lines
+		std::string responseBody;
+
+		WebServer(int port = 80) : responseCode(0) {}
+		virtual ~WebServer() {}
+		void begin() {}
+		virtual void handleClient() {}
+		virtual void close() {}
+
+		void on(const String &uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+		void on(const String &uri, HTTPMethod method, THandlerFunction handler);
+		void onNotFound(THandlerFunction handler) { notFoundHandler = handler; }
+		void collectHeaders(const char *headerKeys[], const size_t headerKeysCount);
+
+		String arg(const String &name) const;
+		bool hasArg(const String &name) const { return requestArgs.count(name.c_str()) > 0; }
+		String header(const String &name) const;
+		bool hasHeader(const String &name) const { return requestHeaders.count(name.c_str()) > 0; }
+		WiFiClient client() { return currentClient; }
+
+		void sendHeader(const String &name, const String &value, bool first = false);
+		void setContentLength(size_t length) {}
+		void send(int code, const char *contentType = NULL, const String &content = String());
+		void send_P(int code, PGM_P contentType, PGM_P content, size_t contentLength);
+		void sendContent(const String &content) { responseBody.append(content.c_str(), content.length()); }
+		void sendContent_P(PGM_P content, size_t size) { responseBody.append(content, size); }
+
+		int request(HTTPMethod method, const char *uri, const char *headerName = NULL, const char *headerValue = NULL);
+};
+
+#endif
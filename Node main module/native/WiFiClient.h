@@ -0,0 +1,23 @@
+/*
+Host stand-in for the ESP32 WiFiClient, there is no network on the host.
+HTTPClient.h answers requests from a virtual endpoint instead.
+*/
+
+#ifndef WiFiClient_h
+#define WiFiClient_h
+
+#include <Arduino.h>
+
+class WiFiClient {
+	private:
+		bool open;
+	public:
+		WiFiClient() : open(false) {}
+		virtual ~WiFiClient() {}
+		void connect() { open = true; }
+		bool connected() const { return open; }
+		void stop() { open = false; }
+		operator bool() const { return open; }
+};
+
+#endif
@@ -0,0 +1,15 @@
+/*
+Host stand-in for the ESP32 WiFiClientSecure, a WiFiClient without TLS.
+*/
+
+#ifndef WiFiClientSecure_h
+#define WiFiClientSecure_h
+
+#include "WiFiClient.h"
+
+class WiFiClientSecure : public WiFiClient {
+	public:
+		void setInsecure() {}
+};
+
+#endif
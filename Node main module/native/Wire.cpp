@@ -0,0 +1,148 @@
+/*
+Host stand-in for the Arduino Wire library: a virtual I2C bus.
+See Wire.h for the model.
+*/
+
+#include "Wire.h"
+
+TwoWire Wire;
+
+TwoWire::TwoWire() : txAddress(0), txLength(0), transmitting(false), rxLength(0), rxIndex(0), inRequest(false), replyLength(0)
+{
+  memset(slaves, 0, sizeof(slaves));
+  resetStats();
+}
+
+void TwoWire::attach(uint8_t address, I2CSlave *slave)
+{
+  if (address < I2C_ADDRESSES)
+  {
+    slaves[address] = slave;
+  }
+}
+
+void TwoWire::detach(uint8_t address)
+{
+  if (address < I2C_ADDRESSES)
+  {
+    slaves[address] = NULL;
+  }
+}
+
+void TwoWire::resetStats()
+{
+  memset(&counters, 0, sizeof(counters));
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  txAddress = address;
+  txLength = 0;
+  transmitting = true;
+}
+
+/*
+Delivers the written bytes to the module.
+Returns 0 on success and 2 (address NACK) when nothing is attached, like the real library.
+*/
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+  transmitting = false;
+  counters.transactions++;
+  I2CSlave *slave = txAddress < I2C_ADDRESSES ? slaves[txAddress] : NULL;
+  if (slave == NULL)
+  {
+    counters.nacks++;
+    return 2;
+  }
+  counters.bytesWritten += txLength;
+  if (txLength > 0)
+  {
+    slave->receive(txBuffer, txLength);
+  }
+  return 0;
+}
+
+/*
+Runs the module's request handler and hands its reply to the master.
+A reply shorter than asked for is padded with 0xFF, the idle level of SDA.
+Returns 0 when nothing is attached.
+*/
+uint8_t TwoWire::requestFrom(int address, int quantity, int sendStop)
+{
+  rxLength = 0;
+  rxIndex = 0;
+  counters.transactions++;
+  I2CSlave *slave = address >= 0 && address < I2C_ADDRESSES ? slaves[address] : NULL;
+  if (slave == NULL)
+  {
+    counters.nacks++;
+    return 0;
+  }
+  if (quantity < 0)
+  {
+    quantity = 0;
+  }
+  if (quantity > BUFFER_LENGTH)
+  {
+    quantity = BUFFER_LENGTH;
+  }
+
+  replyLength = 0;
+  inRequest = true;
+  slave->request();
+  inRequest = false;
+
+  memcpy(rxBuffer, replyBuffer, replyLength < quantity ? replyLength : quantity);
+  for (int i = replyLength; i < quantity; i++)
+  {
+    rxBuffer[i] = 0xFF;
+  }
+  rxLength = quantity;
+  counters.bytesRead += quantity;
+  return quantity;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+  if (inRequest)
+  {
+    if (replyLength >= BUFFER_LENGTH)
+    {
+      return 0;
+    }
+    replyBuffer[replyLength++] = data;
+    return 1;
+  }
+  if (!transmitting || txLength >= BUFFER_LENGTH)
+  {
+    return 0;
+  }
+  txBuffer[txLength++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity)
+{
+  size_t written = 0;
+  while (written < quantity && write(data[written]))
+  {
+    written++;
+  }
+  return written;
+}
+
+int TwoWire::available()
+{
+  return rxLength - rxIndex;
+}
+
+int TwoWire::read()
+{
+  return rxIndex < rxLength ? rxBuffer[rxIndex++] : -1;
+}
+
+int TwoWire::peek()
+{
+  return rxIndex < rxLength ? rxBuffer[rxIndex] : -1;
+}
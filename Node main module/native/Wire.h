@@ -0,0 +1,74 @@
+/*
+Host stand-in for the Arduino Wire library: a virtual I2C bus.
+
+Modules are I2CSlave objects attached at an address. The master side
+(beginTransmission/write/endTransmission, requestFrom/read) is routed to the
+attached module's receive() and request() handlers, and Wire.write() inside
+request() fills the reply the way the AVR slave buffer does. Addresses with
+nothing attached NACK, so scans and hot-plug behave like the real bus.
+
+Every transaction and byte is counted so the simulator and the benchmarks
+can report the bus traffic of a polling cycle.
+*/
+
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <Arduino.h>
+
+#define BUFFER_LENGTH 32
+#define I2C_ADDRESSES 128
+
+class I2CSlave {
+	public:
+		virtual ~I2CSlave() {}
+		virtual void receive(const uint8_t *data, uint8_t length) = 0; // Wire.onReceive
+		virtual void request() = 0;                                    // Wire.onRequest
+};
+
+struct I2CStats {
+	unsigned long transactions;  // addressed transfers, both directions
+	unsigned long bytesWritten;  // master to module
+	unsigned long bytesRead;     // module to master
+	unsigned long nacks;
+};
+
+class TwoWire {
+	private:
+		I2CSlave *slaves[I2C_ADDRESSES];
+		uint8_t txAddress;
+		uint8_t txBuffer[BUFFER_LENGTH];
+		uint8_t txLength;
+		bool transmitting;
+		uint8_t rxBuffer[BUFFER_LENGTH];
+		uint8_t rxLength;
+		uint8_t rxIndex;
+		bool inRequest;           // a module is filling its reply
+		uint8_t replyBuffer[BUFFER_LENGTH];
+		uint8_t replyLength;
+		I2CStats counters;
+	public:
+		TwoWire();
+		void begin() {}
+		void begin(uint8_t address) {}
+		void setClock(uint32_t frequency) {}
+
+		void beginTransmission(uint8_t address);
+		uint8_t endTransmission(bool sendStop = true);
+		uint8_t requestFrom(int address, int quantity, int sendStop = 1);
+		size_t write(uint8_t data);
+		size_t write(const uint8_t *data, size_t quantity);
+		int available();
+		int read();
+		int peek();
+
+		// virtual bus control
+		void attach(uint8_t address, I2CSlave *slave);
+		void detach(uint8_t address);
+		const I2CStats &stats() const { return counters; }
+		void resetStats();
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,20 @@
+/*
+CRC-32 (IEEE 802.3) shared by the records kept in flash.
+See Checksum.h for usage.
+*/
+
+#include "Checksum.h"
+
+// computed bitwise like the frame CRC so it needs no table
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, uint32_t length)
+{
+  for (uint32_t i = 0; i < length; i++)
+  {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+  }
+  return crc;
+}
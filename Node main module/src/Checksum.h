@@ -0,0 +1,17 @@
+/*
+CRC-32 (IEEE 802.3) shared by the records kept in flash.
+
+Start with 0xFFFFFFFF, feed the data in as many pieces as convenient and
+invert the result:
+	uint32_t crc = crc32Update(0xFFFFFFFF, header, headerLength);
+	crc = crc32Update(crc, payload, payloadLength) ^ 0xFFFFFFFF;
+*/
+
+#ifndef Checksum_h
+#define Checksum_h
+
+#include <Arduino.h>
+
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, uint32_t length);
+
+#endif
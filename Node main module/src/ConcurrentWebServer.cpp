@@ -0,0 +1,146 @@
+/*
+WebServer that serves several connections at once.
+See ConcurrentWebServer.h for how connections are kept and released.
+*/
+
+#include "ConcurrentWebServer.h"
+
+ConcurrentWebServer::ConcurrentWebServer(int port) : WebServer(port)
+{
+  next = 0;
+  for (uint8_t i = 0; i < WEB_MAX_CONNECTIONS; i++)
+  {
+    connections[i].state = SLOT_FREE;
+    connections[i].since = 0;
+  }
+}
+
+/*
+Accept every waiting connection there is a slot for.
+A connection still waiting to close gives up its slot if all are taken.
+*/
+void ConcurrentWebServer::accept()
+{
+  for (;;)
+  {
+    Connection *slot = NULL;
+    Connection *closing = NULL;
+    for (uint8_t i = 0; i < WEB_MAX_CONNECTIONS && slot == NULL; i++)
+    {
+      Connection &connection = connections[i];
+      if (connection.state == SLOT_FREE)
+      {
+        slot = &connection;
+      }
+      else if (connection.state == SLOT_WAIT_CLOSE && (closing == NULL || millis() - connection.since > millis() - closing->since))
+      {
+        closing = &connection;
+      }
+    }
+    if (slot == NULL)
+    {
+      slot = closing;
+    }
+    if (slot == NULL)
+    {
+      // every slot waits for a request, the rest stay in the backlog
+      return;
+    }
+
+    WiFiClient client = _server.available();
+    if (!client)
+    {
+      return;
+    }
+    release(*slot);
+    slot->client = client;
+    slot->state = SLOT_WAIT_READ;
+    slot->since = millis();
+  }
+}
+
+/*
+Move one connection along, as WebServer does with its single current client.
+A request is parsed and handled with the connection as the current client.
+*/
+void ConcurrentWebServer::serve(Connection &connection)
+{
+  if (!connection.client.connected())
+  {
+    release(connection);
+    return;
+  }
+
+  if (connection.state == SLOT_WAIT_CLOSE)
+  {
+    if (millis() - connection.since > HTTP_MAX_CLOSE_WAIT)
+    {
+      release(connection);
+    }
+    return;
+  }
+
+  if (!connection.client.available())
+  {
+    if (millis() - connection.since > HTTP_MAX_DATA_WAIT)
+    {
+      release(connection);
+    }
+    return;
+  }
+
+  _currentClient = connection.client;
+  _currentStatus = HC_WAIT_READ;
+  bool handled = _parseRequest(_currentClient);
+  if (handled)
+  {
+    _currentClient.setTimeout(HTTP_MAX_SEND_WAIT);
+    _contentLength = CONTENT_LENGTH_NOT_SET;
+    _handleRequest();
+  }
+  // the slot keeps the connection, a handler may have taken over its own copy
+  _currentClient = WiFiClient();
+  _currentStatus = HC_NONE;
+  _currentUpload.reset();
+
+  if (handled && connection.client.connected())
+  {
+    connection.state = SLOT_WAIT_CLOSE;
+    connection.since = millis();
+  }
+  else
+  {
+    release(connection);
+  }
+}
+
+// helper function to give a slot back, only our copy of the connection is dropped
+void ConcurrentWebServer::release(Connection &connection)
+{
+  connection.client = WiFiClient();
+  connection.state = SLOT_FREE;
+}
+
+void ConcurrentWebServer::handleClient()
+{
+  accept();
+  for (uint8_t i = 0; i < WEB_MAX_CONNECTIONS; i++)
+  {
+    Connection &connection = connections[(next + i) % WEB_MAX_CONNECTIONS];
+    if (connection.state != SLOT_FREE)
+    {
+      serve(connection);
+    }
+  }
+  next = (next + 1) % WEB_MAX_CONNECTIONS;
+}
+
+// stop listening, dropping the connections that are still held
+void ConcurrentWebServer::close()
+{
+  for (uint8_t i = 0; i < WEB_MAX_CONNECTIONS; i++)
+  {
+    release(connections[i]);
+  }
+  WebServer::close();
+}
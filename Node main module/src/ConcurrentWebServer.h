@@ -0,0 +1,58 @@
+/*
+WebServer that serves several connections at once.
+
+The stock WebServer keeps a single current client. It waits up to
+HTTP_MAX_DATA_WAIT for that client to send its request and then up to
+HTTP_MAX_CLOSE_WAIT for it to close the connection, and every other
+connection sits in the listen backlog meanwhile. A browser that preconnects a
+spare socket, or one that takes its time closing after a reply, stalls a
+config tool polling /getNodeInfo for seconds, and the other way around.
+
+This server accepts up to WEB_MAX_CONNECTIONS connections and watches all of
+them from handleClient(). A connection is dispatched as soon as its request
+starts to arrive, and one that has been answered waits for its client to
+close in the background. Neither holds up the others. If every slot is taken,
+the connection that has been closing the longest is released for a new one.
+
+Requests are parsed and handled by WebServer itself, one at a time on the
+caller of handleClient(). Handlers, AutoConnect and HTTPUpdateServer see an
+ordinary WebServer and need no changes. A handler that takes over server.client()
+(e.g. /events) keeps its copy of the connection when the slot is released.
+*/
+
+#ifndef ConcurrentWebServer_h
+#define ConcurrentWebServer_h
+
+#include <Arduino.h>
+#include <WebServer.h>
+#include "SocketBudget.h"
+
+#define WEB_MAX_CONNECTIONS SOCKETS_FOR_WEB // see SocketBudget.h
+
+class ConcurrentWebServer : public WebServer {
+	private:
+		enum SlotState : uint8_t {
+			SLOT_FREE = 0,
+			SLOT_WAIT_READ,  // accepted, request not received yet
+			SLOT_WAIT_CLOSE  // answered, waiting for the client to close
+		};
+
+		struct Connection {
+			WiFiClient client;
+			SlotState state;
+			unsigned long since; // millis() of the last state change
+		};
+
+		Connection connections[WEB_MAX_CONNECTIONS];
+		uint8_t next; // slot served first on the next pass, so no connection is always last
+
+		void accept();
+		void serve(Connection &connection);
+		void release(Connection &connection);
+	public:
+		ConcurrentWebServer(int port = 80);
+		virtual void handleClient();
+		virtual void close();
+};
+
+#endif
@@ -0,0 +1,18 @@
+/*
+Matching of SSDP discovery requests.
+See Discovery.h for what is answered.
+*/
+
+#include "Discovery.h"
+
+// helper function to check whether a received UDP packet is a search the node should answer
+bool isSearchRequest(const char *packet)
+{
+  String request = packet;
+  if (request.indexOf("M-SEA") < 0) //M-SEARCH
+  {
+    return false;
+  }
+  //match upnp:rootdevice, device:basic:1, ssdp:all and ssdp:discover
+  return request.indexOf("np:rootd") > 0 || request.indexOf("asic:1") > 0 || request.indexOf("dp:all") > 0 || request.indexOf("dp:dis") > 0;
+}
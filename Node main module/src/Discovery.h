@@ -0,0 +1,16 @@
+/*
+Matching of SSDP discovery requests.
+
+loop() answers an M-SEARCH that asks for the root device, basic devices,
+all services or a plain ssdp:discover, everything else on the multicast
+group is ignored.
+*/
+
+#ifndef Discovery_h
+#define Discovery_h
+
+#include <Arduino.h>
+
+bool isSearchRequest(const char *packet);
+
+#endif
@@ -0,0 +1,153 @@
+/*
+Server-Sent Events stream for the live sensor viewer.
+See EventStream.h for how subscribers are kept and throttled.
+*/
+
+#include <lwip/sockets.h>
+#include "EventStream.h"
+
+// helper function to append one event to the pending data of a subscriber
+static void appendEvent(String &pending, const char *data, uint32_t id)
+{
+  pending += "id: ";
+  pending += id;
+  pending += "\ndata: ";
+  pending += data;
+  pending += "\n\n";
+}
+
+EventStream::EventStream()
+{
+  subscriberCount = 0;
+  for (uint8_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++)
+  {
+    subscribers[i].active = false;
+    subscribers[i].dropped = 0;
+  }
+}
+
+/*
+Take over the connection of an /events request and send it the current reading.
+
+@return false if all subscriber slots are taken
+*/
+bool EventStream::subscribe(WiFiClient client, const char *data, uint32_t id)
+{
+  for (uint8_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++)
+  {
+    Subscriber &subscriber = subscribers[i];
+    if (subscriber.active)
+    {
+      continue;
+    }
+
+    subscriber.client = client;
+    subscriber.dropped = 0;
+    subscriber.active = true;
+    subscriber.pending =
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: text/event-stream\r\n"
+      "Cache-Control: no-cache\r\n"
+      "Connection: keep-alive\r\n"
+      "\r\n"
+      "retry: " + String(EVENT_STREAM_RETRY) + "\n\n";
+    appendEvent(subscriber.pending, data, id);
+    subscriberCount++;
+    Serial.println("Live viewer subscribed, " + String(subscriberCount) + " watching.");
+    flush(subscriber);
+    return true;
+  }
+  return false;
+}
+
+// push an event to every subscriber that has caught up with the previous one
+void EventStream::publish(const char *data, uint32_t id)
+{
+  for (uint8_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++)
+  {
+    Subscriber &subscriber = subscribers[i];
+    if (!subscriber.active)
+    {
+      continue;
+    }
+    if (!subscriber.client.connected())
+    {
+      drop(subscriber);
+      continue;
+    }
+    if (!flush(subscriber))
+    {
+      if (subscriber.active && ++subscriber.dropped >= EVENT_STREAM_MAX_DROPPED)
+      {
+        Serial.println("Live viewer too slow, disconnecting.");
+        drop(subscriber);
+      }
+      continue;
+    }
+    subscriber.dropped = 0;
+    appendEvent(subscriber.pending, data, id);
+    flush(subscriber);
+  }
+}
+
+// retry pending writes and forget subscribers that went away, call from loop()
+void EventStream::service()
+{
+  for (uint8_t i = 0; i < EVENT_STREAM_MAX_CLIENTS; i++)
+  {
+    Subscriber &subscriber = subscribers[i];
+    if (!subscriber.active)
+    {
+      continue;
+    }
+    if (!subscriber.client.connected())
+    {
+      drop(subscriber);
+    }
+    else if (subscriber.pending.length() > 0)
+    {
+      flush(subscriber);
+    }
+  }
+}
+
+uint8_t EventStream::count() const
+{
+  return subscriberCount;
+}
+
+/*
+Write as much of the pending data as the socket takes without blocking.
+
+@return true if nothing is pending anymore
+*/
+bool EventStream::flush(Subscriber &subscriber)
+{
+  while (subscriber.pending.length() > 0)
+  {
+    int sent = send(subscriber.client.fd(), subscriber.pending.c_str(), subscriber.pending.length(), MSG_DONTWAIT);
+    if (sent > 0)
+    {
+      subscriber.pending.remove(0, sent);
+    }
+    else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      return false;
+    }
+    else
+    {
+      drop(subscriber);
+      return false;
+    }
+  }
+  return true;
+}
+
+void EventStream::drop(Subscriber &subscriber)
+{
+  subscriber.client.stop();
+  subscriber.pending = "";
+  subscriber.active = false;
+  subscriberCount--;
+  Serial.println("Live viewer left, " + String(subscriberCount) + " watching.");
+}
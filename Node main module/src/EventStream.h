@@ -0,0 +1,49 @@
+/*
+Server-Sent Events stream for the live sensor viewer.
+
+The /events handler hands its client over with subscribe(), after which the
+connection is kept open outside of WebServer (WiFiClient copies share the
+socket, so the server closing its copy does not close ours). loop() pushes
+every new snapshot to all subscribers with publish(), so any number of open
+viewers share one sampling pass.
+
+Writes never block: data a subscriber's socket does not accept yet is kept
+and retried by service(). While a subscriber still has an event pending, newer
+events are skipped for it, a viewer only needs the latest reading. A subscriber
+that misses EVENT_STREAM_MAX_DROPPED events in a row is disconnected.
+*/
+
+#ifndef EventStream_h
+#define EventStream_h
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include "SocketBudget.h"
+
+#define EVENT_STREAM_MAX_CLIENTS SOCKETS_FOR_VIEWERS // see SocketBudget.h
+#define EVENT_STREAM_MAX_DROPPED 10 // events in a row a slow subscriber may miss
+#define EVENT_STREAM_RETRY 2000     // ms browsers wait before reconnecting
+
+class EventStream {
+	private:
+		struct Subscriber {
+			WiFiClient client;
+			String pending;  // bytes not yet accepted by the socket, keeps its capacity between events
+			uint8_t dropped;
+			bool active;
+		};
+
+		Subscriber subscribers[EVENT_STREAM_MAX_CLIENTS];
+		uint8_t subscriberCount;
+
+		bool flush(Subscriber &subscriber);
+		void drop(Subscriber &subscriber);
+	public:
+		EventStream();
+		bool subscribe(WiFiClient client, const char *data, uint32_t id);
+		void publish(const char *data, uint32_t id);
+		void service();
+		uint8_t count() const;
+};
+
+#endif
@@ -0,0 +1,207 @@
+/*
+Counters and latency histograms for the /metrics endpoint.
+See Metrics.h for how they are recorded.
+*/
+
+#include <stdarg.h>
+#include "Metrics.h"
+
+Metrics metrics;
+
+// bucket upper bounds, in microseconds for observe() and in seconds for the le label
+static const uint32_t bucketBounds[HISTOGRAM_BUCKETS] = {
+  1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+static const char *const bucketLabels[HISTOGRAM_BUCKETS] = {
+  "0.001", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "0.5", "1", "2.5", "5", "10"
+};
+
+size_t appendMetric(char *buffer, size_t length, size_t capacity, const char *format, ...)
+{
+  if (length >= capacity)
+  {
+    return capacity;
+  }
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(buffer + length, capacity - length, format, args);
+  va_end(args);
+  if (written < 0 || (size_t)written >= capacity - length)
+  {
+    return capacity;
+  }
+  return length + written;
+}
+
+// -------------- LatencyHistogram -------------- //
+
+void LatencyHistogram::observe(uint32_t micros)
+{
+  uint8_t bucket = 0;
+  while (bucket < HISTOGRAM_BUCKETS && micros > bucketBounds[bucket])
+  {
+    bucket++;
+  }
+  buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  sumMicros.fetch_add(micros, std::memory_order_relaxed);
+  total.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::render(const char *name, const char *help, char *buffer, size_t length, size_t capacity) const
+{
+  length = appendMetric(buffer, length, capacity, "# TYPE %s histogram\n# UNIT %s seconds\n# HELP %s %s\n", name, name, name, help);
+
+  // buckets are stored on their own, the exposition format wants them cumulative
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+  {
+    cumulative += buckets[i].load(std::memory_order_relaxed);
+    length = appendMetric(buffer, length, capacity, "%s_bucket{le=\"%s\"} %lu\n", name, bucketLabels[i], (unsigned long)cumulative);
+  }
+  cumulative += buckets[HISTOGRAM_BUCKETS].load(std::memory_order_relaxed);
+  length = appendMetric(buffer, length, capacity, "%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)cumulative);
+  // the count has to match the +Inf bucket even if an observation lands mid render
+  length = appendMetric(buffer, length, capacity, "%s_count %lu\n%s_sum %.6f\n", name, (unsigned long)cumulative,
+                        name, sumMicros.load(std::memory_order_relaxed) / 1000000.0);
+  return length;
+}
+
+// -------------- Metrics -------------- //
+
+// one I2C transfer with a module, bytes counts both directions
+void Metrics::moduleTransaction(byte address, uint8_t bytes)
+{
+  if (address >= METRICS_MODULES)
+  {
+    return;
+  }
+  modules[address].transactions.fetch_add(1, std::memory_order_relaxed);
+  modules[address].bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+// a reply that needed more than DATA_TRANSMISSION_TIMEOUT transfers and was cut off
+void Metrics::moduleTimeout(byte address)
+{
+  if (address < METRICS_MODULES)
+  {
+    modules[address].timeouts.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// count a response code of the endpoint, negative codes are HTTPClient errors
+void Metrics::httpResponse(int code)
+{
+  // 0 marks a free slot, so a code of 0 can only be counted as other
+  for (uint8_t i = 0; code != 0 && i < METRICS_HTTP_CODES; i++)
+  {
+    int32_t slot = httpCodes[i].load(std::memory_order_relaxed);
+    if (slot == 0)
+    {
+      // claim the free slot, unless another task just claimed it for some code
+      int32_t expected = 0;
+      if (httpCodes[i].compare_exchange_strong(expected, code, std::memory_order_relaxed))
+      {
+        slot = code;
+      }
+      else
+      {
+        slot = expected;
+      }
+    }
+    if (slot == code)
+    {
+      httpCounts[i].fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+  httpCounts[METRICS_HTTP_CODES].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::wifiReconnected()
+{
+  reconnects.fetch_add(1, std::memory_order_relaxed);
+}
+
+// a reading dropped because the endpoint refused it with a code that retrying cannot change
+void Metrics::readingRejected()
+{
+  rejected.fetch_add(1, std::memory_order_relaxed);
+}
+
+// duration of one loop() iteration, the maximum is kept until the next scrape
+void Metrics::loopTime(uint32_t micros)
+{
+  loopMicros.store(micros, std::memory_order_relaxed);
+  uint32_t longest = loopMaxMicros.load(std::memory_order_relaxed);
+  while (micros > longest && !loopMaxMicros.compare_exchange_weak(longest, micros, std::memory_order_relaxed))
+  {
+  }
+}
+
+// render all counters and histograms, returns the length or 0 if the buffer is too small
+size_t Metrics::render(char *buffer, size_t capacity)
+{
+  size_t length = 0;
+  static const char *const moduleCounters[3][2] = {
+    {"sensestack_i2c_transactions", "I2C transfers with a module."},
+    {"sensestack_i2c_bytes", "Bytes moved over I2C with a module, both directions."},
+    {"sensestack_i2c_timeouts", "Replies cut off after too many transfers."}
+  };
+  for (uint8_t counter = 0; counter < 3; counter++)
+  {
+    length = appendMetric(buffer, length, capacity, "# TYPE %s counter\n# HELP %s %s\n",
+                          moduleCounters[counter][0], moduleCounters[counter][0], moduleCounters[counter][1]);
+    for (uint8_t address = 0; address < METRICS_MODULES; address++)
+    {
+      const ModuleCounters &module = modules[address];
+      if (module.transactions.load(std::memory_order_relaxed) == 0)
+      {
+        continue; // never polled
+      }
+      uint32_t value = counter == 0 ? module.transactions.load(std::memory_order_relaxed)
+                     : counter == 1 ? module.bytes.load(std::memory_order_relaxed)
+                     : module.timeouts.load(std::memory_order_relaxed);
+      length = appendMetric(buffer, length, capacity, "%s_total{module=\"0x%02X\"} %lu\n",
+                            moduleCounters[counter][0], address, (unsigned long)value);
+    }
+  }
+
+  length = scan.render("sensestack_scan_duration_seconds", "Full scans of the I2C address space.", buffer, length, capacity);
+  length = sweep.render("sensestack_sweep_duration_seconds", "Sweeps of a few I2C addresses for new modules.", buffer, length, capacity);
+  length = fetch.render("sensestack_fetch_duration_seconds", "Polling every module into a snapshot.", buffer, length, capacity);
+  length = upload.render("sensestack_upload_duration_seconds", "POST of a reading to the endpoint, reply included.", buffer, length, capacity);
+
+  length = appendMetric(buffer, length, capacity, "# TYPE sensestack_http_responses counter\n# HELP sensestack_http_responses Replies from the endpoint by code, negative codes are client errors.\n");
+  for (uint8_t i = 0; i < METRICS_HTTP_CODES; i++)
+  {
+    int32_t code = httpCodes[i].load(std::memory_order_relaxed);
+    if (code != 0)
+    {
+      length = appendMetric(buffer, length, capacity, "sensestack_http_responses_total{code=\"%ld\"} %lu\n",
+                            (long)code, (unsigned long)httpCounts[i].load(std::memory_order_relaxed));
+    }
+  }
+  uint32_t other = httpCounts[METRICS_HTTP_CODES].load(std::memory_order_relaxed);
+  if (other > 0)
+  {
+    length = appendMetric(buffer, length, capacity, "sensestack_http_responses_total{code=\"other\"} %lu\n", (unsigned long)other);
+  }
+
+  length = appendMetric(buffer, length, capacity,
+                        "# TYPE sensestack_wifi_reconnects counter\n# HELP sensestack_wifi_reconnects Connections to the access point after the first.\n"
+                        "sensestack_wifi_reconnects_total %lu\n",
+                        (unsigned long)reconnects.load(std::memory_order_relaxed));
+  length = appendMetric(buffer, length, capacity,
+                        "# TYPE sensestack_readings_rejected counter\n# HELP sensestack_readings_rejected Readings dropped after the endpoint refused them for good.\n"
+                        "sensestack_readings_rejected_total %lu\n",
+                        (unsigned long)rejected.load(std::memory_order_relaxed));
+  length = appendMetric(buffer, length, capacity,
+                        "# TYPE sensestack_loop_seconds gauge\n# HELP sensestack_loop_seconds Duration of the last loop() iteration.\n"
+                        "sensestack_loop_seconds %.6f\n"
+                        "# TYPE sensestack_loop_max_seconds gauge\n# HELP sensestack_loop_max_seconds Longest loop() iteration since the last scrape.\n"
+                        "sensestack_loop_max_seconds %.6f\n",
+                        loopMicros.load(std::memory_order_relaxed) / 1000000.0,
+                        loopMaxMicros.exchange(0, std::memory_order_relaxed) / 1000000.0);
+
+  return length < capacity ? length : 0;
+}
@@ -0,0 +1,77 @@
+/*
+Counters and latency histograms for the /metrics endpoint.
+
+Every counter is a relaxed atomic increment, so the sampling task, the uplink
+task and loop() record into the same global metrics object without locks and
+without slowing the cycle they measure. render() writes everything in the
+OpenMetrics text format; node level gauges like heap and RSSI are read when
+the endpoint is scraped and appended by the handler in main.cpp.
+
+Counters are 32 bit and wrap, which Prometheus handles like a counter reset.
+
+Usage:
+	unsigned long started = micros();
+	fetchData(registry, snapshot);
+	metrics.fetch.observe(micros() - started);
+
+	metrics.moduleTransaction(address, received);
+*/
+
+#ifndef Metrics_h
+#define Metrics_h
+
+#include <Arduino.h>
+#include <atomic>
+
+#define METRICS_MODULES 128    // one set of bus counters per 7 bit address
+#define HISTOGRAM_BUCKETS 12   // upper bounds in Metrics.cpp, plus +Inf
+#define METRICS_HTTP_CODES 16  // distinct response codes counted, the rest go to code "other"
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+class LatencyHistogram {
+	private:
+		std::atomic<uint32_t> buckets[HISTOGRAM_BUCKETS + 1];
+		std::atomic<uint32_t> total;
+		std::atomic<uint32_t> sumMicros;
+	public:
+		void observe(uint32_t micros);
+		size_t render(const char *name, const char *help, char *buffer, size_t length, size_t capacity) const;
+};
+
+class Metrics {
+	private:
+		struct ModuleCounters {
+			std::atomic<uint32_t> transactions;
+			std::atomic<uint32_t> bytes;
+			std::atomic<uint32_t> timeouts;
+		};
+
+		ModuleCounters modules[METRICS_MODULES];
+		std::atomic<int32_t> httpCodes[METRICS_HTTP_CODES];  // 0 marks a free slot
+		std::atomic<uint32_t> httpCounts[METRICS_HTTP_CODES + 1];
+		std::atomic<uint32_t> reconnects;
+		std::atomic<uint32_t> rejected;
+		std::atomic<uint32_t> loopMicros;
+		std::atomic<uint32_t> loopMaxMicros;
+	public:
+		LatencyHistogram scan;    // full scans of the address space
+		LatencyHistogram sweep;   // partial sweeps for newly attached modules
+		LatencyHistogram fetch;   // polling every module into a snapshot
+		LatencyHistogram upload;  // POST to the endpoint, reply included
+
+		void moduleTransaction(byte address, uint8_t bytes);
+		void moduleTimeout(byte address);
+		void httpResponse(int code);
+		void wifiReconnected();
+		void readingRejected();
+		void loopTime(uint32_t micros);
+		size_t render(char *buffer, size_t capacity);
+};
+
+// global so every task can record without passing it around, zeroed at boot
+extern Metrics metrics;
+
+// helper function to append printf style text, returns the new length or capacity once it does not fit
+size_t appendMetric(char *buffer, size_t length, size_t capacity, const char *format, ...);
+
+#endif
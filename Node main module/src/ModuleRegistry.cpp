@@ -0,0 +1,367 @@
+/*
+Registry of the sensor modules connected to the I2C bus.
+See ModuleRegistry.h for the polling and sweeping scheme.
+*/
+
+#include <Wire.h>
+#include "ModuleRegistry.h"
+#include "Checksum.h"
+#include "Log.h"
+
+ModuleRegistry::ModuleRegistry()
+{
+  moduleCount = 0;
+  sweepAddress = 1;
+  layoutVersion = 0;
+  descriptorCount = 0;
+  storage = NULL;
+}
+
+// probe a single address, true if a module acknowledged it
+bool ModuleRegistry::probe(byte address)
+{
+  Wire.beginTransmission(address);
+  byte error = Wire.endTransmission();
+  if (error == 4) // unknown error
+  {
+    LOG_ERROR("Unknown error at address 0x%02X", address);
+  }
+  return error == 0;
+}
+
+int8_t ModuleRegistry::find(byte address) const
+{
+  for (uint8_t i = 0; i < moduleCount; i++)
+  {
+    if (modules[i] == address)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// insert a module keeping the list sorted, so the JSON layout does not depend on attach order
+void ModuleRegistry::attach(byte address)
+{
+  if (moduleCount >= MAX_SENSORS)
+  {
+    LOG_WARN("Maximum of %d sensors are connected. Ignoring module at 0x%02X", MAX_SENSORS, address);
+    return;
+  }
+
+  uint8_t i = moduleCount;
+  while (i > 0 && modules[i - 1] > address)
+  {
+    modules[i] = modules[i - 1];
+    missedPolls[i] = missedPolls[i - 1];
+    asked[i] = asked[i - 1];
+    i--;
+  }
+  modules[i] = address;
+  missedPolls[i] = 0;
+  asked[i] = false;
+  moduleCount++;
+  layoutVersion++;
+
+  LOG_INFO("Module attached at address 0x%02X", address);
+}
+
+void ModuleRegistry::detach(uint8_t index)
+{
+  LOG_INFO("Module detached from address 0x%02X", modules[index]);
+
+  for (uint8_t i = index; i + 1 < moduleCount; i++)
+  {
+    modules[i] = modules[i + 1];
+    missedPolls[i] = missedPolls[i + 1];
+    asked[i] = asked[i + 1];
+  }
+  moduleCount--;
+  layoutVersion++;
+}
+
+// full scan of the address space, attaching and detaching as needed
+void ModuleRegistry::scan()
+{
+  LOG_INFO("Scanning for connected modules...");
+  for (byte address = 1; address < TOP_ADDRESS; address++)
+  {
+    if (address == RESERVED_ADDRESS) // Prevent connection to built-in sensor on NB-IoT board.
+    {
+      continue;
+    }
+
+    int8_t index = find(address);
+    if (probe(address))
+    {
+      if (index < 0)
+      {
+        attach(address);
+      }
+      else
+      {
+        missedPolls[index] = 0;
+      }
+    }
+    else if (index >= 0)
+    {
+      detach(index);
+    }
+  }
+
+  if (moduleCount == 0)
+  {
+    LOG_INFO("No modules are connected.");
+  }
+  else
+  {
+    LOG_INFO("Scan complete.");
+  }
+}
+
+// probe the next few unknown addresses, wrapping around the address space
+void ModuleRegistry::sweep(uint8_t addresses)
+{
+  if (moduleCount >= MAX_SENSORS)
+  {
+    return;
+  }
+
+  // bounded by the size of the address space in case every address is known
+  for (byte step = 1; step < TOP_ADDRESS && addresses > 0; step++)
+  {
+    byte address = sweepAddress;
+    sweepAddress++;
+    if (sweepAddress >= TOP_ADDRESS)
+    {
+      sweepAddress = 1;
+    }
+
+    if (address == RESERVED_ADDRESS || find(address) >= 0)
+    {
+      continue;
+    }
+    addresses--;
+    if (probe(address))
+    {
+      attach(address);
+    }
+  }
+}
+
+// record the outcome of polling a module, detaching it after too many failures
+void ModuleRegistry::pollResult(byte address, bool success)
+{
+  int8_t index = find(address);
+  if (index < 0)
+  {
+    return;
+  }
+
+  if (success)
+  {
+    missedPolls[index] = 0;
+  }
+  else if (++missedPolls[index] >= MODULE_MISSED_POLLS)
+  {
+    detach(index);
+  }
+}
+
+uint8_t ModuleRegistry::count() const
+{
+  return moduleCount;
+}
+
+byte ModuleRegistry::address(uint8_t index) const
+{
+  return modules[index];
+}
+
+bool ModuleRegistry::contains(byte address) const
+{
+  return find(address) >= 0;
+}
+
+uint32_t ModuleRegistry::version() const
+{
+  return layoutVersion;
+}
+
+int8_t ModuleRegistry::findDescriptor(byte address) const
+{
+  for (uint8_t i = 0; i < descriptorCount; i++)
+  {
+    if (descriptors[i].address == address)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void ModuleRegistry::removeDescriptor(int8_t index)
+{
+  for (uint8_t i = index; i + 1 < descriptorCount; i++)
+  {
+    descriptors[i] = descriptors[i + 1];
+  }
+  descriptorCount--;
+}
+
+// load the descriptors cached in fs, new descriptors are saved there from now on
+void ModuleRegistry::loadDescriptors(fs::FS &fs)
+{
+  storage = &fs;
+  descriptorCount = 0;
+  if (!fs.exists(DESCRIPTOR_FILE))
+  {
+    return;
+  }
+  File file = fs.open(DESCRIPTOR_FILE, FILE_READ);
+  if (!file)
+  {
+    return;
+  }
+
+  static uint8_t records[MAX_SENSORS * (1 + DESCRIPTOR_MAX_LENGTH)];
+  uint8_t header[8];
+  size_t length = 0;
+  if (file.read(header, sizeof(header)) == sizeof(header))
+  {
+    length = file.read(records, sizeof(records));
+  }
+  file.close();
+
+  uint16_t magic = header[0] | (uint16_t)header[1] << 8;
+  uint32_t crc = header[4] | (uint32_t)header[5] << 8 | (uint32_t)header[6] << 16 | (uint32_t)header[7] << 24;
+  if (length == 0 || magic != DESCRIPTOR_FILE_MAGIC || header[2] > MAX_SENSORS
+      || (crc32Update(0xFFFFFFFF, records, length) ^ 0xFFFFFFFF) != crc)
+  {
+    LOG_WARN("Module descriptor cache is damaged, ignoring it.");
+    return;
+  }
+
+  size_t position = 0;
+  for (uint8_t i = 0; i < header[2] && position + 1 + DESCRIPTOR_HEADER_LENGTH < length; i++)
+  {
+    CachedDescriptor &cached = descriptors[descriptorCount];
+    cached.address = records[position];
+    uint8_t descriptorSize = descriptorLength(records + position + 1);
+    if (position + 1 + descriptorSize > length || !decodeDescriptor(records + position + 1, descriptorSize, cached.descriptor))
+    {
+      break;
+    }
+    position += 1 + descriptorSize;
+    descriptorCount++;
+  }
+  LOG_INFO("Loaded %u cached module descriptors.", descriptorCount);
+}
+
+void ModuleRegistry::saveDescriptors()
+{
+  if (storage == NULL)
+  {
+    return;
+  }
+
+  static uint8_t records[MAX_SENSORS * (1 + DESCRIPTOR_MAX_LENGTH)];
+  size_t length = 0;
+  for (uint8_t i = 0; i < descriptorCount; i++)
+  {
+    records[length++] = descriptors[i].address;
+    ModuleDescriptor descriptor = descriptors[i].descriptor;
+    length += encodeDescriptor(records + length, descriptor);
+  }
+  uint32_t crc = crc32Update(0xFFFFFFFF, records, length) ^ 0xFFFFFFFF;
+  uint8_t header[8] = {DESCRIPTOR_FILE_MAGIC & 0xFF, DESCRIPTOR_FILE_MAGIC >> 8, descriptorCount, 0,
+                       (uint8_t)crc, (uint8_t)(crc >> 8), (uint8_t)(crc >> 16), (uint8_t)(crc >> 24)};
+
+  File file = storage->open(DESCRIPTOR_FILE, FILE_WRITE);
+  if (!file)
+  {
+    LOG_WARN("Could not open the module descriptor cache.");
+    return;
+  }
+  file.write(header, sizeof(header));
+  file.write(records, length);
+  file.close();
+}
+
+// the cached descriptor of a module, NULL if it has none
+const ModuleDescriptor* ModuleRegistry::descriptor(byte address) const
+{
+  int8_t index = findDescriptor(address);
+  return index < 0 ? NULL : &descriptors[index].descriptor;
+}
+
+// true if an attached module has not been asked for its descriptor yet
+bool ModuleRegistry::needsDescriptor(byte address) const
+{
+  int8_t index = find(address);
+  return index >= 0 && !asked[index] && findDescriptor(address) < 0;
+}
+
+// record the descriptor a module answered with, NULL if it does not have one
+void ModuleRegistry::describe(byte address, const ModuleDescriptor *descriptor)
+{
+  int8_t index = find(address);
+  if (index >= 0)
+  {
+    asked[index] = true;
+  }
+
+  int8_t cached = findDescriptor(address);
+  if (descriptor == NULL)
+  {
+    if (cached >= 0)
+    {
+      removeDescriptor(cached);
+      saveDescriptors();
+    }
+    return;
+  }
+  if (cached >= 0 && descriptors[cached].descriptor.id == descriptor->id)
+  {
+    return;
+  }
+
+  if (cached < 0)
+  {
+    // make room by dropping the descriptor of a module that is no longer attached
+    for (uint8_t i = 0; i < descriptorCount && descriptorCount >= MAX_SENSORS; i++)
+    {
+      if (find(descriptors[i].address) < 0)
+      {
+        removeDescriptor(i);
+      }
+    }
+    if (descriptorCount >= MAX_SENSORS)
+    {
+      return;
+    }
+    cached = descriptorCount++;
+  }
+  descriptors[cached].address = address;
+  descriptors[cached].descriptor = *descriptor;
+  LOG_INFO("Module 0x%02X is type %u firmware %u with %u channels.", address, descriptor->moduleType,
+           descriptor->firmwareVersion, descriptor->channelCount);
+  saveDescriptors();
+}
+
+// drop the cached descriptor of a module so it is described again
+void ModuleRegistry::forgetDescriptor(byte address)
+{
+  int8_t index = find(address);
+  if (index >= 0)
+  {
+    asked[index] = false;
+  }
+  int8_t cached = findDescriptor(address);
+  if (cached >= 0)
+  {
+    removeDescriptor(cached);
+    saveDescriptors();
+  }
+}
@@ -0,0 +1,73 @@
+/*
+Registry of the sensor modules connected to the I2C bus.
+
+The bus is scanned once at boot. After that known modules are polled directly
+and sweep() probes only a few unknown addresses per call, so attaching a module
+is noticed within one pass over the address space while a sampling cycle costs
+one transaction per connected module. A module that fails MODULE_MISSED_POLLS
+polls in a row is detached.
+
+The registry also caches the descriptor of every module that has one
+(SenseStackFrame.h), keyed by address. It is read once when a module is first
+seen and kept in DESCRIPTOR_FILE across reboots, so after that a module is
+polled for values frames only. A module that answers with another descriptor
+id, after a firmware update or when it was swapped for another, is forgotten
+and described again. The file is a cache, a damaged one is ignored:
+	magic (2) | count (1) | reserved (1) | CRC-32 (4) | count times: address (1) | descriptor as sent
+*/
+
+#ifndef ModuleRegistry_h
+#define ModuleRegistry_h
+
+#include <Arduino.h>
+#include <FS.h>
+#include "protocol.h"
+#include "SenseStackFrame.h"
+
+#define REGISTRY_SWEEP_ADDRESSES 4 // unknown addresses probed per sweep() call
+#define MODULE_MISSED_POLLS 3      // failed polls in a row before a module is detached
+#define RESERVED_ADDRESS 0x40      // built-in sensor on the NB-IoT board
+#define DESCRIPTOR_FILE "/modules.bin"
+#define DESCRIPTOR_FILE_MAGIC 0x444D
+
+class ModuleRegistry {
+	private:
+		struct CachedDescriptor {
+			byte address;
+			ModuleDescriptor descriptor;
+		};
+
+		byte modules[MAX_SENSORS];      // addresses of attached modules, sorted ascending
+		uint8_t missedPolls[MAX_SENSORS];
+		bool asked[MAX_SENSORS];        // descriptor requested since the module attached
+		uint8_t moduleCount;
+		CachedDescriptor descriptors[MAX_SENSORS];
+		uint8_t descriptorCount;
+		fs::FS *storage;                // where descriptors are kept, NULL to keep them in memory only
+		byte sweepAddress;              // next address sweep() will probe
+		uint32_t layoutVersion;         // incremented on every attach and detach
+
+		bool probe(byte address);
+		int8_t find(byte address) const;
+		void attach(byte address);
+		void detach(uint8_t index);
+		int8_t findDescriptor(byte address) const;
+		void removeDescriptor(int8_t index);
+		void saveDescriptors();
+	public:
+		ModuleRegistry();
+		void scan();
+		void sweep(uint8_t addresses = REGISTRY_SWEEP_ADDRESSES);
+		void pollResult(byte address, bool success);
+		uint8_t count() const;
+		byte address(uint8_t index) const;
+		bool contains(byte address) const;
+		uint32_t version() const;
+		void loadDescriptors(fs::FS &fs);
+		const ModuleDescriptor* descriptor(byte address) const;
+		bool needsDescriptor(byte address) const;
+		void describe(byte address, const ModuleDescriptor *descriptor);
+		void forgetDescriptor(byte address);
+};
+
+#endif
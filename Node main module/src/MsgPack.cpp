@@ -0,0 +1,140 @@
+/*
+Minimal MessagePack writer for the uplink bodies.
+See MsgPack.h for what it supports.
+*/
+
+#include "MsgPack.h"
+
+MsgPackWriter::MsgPackWriter(char *buffer, size_t capacity)
+{
+  this->buffer = buffer;
+  this->capacity = capacity;
+  position = 0;
+  overflow = false;
+}
+
+void MsgPackWriter::writeByte(uint8_t value)
+{
+  if (position >= capacity)
+  {
+    overflow = true;
+    return;
+  }
+  buffer[position++] = value;
+}
+
+void MsgPackWriter::writeBigEndian(uint64_t value, uint8_t bytes)
+{
+  while (bytes-- > 0)
+  {
+    writeByte(value >> (8 * bytes));
+  }
+}
+
+// start a map, followed by entries key and value pairs
+void MsgPackWriter::writeMap(uint16_t entries)
+{
+  if (entries < 16)
+  {
+    writeByte(0x80 | entries);
+    return;
+  }
+  writeByte(0xde);
+  writeBigEndian(entries, 2);
+}
+
+// start an array, followed by count values
+void MsgPackWriter::writeArray(uint16_t count)
+{
+  if (count < 16)
+  {
+    writeByte(0x90 | count);
+    return;
+  }
+  writeByte(0xdc);
+  writeBigEndian(count, 2);
+}
+
+void MsgPackWriter::writeString(const char *text)
+{
+  size_t length = strlen(text);
+  if (length < 32)
+  {
+    writeByte(0xa0 | length);
+  }
+  else if (length < 256)
+  {
+    writeByte(0xd9);
+    writeByte(length);
+  }
+  else
+  {
+    writeByte(0xda);
+    writeBigEndian(length, 2);
+  }
+  writeRaw(text, length);
+}
+
+void MsgPackWriter::writeBool(bool value)
+{
+  writeByte(value ? 0xc3 : 0xc2);
+}
+
+// the smallest encoding that holds value
+void MsgPackWriter::writeUnsigned(uint32_t value)
+{
+  if (value < 128)
+  {
+    writeByte(value);
+  }
+  else if (value < 256)
+  {
+    writeByte(0xcc);
+    writeByte(value);
+  }
+  else if (value < 65536)
+  {
+    writeByte(0xcd);
+    writeBigEndian(value, 2);
+  }
+  else
+  {
+    writeByte(0xce);
+    writeBigEndian(value, 4);
+  }
+}
+
+void MsgPackWriter::writeFloat(float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  writeByte(0xca);
+  writeBigEndian(bits, 4);
+}
+
+void MsgPackWriter::writeDouble(double value)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  writeByte(0xcb);
+  writeBigEndian(bits, 8);
+}
+
+// copy bytes that are already packed, such as a rendered header
+void MsgPackWriter::writeRaw(const char *data, size_t length)
+{
+  if (length > capacity - position)
+  {
+    overflow = true;
+    position = capacity;
+    return;
+  }
+  memcpy(buffer + position, data, length);
+  position += length;
+}
+
+// bytes written, 0 if the buffer was too small
+size_t MsgPackWriter::length() const
+{
+  return overflow ? 0 : position;
+}
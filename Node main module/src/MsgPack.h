@@ -0,0 +1,44 @@
+/*
+Minimal MessagePack writer for the uplink bodies.
+
+Values are written straight into a caller supplied buffer, big-endian as the
+format requires. Only what the bodies use is supported: maps, arrays,
+strings, booleans, unsigned integers, 32 and 64 bit floats and bytes that
+are already packed. Writing past the end of the buffer is never done, the
+writer remembers it instead and length() then returns 0:
+
+	MsgPackWriter packer(buffer, sizeof(buffer));
+	packer.writeMap(1);
+	packer.writeString("temperature");
+	packer.writeFloat(23.5);
+	size_t length = packer.length();
+*/
+
+#ifndef MsgPack_h
+#define MsgPack_h
+
+#include <Arduino.h>
+
+class MsgPackWriter {
+	private:
+		char *buffer;
+		size_t capacity;
+		size_t position;
+		bool overflow;
+
+		void writeByte(uint8_t value);
+		void writeBigEndian(uint64_t value, uint8_t bytes);
+	public:
+		MsgPackWriter(char *buffer, size_t capacity);
+		void writeMap(uint16_t entries);
+		void writeArray(uint16_t count);
+		void writeString(const char *text);
+		void writeBool(bool value);
+		void writeUnsigned(uint32_t value);
+		void writeFloat(float value);
+		void writeDouble(double value);
+		void writeRaw(const char *data, size_t length);
+		size_t length() const;
+};
+
+#endif
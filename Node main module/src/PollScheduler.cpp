@@ -0,0 +1,184 @@
+/*
+Per module poll schedule of the sampling task.
+See PollScheduler.h for when a module is polled.
+*/
+
+#include "PollScheduler.h"
+
+PollScheduler::PollScheduler() : entryCount(0) {}
+
+int8_t PollScheduler::find(byte address) const
+{
+  for (uint8_t i = 0; i < entryCount; i++)
+  {
+    if (heap[i].address == address)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// true if entry a is due before entry b, safe across the millis() rollover
+bool PollScheduler::before(uint8_t a, uint8_t b) const
+{
+  return (long)(heap[a].nextDue - heap[b].nextDue) < 0;
+}
+
+void PollScheduler::swap(uint8_t a, uint8_t b)
+{
+  Entry entry = heap[a];
+  heap[a] = heap[b];
+  heap[b] = entry;
+}
+
+uint8_t PollScheduler::siftUp(uint8_t position)
+{
+  while (position > 0)
+  {
+    uint8_t parent = (position - 1) / 2;
+    if (!before(position, parent))
+    {
+      break;
+    }
+    swap(position, parent);
+    position = parent;
+  }
+  return position;
+}
+
+void PollScheduler::siftDown(uint8_t position)
+{
+  for (;;)
+  {
+    uint8_t earliest = position;
+    uint8_t left = 2 * position + 1;
+    uint8_t right = left + 1;
+    if (left < entryCount && before(left, earliest))
+    {
+      earliest = left;
+    }
+    if (right < entryCount && before(right, earliest))
+    {
+      earliest = right;
+    }
+    if (earliest == position)
+    {
+      return;
+    }
+    swap(position, earliest);
+    position = earliest;
+  }
+}
+
+// schedule a newly attached module, it is due right away
+bool PollScheduler::add(byte address, const ModuleTiming &timing, unsigned long now)
+{
+  if (entryCount >= MAX_SENSORS || find(address) >= 0)
+  {
+    return false;
+  }
+  Entry &entry = heap[entryCount];
+  entry.address = address;
+  entry.timing = timing;
+  entry.lastPolled = now - timing.minInterval; // pollable right away
+  entry.nextDue = now;
+  entry.answered = false;
+  siftUp(entryCount++);
+  return true;
+}
+
+void PollScheduler::remove(byte address)
+{
+  int8_t index = find(address);
+  if (index < 0)
+  {
+    return;
+  }
+  // move the last entry into the hole and restore the heap around it
+  entryCount--;
+  if (index < entryCount)
+  {
+    heap[index] = heap[entryCount];
+    siftDown(siftUp(index));
+  }
+}
+
+bool PollScheduler::contains(byte address) const
+{
+  return find(address) >= 0;
+}
+
+uint8_t PollScheduler::count() const
+{
+  return entryCount;
+}
+
+// address of the n-th scheduled module, in no particular order
+byte PollScheduler::address(uint8_t index) const
+{
+  return heap[index].address;
+}
+
+// modules that answered their last poll
+uint8_t PollScheduler::answering() const
+{
+  uint8_t answered = 0;
+  for (uint8_t i = 0; i < entryCount; i++)
+  {
+    if (heap[i].answered)
+    {
+      answered++;
+    }
+  }
+  return answered;
+}
+
+// the module whose live view poll is due first, 0 if none is due yet
+byte PollScheduler::nextDue(unsigned long now) const
+{
+  if (entryCount == 0 || (long)(now - heap[0].nextDue) < 0)
+  {
+    return 0;
+  }
+  return heap[0].address;
+}
+
+// true once the minimum interval of a module has passed since its last poll
+bool PollScheduler::canPoll(byte address, unsigned long now) const
+{
+  int8_t index = find(address);
+  return index >= 0 && now - heap[index].lastPolled >= heap[index].timing.minInterval;
+}
+
+// true if a module was polled at or after since, e.g. earlier in the same pass
+bool PollScheduler::polledSince(byte address, unsigned long since) const
+{
+  int8_t index = find(address);
+  return index >= 0 && (long)(heap[index].lastPolled - since) >= 0;
+}
+
+/*
+Record a poll and schedule the next poll of the module on its own cadence.
+
+@param limit : longest ms between two polls, the live view rate while a viewer is open, 0 for none.
+               The minimum interval of the module still wins.
+*/
+void PollScheduler::polled(byte address, bool answered, unsigned long now, unsigned long limit)
+{
+  int8_t index = find(address);
+  if (index < 0)
+  {
+    return;
+  }
+  Entry &entry = heap[index];
+  unsigned long interval = max(entry.timing.minInterval, entry.timing.preferredInterval);
+  if (limit > 0 && interval > limit)
+  {
+    interval = max(limit, (unsigned long)entry.timing.minInterval);
+  }
+  entry.lastPolled = now;
+  entry.nextDue = now + interval;
+  entry.answered = answered;
+  siftDown(index);
+}
@@ -0,0 +1,63 @@
+/*
+Per module poll schedule of the sampling task.
+
+Every module reports a minimum and a preferred poll interval when it is
+attached (CMD_READ_TIMING in SenseStackFrame.h). Each module is polled on
+its own cadence, as fast as it has new samples and never faster, so a DHT22
+is read every 2 seconds while a 10 Hz sensor feeds the window statistics
+(WindowStats.h) ten times a second. While the live view is open, slower
+modules are polled at least at its rate as far as their minimum interval
+allows. When a reading is due at the endpoint, every module
+whose minimum interval has passed is polled once so the upload is fresh.
+
+Entries are kept in a binary min-heap on the time they are next due, so
+finding the next module to poll costs nothing however many are attached.
+*/
+
+#ifndef PollScheduler_h
+#define PollScheduler_h
+
+#include <Arduino.h>
+#include "protocol.h"
+
+#define DEFAULT_MIN_INTERVAL 0          // for modules that do not report their timing
+#define DEFAULT_PREFERRED_INTERVAL 1000
+
+struct ModuleTiming {
+  uint16_t minInterval;        // ms the module needs between two reads
+  uint16_t preferredInterval;  // ms between two new samples of the module
+};
+
+class PollScheduler {
+	private:
+		struct Entry {
+			byte address;
+			ModuleTiming timing;
+			unsigned long lastPolled;  // millis() of the last poll
+			unsigned long nextDue;     // millis() of the next poll on its own cadence
+			bool answered;             // outcome of the last poll
+		};
+
+		Entry heap[MAX_SENSORS];       // ordered by nextDue
+		uint8_t entryCount;
+
+		int8_t find(byte address) const;
+		bool before(uint8_t a, uint8_t b) const;
+		void swap(uint8_t a, uint8_t b);
+		uint8_t siftUp(uint8_t position);
+		void siftDown(uint8_t position);
+	public:
+		PollScheduler();
+		bool add(byte address, const ModuleTiming &timing, unsigned long now);
+		void remove(byte address);
+		bool contains(byte address) const;
+		uint8_t count() const;
+		byte address(uint8_t index) const;
+		uint8_t answering() const;
+		byte nextDue(unsigned long now) const;
+		bool canPoll(byte address, unsigned long now) const;
+		bool polledSince(byte address, unsigned long since) const;
+		void polled(byte address, bool answered, unsigned long now, unsigned long limit);
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+Phase level profiler for loop(), built only with -D LOOP_PROFILER.
+See Profiler.h for how loop() is instrumented.
+*/
+
+#include "Profiler.h"
+
+#ifdef LOOP_PROFILER
+
+#include <algorithm>
+
+LoopProfiler profiler;
+
+static const char *const phaseNames[PROFILER_PHASES] = {
+  "web", "portal", "stream", "button", "blink", "upload", "uplink", "discovery", "log"
+};
+
+LoopProfiler::LoopProfiler() : next(0), recorded(0), phaseCycles(0), phaseMillis(0)
+{
+  memset(trace, 0, sizeof(trace));
+}
+
+// start of a loop() iteration
+void LoopProfiler::begin()
+{
+  memset(trace[next].micros, 0, sizeof(trace[next].micros));
+  phaseMillis = millis();
+  trace[next].startedAt = phaseMillis;
+  phaseCycles = ESP.getCycleCount();
+}
+
+// end of a phase, the next phase starts right away
+void LoopProfiler::mark(ProfilePhase phase)
+{
+  uint32_t cycles = ESP.getCycleCount();
+  uint32_t now = millis();
+  uint32_t elapsed;
+  if (now - phaseMillis >= PROFILER_LONG_PHASE)
+  {
+    elapsed = (now - phaseMillis) * 1000;
+  }
+  else
+  {
+    elapsed = (cycles - phaseCycles) / ESP.getCpuFreqMHz();
+  }
+  // a phase marked twice in one iteration adds up
+  trace[next].micros[phase] += elapsed;
+  phaseMillis = now;
+  phaseCycles = ESP.getCycleCount();
+}
+
+// end of a loop() iteration, keeps it in the ring buffer
+void LoopProfiler::end()
+{
+  next = (next + 1) % PROFILER_ITERATIONS;
+  // one slot always holds the iteration in progress, which the handlers run in
+  if (recorded < PROFILER_ITERATIONS - 1)
+  {
+    recorded++;
+  }
+}
+
+// nearest rank percentile of a phase over the recorded iterations
+uint32_t LoopProfiler::percentile(uint8_t phase, uint8_t percent) const
+{
+  if (recorded == 0)
+  {
+    return 0;
+  }
+  uint32_t values[PROFILER_ITERATIONS];
+  uint16_t oldest = (next + PROFILER_ITERATIONS - recorded) % PROFILER_ITERATIONS;
+  for (uint16_t i = 0; i < recorded; i++)
+  {
+    values[i] = trace[(oldest + i) % PROFILER_ITERATIONS].micros[phase];
+  }
+  uint16_t rank = (recorded * percent + 99) / 100;
+  if (rank > 0)
+  {
+    rank--;
+  }
+  std::nth_element(values, values + rank, values + recorded);
+  return values[rank];
+}
+
+// render p50, p99 and max per phase in microseconds as JSON, returns 0 if it does not fit
+size_t LoopProfiler::renderSummary(char *buffer, size_t capacity) const
+{
+  int length = snprintf(buffer, capacity, "{\"iterations\":%u,\"unit\":\"us\",\"phases\":{", recorded);
+  for (uint8_t phase = 0; phase < PROFILER_PHASES && length > 0 && (size_t)length < capacity; phase++)
+  {
+    length += snprintf(buffer + length, capacity - length, "%s\"%s\":{\"p50\":%lu,\"p99\":%lu,\"max\":%lu}",
+                       phase > 0 ? "," : "", phaseNames[phase],
+                       (unsigned long)percentile(phase, 50), (unsigned long)percentile(phase, 99),
+                       (unsigned long)percentile(phase, 100));
+  }
+  if (length > 0 && (size_t)length < capacity)
+  {
+    length += snprintf(buffer + length, capacity - length, "}}");
+  }
+  return length > 0 && (size_t)length < capacity ? length : 0;
+}
+
+/*
+Render the trace as CSV, oldest iteration first, one row per iteration.
+Call with row 0 and keep calling with the same row variable while it returns
+non-zero, every call fills the buffer with as many whole rows as fit.
+Row 0 is the header, so it is sent once even while nothing is recorded yet.
+*/
+size_t LoopProfiler::renderTrace(uint16_t &row, char *buffer, size_t capacity) const
+{
+  size_t length = 0;
+  if (row == 0)
+  {
+    length = snprintf(buffer, capacity, "started_ms");
+    for (uint8_t phase = 0; phase < PROFILER_PHASES; phase++)
+    {
+      length += snprintf(buffer + length, capacity - length, ",%s_us", phaseNames[phase]);
+    }
+    length += snprintf(buffer + length, capacity - length, "\n");
+    row++;
+  }
+
+  uint16_t oldest = (next + PROFILER_ITERATIONS - recorded) % PROFILER_ITERATIONS;
+  while (row <= recorded)
+  {
+    const Iteration &iteration = trace[(oldest + row - 1) % PROFILER_ITERATIONS];
+    char line[16 + 11 * PROFILER_PHASES];
+    size_t lineLength = snprintf(line, sizeof(line), "%lu", (unsigned long)iteration.startedAt);
+    for (uint8_t phase = 0; phase < PROFILER_PHASES; phase++)
+    {
+      lineLength += snprintf(line + lineLength, sizeof(line) - lineLength, ",%lu", (unsigned long)iteration.micros[phase]);
+    }
+    lineLength += snprintf(line + lineLength, sizeof(line) - lineLength, "\n");
+    if (length + lineLength >= capacity)
+    {
+      break;
+    }
+    memcpy(buffer + length, line, lineLength + 1);
+    length += lineLength;
+    row++;
+  }
+  return length;
+}
+
+#endif
@@ -0,0 +1,83 @@
+/*
+Phase level profiler for loop(), built only with -D LOOP_PROFILER.
+
+loop() marks the end of each of its phases. The time spent in every phase is
+taken from the CPU cycle counter and kept for the last PROFILER_ITERATIONS
+iterations in a ring buffer, so a stall shows up with the phase that caused
+it. /profile serves p50, p99 and max per phase as JSON and /profile/trace
+downloads the raw ring buffer as CSV.
+
+Without LOOP_PROFILER the macros expand to nothing and neither the buffer
+nor the handlers are compiled, so production builds pay nothing.
+
+Usage:
+	void loop() {
+		PROFILE_LOOP_BEGIN();
+		server.handleClient();
+		PROFILE_PHASE(PHASE_WEB);
+		...
+		PROFILE_LOOP_END();
+	}
+*/
+
+#ifndef Profiler_h
+#define Profiler_h
+
+#ifdef LOOP_PROFILER
+
+#include <Arduino.h>
+
+#define PROFILER_ITERATIONS 128    // ring buffer slots, the last PROFILER_ITERATIONS - 1 iterations are kept
+#define PROFILER_LONG_PHASE 10000  // ms after which a phase is timed with millis(), the cycle counter wraps within 18 s
+
+enum ProfilePhase {
+	PHASE_WEB = 0,     // server.handleClient()
+	PHASE_PORTAL,      // Portal.handleRequest()
+	PHASE_STREAM,      // live viewers
+	PHASE_BUTTON,
+	PHASE_BLINK,
+	PHASE_UPLOAD,      // serializing and handing readings to the uplink
+	PHASE_UPLINK,      // endpoint replies and the reading store
+	PHASE_DISCOVERY,   // SSDP
+	PHASE_LOG,         // draining the log buffer to Serial
+	PROFILER_PHASES
+};
+
+class LoopProfiler {
+	private:
+		struct Iteration {
+			uint32_t startedAt;                 // millis() when the iteration began
+			uint32_t micros[PROFILER_PHASES];
+		};
+
+		Iteration trace[PROFILER_ITERATIONS];
+		uint16_t next;         // slot the current iteration is written to
+		uint16_t recorded;     // complete iterations in the buffer
+		uint32_t phaseCycles;  // cycle counter at the start of the current phase
+		uint32_t phaseMillis;
+
+		uint32_t percentile(uint8_t phase, uint8_t percent) const;
+	public:
+		LoopProfiler();
+		void begin();
+		void mark(ProfilePhase phase);
+		void end();
+		size_t renderSummary(char *buffer, size_t capacity) const;
+		size_t renderTrace(uint16_t &row, char *buffer, size_t capacity) const;
+};
+
+extern LoopProfiler profiler;
+
+#define PROFILE_LOOP_BEGIN() profiler.begin()
+#define PROFILE_PHASE(phase) profiler.mark(phase)
+#define PROFILE_LOOP_END() profiler.end()
+
+#else
+
+#define PROFILE_LOOP_BEGIN()
+#define PROFILE_PHASE(phase)
+#define PROFILE_LOOP_END()
+
+#endif
+
+#endif
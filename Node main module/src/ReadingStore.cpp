@@ -0,0 +1,379 @@
+/*
+Store-and-forward queue for readings that could not be sent.
+See ReadingStore.h for the record layout and the acknowledgement scheme.
+*/
+
+#include "ReadingStore.h"
+#include "Checksum.h"
+
+#define STORE_READ_CHUNK 128
+
+ReadingStore::ReadingStore()
+{
+  partition = NULL;
+  sectorCount = 0;
+  headSector = 0;
+  headOffset = 0;
+  tailSector = 0;
+  readSector = 0;
+  readOffset = 0;
+  nextSequence = 1;
+  ackedSequence = 0;
+  pendingCount = 0;
+}
+
+// find the partition and recover the log, false if the store is not available
+bool ReadingStore::begin()
+{
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, STORE_PARTITION_LABEL);
+  if (partition == NULL || partition->size / STORE_SECTOR_SIZE < 2)
+  {
+    Serial.println("No readings partition, readings that fail to send will be lost.");
+    partition = NULL;
+    return false;
+  }
+  sectorCount = partition->size / STORE_SECTOR_SIZE;
+  recover();
+  Serial.println("Reading store ready, " + String(pendingCount) + " readings waiting to be sent.");
+  return true;
+}
+
+bool ReadingStore::enabled() const
+{
+  return partition != NULL;
+}
+
+// bytes a record takes in flash, payloads are padded to a multiple of 4
+uint32_t ReadingStore::recordLength(uint32_t payloadLength)
+{
+  return STORE_HEADER_LENGTH + ((payloadLength + 3) & ~3UL);
+}
+
+// read the record header at a position, true if it is a complete record with a valid CRC
+bool ReadingStore::readHeader(uint32_t sector, uint32_t offset, RecordHeader &header)
+{
+  if (offset + STORE_HEADER_LENGTH > STORE_SECTOR_SIZE)
+  {
+    return false;
+  }
+  uint32_t address = sector * STORE_SECTOR_SIZE + offset;
+  if (esp_partition_read(partition, address, &header, STORE_HEADER_LENGTH) != ESP_OK)
+  {
+    return false;
+  }
+  if (header.magic != STORE_RECORD_MAGIC || header.length > STORE_SECTOR_SIZE - offset - STORE_HEADER_LENGTH)
+  {
+    return false;
+  }
+
+  uint32_t crc = 0xFFFFFFFF;
+  crc = crc32Update(crc, (const uint8_t*)&header.sequence, sizeof(header.sequence));
+  crc = crc32Update(crc, (const uint8_t*)&header.length, sizeof(header.length));
+  uint8_t chunk[STORE_READ_CHUNK];
+  for (uint32_t done = 0; done < header.length; )
+  {
+    uint32_t length = header.length - done;
+    if (length > STORE_READ_CHUNK)
+    {
+      length = STORE_READ_CHUNK;
+    }
+    if (esp_partition_read(partition, address + STORE_HEADER_LENGTH + done, chunk, length) != ESP_OK)
+    {
+      return false;
+    }
+    crc = crc32Update(crc, chunk, length);
+    done += length;
+  }
+  return (crc ^ 0xFFFFFFFF) == header.crc;
+}
+
+// number of unacknowledged readings in a sector
+uint32_t ReadingStore::countPending(uint32_t sector)
+{
+  uint32_t count = 0;
+  uint32_t offset = 0;
+  RecordHeader header;
+  while (readHeader(sector, offset, header))
+  {
+    if (header.type == STORE_RECORD_READING && header.sequence > ackedSequence)
+    {
+      count++;
+    }
+    offset += recordLength(header.length);
+  }
+  return count;
+}
+
+// rebuild the head, tail, read cursor and acknowledged sequence from flash
+void ReadingStore::recover()
+{
+  bool found = false;
+  uint32_t newest = 0;
+  uint32_t oldest = 0;
+  RecordHeader header;
+
+  // the sector that starts with the highest sequence is the head, the lowest the tail
+  for (uint32_t sector = 0; sector < sectorCount; sector++)
+  {
+    if (!readHeader(sector, 0, header))
+    {
+      continue;
+    }
+    if (!found || header.sequence > newest)
+    {
+      newest = header.sequence;
+      headSector = sector;
+    }
+    if (!found || header.sequence < oldest)
+    {
+      oldest = header.sequence;
+      tailSector = sector;
+    }
+    found = true;
+  }
+
+  if (!found)
+  {
+    // empty or unformatted partition, start from scratch
+    esp_partition_erase_range(partition, 0, STORE_SECTOR_SIZE);
+    headSector = 0;
+    headOffset = 0;
+    tailSector = 0;
+    readSector = 0;
+    readOffset = 0;
+    return;
+  }
+
+  // walk every record from tail to head for the sequence and acknowledgement counters
+  uint32_t sector = tailSector;
+  for (;;)
+  {
+    uint32_t offset = 0;
+    while (readHeader(sector, offset, header))
+    {
+      if (header.sequence >= nextSequence)
+      {
+        nextSequence = header.sequence + 1;
+      }
+      if (header.type == STORE_RECORD_ACK && header.length == sizeof(uint32_t))
+      {
+        uint32_t acked;
+        esp_partition_read(partition, sector * STORE_SECTOR_SIZE + offset + STORE_HEADER_LENGTH, &acked, sizeof(acked));
+        if (acked > ackedSequence)
+        {
+          ackedSequence = acked;
+        }
+      }
+      offset += recordLength(header.length);
+    }
+    if (sector == headSector)
+    {
+      headOffset = offset;
+      break;
+    }
+    sector = (sector + 1) % sectorCount;
+  }
+
+  // a record torn by a power cut leaves programmed bytes behind, do not write over them
+  if (headOffset + STORE_HEADER_LENGTH <= STORE_SECTOR_SIZE)
+  {
+    uint8_t erased[STORE_HEADER_LENGTH];
+    esp_partition_read(partition, headSector * STORE_SECTOR_SIZE + headOffset, erased, STORE_HEADER_LENGTH);
+    for (uint8_t i = 0; i < STORE_HEADER_LENGTH; i++)
+    {
+      if (erased[i] != 0xFF)
+      {
+        headOffset = STORE_SECTOR_SIZE;
+        break;
+      }
+    }
+  }
+
+  sector = tailSector;
+  for (;;)
+  {
+    pendingCount += countPending(sector);
+    if (sector == headSector)
+    {
+      break;
+    }
+    sector = (sector + 1) % sectorCount;
+  }
+  readSector = tailSector;
+  readOffset = 0;
+}
+
+// erase the sector after the head and move into it, dropping the oldest sector if the log is full
+bool ReadingStore::nextSector()
+{
+  uint32_t next = (headSector + 1) % sectorCount;
+  if (next == tailSector)
+  {
+    uint32_t lost = countPending(next);
+    if (lost > 0)
+    {
+      Serial.println("Reading store full, dropping " + String(lost) + " oldest readings.");
+    }
+    pendingCount -= lost;
+    tailSector = (tailSector + 1) % sectorCount;
+    if (readSector == next)
+    {
+      readSector = tailSector;
+      readOffset = 0;
+    }
+  }
+
+  if (esp_partition_erase_range(partition, next * STORE_SECTOR_SIZE, STORE_SECTOR_SIZE) != ESP_OK)
+  {
+    Serial.println("Failed to erase reading store sector.");
+    return false;
+  }
+  headSector = next;
+  headOffset = 0;
+
+  // carry the acknowledgement cursor into the new sector
+  uint32_t acked = ackedSequence;
+  return write(STORE_RECORD_ACK, (const uint8_t*)&acked, sizeof(acked));
+}
+
+// append a record at the head, moving to the next sector when it does not fit
+bool ReadingStore::write(uint8_t type, const uint8_t* payload, uint32_t length)
+{
+  if (length > STORE_MAX_PAYLOAD)
+  {
+    return false;
+  }
+  if (headOffset + recordLength(length) > STORE_SECTOR_SIZE && !nextSector())
+  {
+    return false;
+  }
+
+  RecordHeader header;
+  header.magic = STORE_RECORD_MAGIC;
+  header.type = type;
+  header.reserved = 0xFF;
+  header.sequence = nextSequence;
+  header.length = length;
+  uint32_t crc = 0xFFFFFFFF;
+  crc = crc32Update(crc, (const uint8_t*)&header.sequence, sizeof(header.sequence));
+  crc = crc32Update(crc, (const uint8_t*)&header.length, sizeof(header.length));
+  crc = crc32Update(crc, payload, length);
+  header.crc = crc ^ 0xFFFFFFFF;
+
+  uint32_t address = headSector * STORE_SECTOR_SIZE + headOffset;
+  // advance first, a failed write must not be written over again
+  headOffset += recordLength(length);
+  nextSequence++;
+  if (esp_partition_write(partition, address, &header, STORE_HEADER_LENGTH) != ESP_OK
+    || esp_partition_write(partition, address + STORE_HEADER_LENGTH, payload, length) != ESP_OK)
+  {
+    Serial.println("Failed to write to reading store.");
+    return false;
+  }
+  return true;
+}
+
+/*
+Queue a reading that could not be sent.
+
+@return false if the store is disabled or the reading is too large
+*/
+bool ReadingStore::append(const char *reading, size_t length)
+{
+  if (!enabled() || !write(STORE_RECORD_READING, (const uint8_t*)reading, length))
+  {
+    return false;
+  }
+  pendingCount++;
+  return true;
+}
+
+/*
+Read the oldest reading that has not been acknowledged into buffer, without removing it.
+The reading is NUL terminated, a buffer of STORE_MAX_PAYLOAD + 1 bytes fits any reading.
+
+@return false if there is nothing waiting or it does not fit in buffer
+*/
+bool ReadingStore::peek(char *buffer, size_t capacity, size_t &length, uint32_t &sequence)
+{
+  if (!enabled())
+  {
+    return false;
+  }
+
+  RecordHeader header;
+  for (;;)
+  {
+    if (!readHeader(readSector, readOffset, header))
+    {
+      // end of this sector
+      if (readSector == headSector)
+      {
+        return false;
+      }
+      readSector = (readSector + 1) % sectorCount;
+      readOffset = 0;
+      continue;
+    }
+    if (header.type == STORE_RECORD_READING && header.sequence > ackedSequence)
+    {
+      break;
+    }
+    readOffset += recordLength(header.length);
+  }
+
+  if (header.length + 1 > capacity)
+  {
+    return false;
+  }
+  esp_partition_read(partition, readSector * STORE_SECTOR_SIZE + readOffset + STORE_HEADER_LENGTH, buffer, header.length);
+  buffer[header.length] = 0;
+  length = header.length;
+  sequence = header.sequence;
+  return true;
+}
+
+/*
+Mark every reading up to and including sequence as delivered.
+*/
+void ReadingStore::acknowledge(uint32_t sequence)
+{
+  if (!enabled() || sequence <= ackedSequence)
+  {
+    return;
+  }
+  uint32_t previous = ackedSequence;
+  ackedSequence = sequence;
+  write(STORE_RECORD_ACK, (const uint8_t*)&sequence, sizeof(sequence));
+
+  // move the read cursor past what was just acknowledged
+  RecordHeader header;
+  while (!(readSector == headSector && readOffset >= headOffset))
+  {
+    if (!readHeader(readSector, readOffset, header))
+    {
+      if (readSector == headSector)
+      {
+        break;
+      }
+      readSector = (readSector + 1) % sectorCount;
+      readOffset = 0;
+      continue;
+    }
+    if (header.sequence > sequence)
+    {
+      break;
+    }
+    if (header.type == STORE_RECORD_READING && header.sequence > previous && pendingCount > 0)
+    {
+      pendingCount--;
+    }
+    readOffset += recordLength(header.length);
+  }
+}
+
+// number of readings waiting to be sent
+uint32_t ReadingStore::pending() const
+{
+  return pendingCount;
+}
@@ -0,0 +1,76 @@
+/*
+Store-and-forward queue for readings that could not be sent to the endpoint.
+
+Readings are kept in an append-only ring log in the "readings" flash partition
+(see partitions.csv). The partition is used as a ring of 4 KB sectors, each
+holding whole records:
+
+	magic (2) | type (1) | reserved (1) | sequence (4) | length (4) | CRC-32 (4) | payload
+
+The CRC covers the sequence, length and payload, so a record torn by a power
+cut is dropped on the next boot. Every record, including acknowledgements,
+takes the next sequence number, which is how the newest sector is found again.
+
+Readings are acknowledged by sequence cursor: acknowledge(n) appends an
+acknowledgement record meaning "everything up to n was delivered". The latest
+cursor is also written at the start of every sector the log moves into, so it
+survives the sector that held it being erased. When the log is full the oldest
+sector is erased and its readings are lost, newest data wins.
+
+A node flashed over OTA keeps its old partition table and has no "readings"
+partition, begin() then returns false and the store stays disabled.
+*/
+
+#ifndef ReadingStore_h
+#define ReadingStore_h
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#define STORE_PARTITION_LABEL "readings"
+#define STORE_SECTOR_SIZE 4096
+#define STORE_RECORD_MAGIC 0x5352  // "RS", erased flash reads 0xFFFF
+#define STORE_RECORD_READING 1
+#define STORE_RECORD_ACK 2
+#define STORE_HEADER_LENGTH 16
+#define STORE_MAX_PAYLOAD (STORE_SECTOR_SIZE - 2 * STORE_HEADER_LENGTH - 8) // room for the sector's leading acknowledgement
+
+class ReadingStore {
+	private:
+		struct RecordHeader {
+			uint16_t magic;
+			uint8_t type;
+			uint8_t reserved;
+			uint32_t sequence;
+			uint32_t length;
+			uint32_t crc;
+		};
+
+		const esp_partition_t* partition;
+		uint32_t sectorCount;
+		uint32_t headSector;       // sector being appended to
+		uint32_t headOffset;       // next free byte in the head sector
+		uint32_t tailSector;       // sector holding the oldest records
+		uint32_t readSector;       // position of the next record peek() looks at
+		uint32_t readOffset;
+		uint32_t nextSequence;
+		uint32_t ackedSequence;    // every reading up to this one was delivered
+		uint32_t pendingCount;     // readings after ackedSequence
+
+		static uint32_t recordLength(uint32_t payloadLength);
+		bool readHeader(uint32_t sector, uint32_t offset, RecordHeader &header);
+		uint32_t countPending(uint32_t sector);
+		bool write(uint8_t type, const uint8_t* payload, uint32_t length);
+		bool nextSector();
+		void recover();
+	public:
+		ReadingStore();
+		bool begin();
+		bool enabled() const;
+		bool append(const char *reading, size_t length);
+		bool peek(char *buffer, size_t capacity, size_t &length, uint32_t &sequence);
+		void acknowledge(uint32_t sequence);
+		uint32_t pending() const;
+};
+
+#endif
@@ -0,0 +1,366 @@
+/*
+Serializes snapshots into JSON and MessagePack bodies.
+See ReplySerializer.h for the layout and how the header is reused.
+*/
+
+#include "protocol.h"
+#include "SenseStackFrame.h"
+#include "ReplySerializer.h"
+
+// helper function to add the time and the readings of a snapshot to a JSON document
+static void buildReadings(const SensorSnapshot &snapshot, JsonDocument &jsonDoc)
+{
+  if (snapshot.timestamp != 0)
+  {
+    jsonDoc["timestamp"] = snapshot.timestamp;
+  }
+  if (snapshot.delta)
+  {
+    jsonDoc["delta"] = true;
+  }
+  JsonObject dataObj = jsonDoc.createNestedObject("data");
+  JsonObject unitObj = jsonDoc.createNestedObject("units");
+
+  // keys and text values are linked, not copied, the snapshot outlives the document
+  for (uint8_t i = 0; i < snapshot.readingCount; i++)
+  {
+    const SensorReading &reading = snapshot.readings[i];
+    if (reading.numeric)
+    {
+      dataObj[reading.key] = reading.value;
+      unitObj[reading.key] = unitName(reading.unit);
+    }
+    else
+    {
+      dataObj[reading.key] = reading.text;
+    }
+  }
+}
+
+ReplySerializer::ReplySerializer()
+{
+  strcpy(header, "{}");
+  headerLength = 2;
+  packedHeaderLength = 0;
+  packedHeaderEntries = 0;
+}
+
+// render the node information, call whenever the settings change
+void ReplySerializer::setNode(const String &uuid, const String &name, const String &lat, const String &lon)
+{
+  StaticJsonDocument<JSON_OBJECT_SIZE(4) + SERIALIZER_HEADER_LENGTH> jsonDoc;
+  jsonDoc["uuid"] = uuid.c_str();
+  jsonDoc["name"] = name.c_str();
+  jsonDoc["lat"] = lat.toDouble();
+  jsonDoc["long"] = lon.toDouble();
+
+  if (measureJson(jsonDoc) >= SERIALIZER_HEADER_LENGTH)
+  {
+    Serial.println("Node information too long, leaving it out of replies.");
+    strcpy(header, "{}");
+    headerLength = 2;
+    packedHeaderLength = 0;
+    packedHeaderEntries = 0;
+    return;
+  }
+  headerLength = serializeJson(jsonDoc, header, SERIALIZER_HEADER_LENGTH);
+
+  // the packed header is left out on its own if it does not fit
+  MsgPackWriter packer(packedHeader, sizeof(packedHeader));
+  packer.writeString("uuid");
+  packer.writeString(uuid.c_str());
+  packer.writeString("name");
+  packer.writeString(name.c_str());
+  packer.writeString("lat");
+  packer.writeDouble(lat.toDouble());
+  packer.writeString("long");
+  packer.writeDouble(lon.toDouble());
+  packedHeaderLength = packer.length();
+  packedHeaderEntries = packedHeaderLength > 0 ? 4 : 0;
+}
+
+// render the node information and the readings of a snapshot
+size_t ReplySerializer::render(const SensorSnapshot &snapshot, char *buffer, size_t capacity) const
+{
+  if (headerLength + 1 > capacity)
+  {
+    return 0;
+  }
+  memcpy(buffer, header, headerLength + 1);
+
+  StaticJsonDocument<MAX_JSON_REPLY> jsonDoc;
+  buildReadings(snapshot, jsonDoc);
+  size_t length = append(jsonDoc, buffer, headerLength, capacity);
+  return length > 0 ? appendStats(snapshot, buffer, length, capacity) : 0;
+}
+
+// render only the time and readings of a snapshot, one sample of a batch
+size_t ReplySerializer::renderSample(const SensorSnapshot &snapshot, char *buffer, size_t capacity) const
+{
+  StaticJsonDocument<MAX_JSON_REPLY> jsonDoc;
+  buildReadings(snapshot, jsonDoc);
+  if (measureJson(jsonDoc) + 1 > capacity)
+  {
+    return 0;
+  }
+  size_t length = serializeJson(jsonDoc, buffer, capacity);
+  return appendStats(snapshot, buffer, length, capacity);
+}
+
+// render the node information followed by "samples":[<samples>]
+size_t ReplySerializer::renderBatch(const char *samples, size_t length, char *buffer, size_t capacity) const
+{
+  static const char open[] = "\"samples\":[";
+  static const char close[] = "]}";
+  size_t total = headerLength + (sizeof(open) - 1) + length + (sizeof(close) - 1);
+  if (total + 1 > capacity)
+  {
+    return 0;
+  }
+
+  // replace the closing brace of the header with a separator, or drop it if the header is empty
+  memcpy(buffer, header, headerLength - 1);
+  size_t position = headerLength - 1;
+  if (headerLength > 2)
+  {
+    buffer[position++] = ',';
+  }
+  else
+  {
+    total--;
+  }
+  memcpy(buffer + position, open, sizeof(open) - 1);
+  position += sizeof(open) - 1;
+  memcpy(buffer + position, samples, length);
+  position += length;
+  memcpy(buffer + position, close, sizeof(close));
+  return total;
+}
+
+/*
+Append the members of a document to the object held in buffer.
+
+@param length : length of the object already in buffer, including its closing brace
+
+@return new length, or 0 if the members do not fit
+*/
+size_t ReplySerializer::append(const JsonDocument &fields, char *buffer, size_t length, size_t capacity)
+{
+  if (fields.size() == 0)
+  {
+    return length;
+  }
+  size_t fieldsLength = measureJson(fields);
+  // the opening brace of the fields takes the place of the closing brace in buffer
+  if (length - 1 + fieldsLength + 1 > capacity)
+  {
+    return 0;
+  }
+
+  bool empty = length <= 2;
+  serializeJson(fields, buffer + length - 1, capacity - length + 1);
+  if (empty)
+  {
+    // "{" followed by the fields object would start with "{{", shift it over the brace
+    memmove(buffer, buffer + 1, fieldsLength + 1);
+    return fieldsLength;
+  }
+  buffer[length - 1] = ',';
+  return length - 1 + fieldsLength;
+}
+
+/*
+Append "stats":{...} with the window statistics of the readings to the object held in buffer.
+Written without a document, one JSON object per reading would need several times
+the document memory of the readings themselves.
+
+@param length : length of the object already in buffer, including its closing brace
+
+@return new length, or length unchanged if there are no statistics or they do not fit
+*/
+size_t ReplySerializer::appendStats(const SensorSnapshot &snapshot, char *buffer, size_t length, size_t capacity)
+{
+  // the statistics take the place of the closing brace
+  size_t position = length - 1;
+  uint8_t added = 0;
+  bool fits = true;
+  for (uint8_t i = 0; i < snapshot.readingCount && fits; i++)
+  {
+    const SensorReading &reading = snapshot.readings[i];
+    if (reading.stats.count == 0)
+    {
+      continue;
+    }
+
+    const char *separator = added > 0 ? "," : (length > 2 ? ",\"stats\":{" : "\"stats\":{");
+    int written = snprintf(buffer + position, capacity - position, "%s", separator);
+    fits = written >= 0 && position + written < capacity;
+    if (!fits)
+    {
+      break;
+    }
+    position += written;
+
+    // the key is escaped by ArduinoJson, it may come from a text protocol module
+    StaticJsonDocument<JSON_OBJECT_SIZE(1)> keyDoc;
+    keyDoc.set(reading.key);
+    fits = position + measureJson(keyDoc) < capacity;
+    if (!fits)
+    {
+      break;
+    }
+    position += serializeJson(keyDoc, buffer + position, capacity - position);
+
+    written = snprintf(buffer + position, capacity - position,
+                       ":{\"min\":%.6g,\"max\":%.6g,\"mean\":%.6g,\"stddev\":%.6g,\"count\":%u}",
+                       reading.stats.min, reading.stats.max, reading.stats.mean, reading.stats.stddev, reading.stats.count);
+    fits = written >= 0 && position + written < capacity;
+    position += written;
+    added++;
+  }
+
+  // nothing to add, or it did not fit, closing the two objects needs two more bytes and the NUL
+  if (added == 0 || !fits || position + 2 >= capacity)
+  {
+    buffer[length - 1] = '}';
+    buffer[length] = 0;
+    return length;
+  }
+  buffer[position++] = '}';
+  buffer[position++] = '}';
+  buffer[position] = 0;
+  return position;
+}
+
+// helper function to count the map entries packReadings() writes
+uint8_t ReplySerializer::packedEntries(const SensorSnapshot &snapshot)
+{
+  uint8_t entries = 2; // data and units
+  if (snapshot.timestamp != 0)
+  {
+    entries++;
+  }
+  if (snapshot.delta)
+  {
+    entries++;
+  }
+  for (uint8_t i = 0; i < snapshot.readingCount; i++)
+  {
+    if (snapshot.readings[i].stats.count > 0)
+    {
+      return entries + 1;
+    }
+  }
+  return entries;
+}
+
+// helper function to pack the time, readings, units and statistics of a snapshot as map entries
+void ReplySerializer::packReadings(const SensorSnapshot &snapshot, MsgPackWriter &packer)
+{
+  if (snapshot.timestamp != 0)
+  {
+    packer.writeString("timestamp");
+    packer.writeUnsigned(snapshot.timestamp);
+  }
+  if (snapshot.delta)
+  {
+    packer.writeString("delta");
+    packer.writeBool(true);
+  }
+
+  uint8_t units = 0;
+  uint8_t stats = 0;
+  for (uint8_t i = 0; i < snapshot.readingCount; i++)
+  {
+    units += snapshot.readings[i].numeric;
+    stats += snapshot.readings[i].stats.count > 0;
+  }
+
+  // text readings that hold a number are sent as one, the backend does not parse them again
+  packer.writeString("data");
+  packer.writeMap(snapshot.readingCount);
+  for (uint8_t i = 0; i < snapshot.readingCount; i++)
+  {
+    const SensorReading &reading = snapshot.readings[i];
+    float value;
+    packer.writeString(reading.key);
+    if (reading.number(value))
+    {
+      packer.writeFloat(value);
+    }
+    else
+    {
+      packer.writeString(reading.text);
+    }
+  }
+
+  packer.writeString("units");
+  packer.writeMap(units);
+  for (uint8_t i = 0; i < snapshot.readingCount; i++)
+  {
+    const SensorReading &reading = snapshot.readings[i];
+    if (reading.numeric)
+    {
+      packer.writeString(reading.key);
+      packer.writeString(unitName(reading.unit));
+    }
+  }
+
+  if (stats == 0)
+  {
+    return;
+  }
+  packer.writeString("stats");
+  packer.writeMap(stats);
+  for (uint8_t i = 0; i < snapshot.readingCount; i++)
+  {
+    const SensorReading &reading = snapshot.readings[i];
+    if (reading.stats.count == 0)
+    {
+      continue;
+    }
+    packer.writeString(reading.key);
+    packer.writeMap(5);
+    packer.writeString("min");
+    packer.writeFloat(reading.stats.min);
+    packer.writeString("max");
+    packer.writeFloat(reading.stats.max);
+    packer.writeString("mean");
+    packer.writeFloat(reading.stats.mean);
+    packer.writeString("stddev");
+    packer.writeFloat(reading.stats.stddev);
+    packer.writeString("count");
+    packer.writeUnsigned(reading.stats.count);
+  }
+}
+
+// render the node information and the readings of a snapshot as MessagePack
+size_t ReplySerializer::renderPacked(const SensorSnapshot &snapshot, char *buffer, size_t capacity) const
+{
+  MsgPackWriter packer(buffer, capacity);
+  packer.writeMap(packedHeaderEntries + packedEntries(snapshot));
+  packer.writeRaw(packedHeader, packedHeaderLength);
+  packReadings(snapshot, packer);
+  return packer.length();
+}
+
+// render only the time and readings of a snapshot as MessagePack, one sample of a batch
+size_t ReplySerializer::renderPackedSample(const SensorSnapshot &snapshot, char *buffer, size_t capacity) const
+{
+  MsgPackWriter packer(buffer, capacity);
+  packer.writeMap(packedEntries(snapshot));
+  packReadings(snapshot, packer);
+  return packer.length();
+}
+
+// render the node information followed by "samples" holding count packed samples
+size_t ReplySerializer::renderPackedBatch(const char *samples, size_t length, uint8_t count, char *buffer, size_t capacity) const
+{
+  MsgPackWriter packer(buffer, capacity);
+  packer.writeMap(packedHeaderEntries + 1);
+  packer.writeRaw(packedHeader, packedHeaderLength);
+  packer.writeString("samples");
+  packer.writeArray(count);
+  packer.writeRaw(samples, length);
+  return packer.length();
+}
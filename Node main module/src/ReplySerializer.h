@@ -0,0 +1,59 @@
+/*
+Serializes snapshots into the JSON bodies served and uploaded by the main module.
+
+The node information ({"uuid":..., "name":..., "lat":..., "long":...}) is
+rendered once by setNode() whenever the settings change, and every reply is
+that header with the readings spliced in after it. Everything is rendered into
+caller supplied buffers with documents on the stack, so a reply costs no heap
+allocation and can be written to a socket as is.
+
+	{"uuid":..., "name":..., "lat":..., "long":..., "timestamp":..., "data":{...}, "units":{...}, "stats":{...}}
+
+"stats" holds the window statistics of readings that have them (WindowStats.h).
+They are left out of a reply that would not fit in the buffer with them.
+"delta":true marks a reply holding only the readings that changed (ReportFilter.h).
+
+The uplink can also be sent as MessagePack, the same map with every reading
+that holds a number packed as a 32 bit float (MsgPack.h). renderPacked(),
+renderPackedSample() and renderPackedBatch() mirror their JSON counterparts.
+
+Every render function returns the length written, excluding the terminating
+NUL, or 0 if the buffer is too small.
+*/
+
+#ifndef ReplySerializer_h
+#define ReplySerializer_h
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Snapshot.h"
+#include "MsgPack.h"
+
+#define SERIALIZER_HEADER_LENGTH 256 // rendered node information
+#define SERIALIZER_STATS_LENGTH 2048 // statistics of about 20 readings
+#define JSON_REPLY_LENGTH (MAX_JSON_REPLY + SERIALIZER_STATS_LENGTH) // a reply with statistics
+
+class ReplySerializer {
+	private:
+		char header[SERIALIZER_HEADER_LENGTH];
+		size_t headerLength;
+		char packedHeader[SERIALIZER_HEADER_LENGTH]; // node information as MessagePack map entries
+		size_t packedHeaderLength;
+		uint8_t packedHeaderEntries;
+
+		static uint8_t packedEntries(const SensorSnapshot &snapshot);
+		static void packReadings(const SensorSnapshot &snapshot, MsgPackWriter &packer);
+	public:
+		ReplySerializer();
+		void setNode(const String &uuid, const String &name, const String &lat, const String &lon);
+		size_t render(const SensorSnapshot &snapshot, char *buffer, size_t capacity) const;
+		size_t renderSample(const SensorSnapshot &snapshot, char *buffer, size_t capacity) const;
+		size_t renderBatch(const char *samples, size_t length, char *buffer, size_t capacity) const;
+		size_t renderPacked(const SensorSnapshot &snapshot, char *buffer, size_t capacity) const;
+		size_t renderPackedSample(const SensorSnapshot &snapshot, char *buffer, size_t capacity) const;
+		size_t renderPackedBatch(const char *samples, size_t length, uint8_t count, char *buffer, size_t capacity) const;
+		static size_t append(const JsonDocument &fields, char *buffer, size_t length, size_t capacity);
+		static size_t appendStats(const SensorSnapshot &snapshot, char *buffer, size_t length, size_t capacity);
+};
+
+#endif
@@ -0,0 +1,218 @@
+/*
+Change based reporting: which readings of a snapshot are worth uploading.
+See ReportFilter.h for the deadband list format.
+*/
+
+#include "ReportFilter.h"
+#include "Log.h"
+
+ReportFilter::ReportFilter()
+{
+  deadbandCount = 0;
+  memset(&fallback, 0, sizeof(fallback));
+  sentCount = 0;
+  keyframeSent = false;
+  lastKeyframe = 0;
+}
+
+/*
+Replace the deadbands with those in a list such as "temperature:0.2, humidity:2%".
+Entries that cannot be parsed are skipped, returns false if there were any.
+*/
+bool ReportFilter::configure(const String &list)
+{
+  deadbandCount = 0;
+  memset(&fallback, 0, sizeof(fallback));
+  bool valid = true;
+
+  int start = 0;
+  while (start < (int)list.length())
+  {
+    int end = list.indexOf(',', start);
+    if (end < 0)
+    {
+      end = list.length();
+    }
+    String entry = list.substring(start, end);
+    start = end + 1;
+    entry.trim();
+    if (entry.length() == 0)
+    {
+      continue;
+    }
+
+    int colon = entry.indexOf(':');
+    String key = entry.substring(0, colon);
+    String threshold = entry.substring(colon + 1);
+    key.trim();
+    threshold.trim();
+    Deadband band;
+    band.relative = threshold.endsWith("%");
+    if (band.relative)
+    {
+      threshold.remove(threshold.length() - 1);
+    }
+    char *parsed;
+    band.threshold = strtod(threshold.c_str(), &parsed);
+    if (colon <= 0 || key.length() >= READING_KEY_LENGTH || threshold.length() == 0 || *parsed != 0 || band.threshold < 0)
+    {
+      LOG_WARN("Ignoring deadband \"%s\".", entry.c_str());
+      valid = false;
+      continue;
+    }
+    strncpy(band.key, key.c_str(), READING_KEY_LENGTH);
+
+    if (key == "*")
+    {
+      fallback = band;
+    }
+    else if (deadbandCount < REPORT_MAX_DEADBANDS)
+    {
+      deadbands[deadbandCount++] = band;
+    }
+    else
+    {
+      LOG_WARN("Too many deadbands, ignoring \"%s\".", entry.c_str());
+      valid = false;
+    }
+  }
+  return valid;
+}
+
+const ReportFilter::Deadband& ReportFilter::deadband(const char *key) const
+{
+  for (uint8_t i = 0; i < deadbandCount; i++)
+  {
+    if (strcmp(deadbands[i].key, key) == 0)
+    {
+      return deadbands[i];
+    }
+  }
+  return fallback;
+}
+
+// true if a reading moved past its deadband since it was last sent
+bool ReportFilter::changed(const SensorReading &reading, const Sent &last) const
+{
+  float value;
+  if (!reading.number(value))
+  {
+    return strcmp(reading.text, last.text) != 0;
+  }
+  const Deadband &band = deadband(reading.key);
+  float threshold = band.relative ? fabs(last.value) * band.threshold / 100 : band.threshold;
+  return fabs(value - last.value) > threshold;
+}
+
+// helper function to drop what was sent for modules that have no readings in the snapshot any more,
+// the sampling task removes a detached module's readings from every snapshot
+void ReportFilter::forgetDetached(const SensorSnapshot &snapshot)
+{
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < sentCount; i++)
+  {
+    bool attached = false;
+    for (uint8_t j = 0; j < snapshot.readingCount && !attached; j++)
+    {
+      attached = snapshot.readings[j].module == sent[i].module;
+    }
+    if (attached)
+    {
+      sent[kept++] = sent[i];
+    }
+  }
+  sentCount = kept;
+}
+
+// helper function to find room for a key that was not sent before, taking the one sent longest ago if full
+ReportFilter::Sent *ReportFilter::track(const SensorReading &reading, unsigned long now)
+{
+  Sent *slot;
+  if (sentCount < SNAPSHOT_MAX_READINGS)
+  {
+    slot = &sent[sentCount++];
+  }
+  else
+  {
+    slot = &sent[0];
+    for (uint8_t i = 1; i < sentCount; i++)
+    {
+      if (now - sent[i].at > now - slot->at)
+      {
+        slot = &sent[i];
+      }
+    }
+  }
+  strncpy(slot->key, reading.key, READING_KEY_LENGTH);
+  slot->module = reading.module;
+  return slot;
+}
+
+/*
+Copy the readings of snapshot that are due into report.
+Returns false if none is, the upload can then be skipped.
+*/
+bool ReportFilter::select(const SensorSnapshot &snapshot, SensorSnapshot &report, unsigned long now,
+                          unsigned long heartbeat, unsigned long keyframeInterval)
+{
+  bool keyframe = !keyframeSent || now - lastKeyframe >= keyframeInterval;
+  report.clear();
+  report.sequence = snapshot.sequence;
+  report.takenAt = snapshot.takenAt;
+  report.timestamp = snapshot.timestamp;
+  report.moduleCount = snapshot.moduleCount;
+  report.delta = !keyframe;
+
+  // a keyframe sends every reading, so what was sent is tracked afresh from it
+  if (keyframe)
+  {
+    sentCount = 0;
+  }
+  else
+  {
+    forgetDetached(snapshot);
+  }
+
+  for (uint8_t i = 0; i < snapshot.readingCount; i++)
+  {
+    const SensorReading &reading = snapshot.readings[i];
+    Sent *last = NULL;
+    for (uint8_t j = 0; j < sentCount; j++)
+    {
+      if (sent[j].module == reading.module && strcmp(sent[j].key, reading.key) == 0)
+      {
+        last = &sent[j];
+        break;
+      }
+    }
+
+    if (!keyframe && last != NULL && now - last->at < heartbeat && !changed(reading, *last))
+    {
+      continue;
+    }
+    report.readings[report.readingCount++] = reading;
+
+    if (last == NULL)
+    {
+      last = track(reading, now);
+    }
+    last->value = 0;
+    reading.number(last->value);
+    strncpy(last->text, reading.text, READING_TEXT_LENGTH);
+    last->at = now;
+  }
+
+  if (keyframe)
+  {
+    keyframeSent = true;
+    lastKeyframe = now;
+  }
+  return report.readingCount > 0;
+}
+
+// forget what was sent, the next upload is a keyframe
+void ReportFilter::reset()
+{
+  sentCount = 0;
+  keyframeSent = false;
+}
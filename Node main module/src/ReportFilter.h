@@ -0,0 +1,67 @@
+/*
+Change based reporting: which readings of a snapshot are worth uploading.
+
+Each key has a deadband, an absolute step or a percentage of the value last
+sent. A reading is uploaded when it moved past its deadband since it was last
+sent, or when it has not been sent for the heartbeat interval. Everything else
+is left out of the upload, and an upload where nothing changed is skipped.
+Every keyframe interval all readings are sent, so a backend that missed an
+upload or just started can rebuild the full state. Uploads that leave readings
+out carry "delta":true.
+
+Deadbands are configured as a comma separated list, "*" sets the default
+for keys that are not listed and is 0 (any change) when left out:
+	temperature:0.2, humidity:2%, co_density:0.5, *:1%
+
+Text readings that are not numbers are sent whenever their text changes.
+
+What was sent is tracked afresh from every keyframe, and the readings of a
+module that left the snapshot are forgotten, so modules swapped or replugged
+between keyframes do not fill up the table.
+*/
+
+#ifndef ReportFilter_h
+#define ReportFilter_h
+
+#include <Arduino.h>
+#include "Snapshot.h"
+
+#define REPORT_MAX_DEADBANDS 16
+
+class ReportFilter {
+	private:
+		struct Deadband {
+			char key[READING_KEY_LENGTH];
+			float threshold;
+			bool relative;               // threshold is a percentage of the value last sent
+		};
+
+		struct Sent {
+			char key[READING_KEY_LENGTH];
+			byte module;
+			float value;
+			char text[READING_TEXT_LENGTH];
+			unsigned long at;            // millis() when it was last sent
+		};
+
+		Deadband deadbands[REPORT_MAX_DEADBANDS];
+		uint8_t deadbandCount;
+		Deadband fallback;               // the "*" entry
+		Sent sent[SNAPSHOT_MAX_READINGS];
+		uint8_t sentCount;
+		bool keyframeSent;
+		unsigned long lastKeyframe;
+
+		const Deadband& deadband(const char *key) const;
+		bool changed(const SensorReading &reading, const Sent &last) const;
+		void forgetDetached(const SensorSnapshot &snapshot);
+		Sent *track(const SensorReading &reading, unsigned long now);
+	public:
+		ReportFilter();
+		bool configure(const String &list);
+		bool select(const SensorSnapshot &snapshot, SensorSnapshot &report, unsigned long now,
+		            unsigned long heartbeat, unsigned long keyframeInterval);
+		void reset();
+};
+
+#endif
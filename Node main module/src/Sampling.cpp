@@ -0,0 +1,471 @@
+/*
+Polling of the sensor modules on the I2C bus.
+See Sampling.h for the protocols a module may answer with.
+*/
+
+#include <Wire.h>
+#include "protocol.h"
+#include "SenseStackFrame.h"
+#include "Sampling.h"
+#include "Metrics.h"
+#include "Log.h"
+
+// helper function to request a reply chunk from a module, counting the transfer
+static uint8_t requestChunk(byte sensorAddr, uint8_t length)
+{
+  uint8_t received = Wire.requestFrom(sensorAddr, length);
+  metrics.moduleTransaction(sensorAddr, received);
+  return received;
+}
+
+// helper function to read a binary reply whose first chunk is waiting in the Wire buffer.
+// announcedLength() gets the total length out of the header, the reply is cut to it.
+static uint8_t readChunkedReply(byte sensorAddr, uint8_t *reply, uint8_t (*announcedLength)(const uint8_t *header))
+{
+  uint8_t length = 0;
+  uint8_t replyCount = 1;
+
+  while (Wire.available() && length < FRAME_CHUNK_LENGTH)
+  {
+    reply[length++] = Wire.read();
+  }
+
+  // the first chunk may be padded, keep only what the header announces
+  uint8_t expectedLength = announcedLength(reply);
+  if (length > expectedLength)
+  {
+    length = expectedLength;
+  }
+
+  // request the remaining chunks of a long reply
+  while (length < expectedLength)
+  {
+    if(replyCount >= DATA_TRANSMISSION_TIMEOUT)
+    {
+      LOG_WARN("Too many transmissions from module 0x%02X. Terminating!", sensorAddr);
+      metrics.moduleTimeout(sensorAddr);
+      break;
+    }
+    uint8_t chunkLength = expectedLength - length;
+    if (chunkLength > FRAME_CHUNK_LENGTH)
+    {
+      chunkLength = FRAME_CHUNK_LENGTH;
+    }
+    requestChunk(sensorAddr, chunkLength);
+    replyCount++;
+    while (Wire.available() && length < expectedLength)
+    {
+      reply[length++] = Wire.read();
+    }
+  }
+  LOG_DEBUG("Request complete. Total of %u transmissions.", replyCount);
+  return length;
+}
+
+// helper function to add one binary reading to the snapshot, false once the snapshot is full
+static bool addBinaryReading(byte sensorAddr, uint8_t channel, uint8_t unit, float value, SensorSnapshot &snapshot)
+{
+  // the key is the interned channel name, no string is built for it
+  const char* key = channelName(channel);
+  SensorReading* reading = snapshot.add(key, sensorAddr);
+  if (reading == NULL)
+  {
+    LOG_WARN("Too many readings, discarding.");
+    return false;
+  }
+  // round to the same two decimals the text protocol sends
+  reading->value = round(value * 100) / 100.0;
+  reading->unit = unit;
+  reading->numeric = true;
+  LOG_DEBUG("Parsed reading: %s = %.2f", key, value);
+  return true;
+}
+
+// helper function to read a binary frame whose first chunk is waiting in the Wire buffer
+void readSensorFrame(byte sensorAddr, SensorSnapshot &snapshot)
+{
+  uint8_t frame[FRAME_MAX_LENGTH] = {0};
+  uint8_t frameLength = readChunkedReply(sensorAddr, frame, FrameDecoder::expectedLength);
+
+  FrameDecoder decoder(frame, frameLength);
+  if (!decoder.valid())
+  {
+    LOG_WARN("Invalid frame from module 0x%02X, discarding.", sensorAddr);
+    return;
+  }
+
+  for (uint8_t i = 0; i < decoder.records(); i++)
+  {
+    FrameRecord record = decoder.record(i);
+    if (!addBinaryReading(sensorAddr, record.channel, record.unit, record.value, snapshot))
+    {
+      break;
+    }
+  }
+}
+
+// helper function to read a values frame whose first chunk is waiting in the Wire buffer.
+// Returns false if it follows another descriptor than the cached one.
+bool readSensorValues(byte sensorAddr, const ModuleDescriptor &descriptor, SensorSnapshot &snapshot)
+{
+  uint8_t frame[VALUES_MAX_LENGTH] = {0};
+  uint8_t frameLength = readChunkedReply(sensorAddr, frame, valuesLength);
+  if (frameLength > 1 && frame[1] != descriptor.id)
+  {
+    LOG_INFO("Module 0x%02X changed its descriptor.", sensorAddr);
+    return false;
+  }
+
+  float values[FRAME_MAX_RECORDS];
+  uint16_t present;
+  if (!decodeValues(frame, frameLength, descriptor, values, present))
+  {
+    LOG_WARN("Invalid values frame from module 0x%02X, discarding.", sensorAddr);
+    return true;
+  }
+
+  for (uint8_t i = 0; i < descriptor.channelCount; i++)
+  {
+    const ChannelDescriptor &channel = descriptor.channels[i];
+    if ((present & (1 << i)) && !addBinaryReading(sensorAddr, channel.channel, channel.unit, values[i], snapshot))
+    {
+      break;
+    }
+  }
+  return true;
+}
+
+// helper function to read text fragments, the first of which is waiting in the Wire buffer
+void readSensorText(byte sensorAddr, SensorSnapshot &snapshot)
+{
+  bool endTransmission = false;
+
+  char replyData[MAX_SENSOR_REPLY_LENGTH] = {0};
+  char lastSpecifier = 0;
+  char dataKey[READING_KEY_LENGTH] = {0};
+  uint8_t replyCharIter = 0;
+  uint8_t replyCount = 1;
+
+  // read all data sensor module has to offer (with timeout)
+  while(true)
+  { 
+    // read until end of transmission
+    while (Wire.available() && !endTransmission)
+    {
+      // read each individual character
+      char c = Wire.read();
+      switch(c) {
+        case CH_IS_KEY:
+          lastSpecifier = c;
+          replyCharIter = 0;
+          break;
+
+        case CH_IS_VALUE:
+          lastSpecifier = c;
+          replyCharIter = 0;
+          break;
+
+        case CH_MORE:
+          // terminate reply string
+          replyData[replyCharIter] = 0;
+          // print out reading to see what we got
+          LOG_DEBUG("Parsed reading: %s", replyData);
+          // put the parsed reading in the right string and add data to JSON
+          if(lastSpecifier == CH_IS_KEY)
+          {
+            strncpy(dataKey, replyData, READING_KEY_LENGTH - 1);
+          }
+          else if(lastSpecifier == CH_IS_VALUE)
+          {
+            // add the pair to the snapshot
+            SensorReading* reading = snapshot.add(dataKey, sensorAddr);
+            if (reading != NULL)
+            {
+              strncpy(reading->text, replyData, READING_TEXT_LENGTH - 1);
+              reading->text[READING_TEXT_LENGTH - 1] = 0;
+            }
+          }
+          else
+          {
+            LOG_WARN("Unknown reading, discarding.");
+          }
+          // clear the data buffer
+          memset(replyData,0,sizeof(replyData));
+          replyCharIter = 0;
+          lastSpecifier = c;
+          endTransmission = true;
+          break;
+
+        case CH_TERMINATE:
+          // same as CH_more
+          // terminate reply string
+          replyData[replyCharIter] = 0;
+          // print out reading to see what we got
+          LOG_DEBUG("Parsed reading: %s", replyData);
+          // put the parsed reading in the right string and add data to JSON
+          if(lastSpecifier == CH_IS_KEY)
+          {
+            strncpy(dataKey, replyData, READING_KEY_LENGTH - 1);
+          }
+          else if(lastSpecifier == CH_IS_VALUE)
+          {
+            // add the pair to the snapshot
+            SensorReading* reading = snapshot.add(dataKey, sensorAddr);
+            if (reading != NULL)
+            {
+              strncpy(reading->text, replyData, READING_TEXT_LENGTH - 1);
+              reading->text[READING_TEXT_LENGTH - 1] = 0;
+            }
+          }
+          else
+          {
+            LOG_WARN("Unknown reading, discarding.");
+          }
+          // clear the data buffer
+          memset(replyData,0,sizeof(replyData));
+          replyCharIter = 0;
+          lastSpecifier = c;
+          endTransmission = true;
+          break;
+
+        default:
+          // append the character into the reply data array and increment replyCharIter
+          if (replyCharIter < MAX_SENSOR_REPLY_LENGTH - 1)
+          {
+            replyData[replyCharIter++] = c;
+          }
+          break;
+      }
+    }
+
+    if (lastSpecifier == CH_TERMINATE)
+    {
+      break;
+    }
+    // check timeout
+    if(replyCount >= DATA_TRANSMISSION_TIMEOUT)
+    {
+      LOG_WARN("Too many transmissions from module 0x%02X. Terminating!", sensorAddr);
+      metrics.moduleTimeout(sensorAddr);
+      break;
+    }
+    // start i2c transmission to module
+    requestChunk(sensorAddr, MAX_SENSOR_REPLY_LENGTH);
+    endTransmission = false;
+    replyCount++;
+  }
+  LOG_DEBUG("Request complete. Total of %u transmissions.", replyCount);
+}
+
+// helper function to request data from a sensor module and add it to the snapshot.
+// Returns false if the module did not answer.
+bool getSensorModuleReading(byte sensorAddr, SensorSnapshot &snapshot)
+{
+  // print out who we are communicating with
+  LOG_DEBUG("Sending request to 0x%02X", sensorAddr);
+
+  // ask for a binary frame, modules that only speak the text protocol ignore this.
+  // The command and the read share one bus transaction through a repeated start,
+  // and since modules serve a reply prepared in advance a frame of up to
+  // FRAME_CHUNK_LENGTH bytes arrives in this single burst.
+  Wire.beginTransmission(sensorAddr);
+  Wire.write(CMD_READ_FRAME);
+  Wire.endTransmission(false);
+  metrics.moduleTransaction(sensorAddr, 1);
+
+  // the first byte of the reply tells which protocol the module answered with
+  if (requestChunk(sensorAddr, FRAME_CHUNK_LENGTH) == 0)
+  {
+    LOG_WARN("Module 0x%02X did not answer.", sensorAddr);
+    return false;
+  }
+  if (Wire.peek() == CH_IS_FRAME)
+  {
+    readSensorFrame(sensorAddr, snapshot);
+  }
+  else
+  {
+    readSensorText(sensorAddr, snapshot);
+  }
+  return true;
+}
+
+/*
+Ask a module with a cached descriptor for a values frame and add its readings to the snapshot.
+A module that answers with a frame or text instead is read all the same.
+
+@param stale : set if the module no longer follows the descriptor, which should be read again
+
+@return false if the module did not answer
+*/
+bool getSensorModuleValues(byte sensorAddr, const ModuleDescriptor &descriptor, SensorSnapshot &snapshot, bool &stale)
+{
+  LOG_DEBUG("Sending values request to 0x%02X", sensorAddr);
+  stale = false;
+
+  Wire.beginTransmission(sensorAddr);
+  Wire.write(CMD_READ_VALUES);
+  Wire.endTransmission(false);
+  metrics.moduleTransaction(sensorAddr, 1);
+
+  if (requestChunk(sensorAddr, FRAME_CHUNK_LENGTH) == 0)
+  {
+    LOG_WARN("Module 0x%02X did not answer.", sensorAddr);
+    return false;
+  }
+  switch (Wire.peek())
+  {
+    case CH_IS_VALUES:
+      stale = !readSensorValues(sensorAddr, descriptor, snapshot);
+      break;
+    case CH_IS_FRAME:
+      // nothing published since the module was described
+      readSensorFrame(sensorAddr, snapshot);
+      break;
+    default:
+      // firmware without descriptors took the place of the module
+      stale = true;
+      readSensorText(sensorAddr, snapshot);
+      break;
+  }
+  return true;
+}
+
+// helper function to poll a module the cheapest way it supports: a values frame once its
+// descriptor is known, otherwise a frame or text. Newly seen modules are asked for a descriptor first.
+bool pollSensorModule(ModuleRegistry &registry, byte sensorAddr, SensorSnapshot &snapshot)
+{
+  if (registry.needsDescriptor(sensorAddr))
+  {
+    ModuleDescriptor descriptor;
+    bool described = readModuleDescriptor(sensorAddr, descriptor);
+    registry.describe(sensorAddr, described ? &descriptor : NULL);
+  }
+
+  const ModuleDescriptor *cached = registry.descriptor(sensorAddr);
+  if (cached == NULL)
+  {
+    return getSensorModuleReading(sensorAddr, snapshot);
+  }
+
+  bool stale;
+  uint8_t readingsBefore = snapshot.readingCount;
+  bool answered = getSensorModuleValues(sensorAddr, *cached, snapshot, stale);
+  if (stale)
+  {
+    registry.forgetDescriptor(sensorAddr);
+    if (snapshot.readingCount == readingsBefore)
+    {
+      // the values followed another descriptor and were dropped, read this poll as a frame
+      answered = getSensorModuleReading(sensorAddr, snapshot);
+    }
+  }
+  return answered;
+}
+
+// helper function to request data from all connected modules into a snapshot
+void fetchData(ModuleRegistry &registry, SensorSnapshot &snapshot)
+{
+  snapshot.clear();
+
+  // obtain information from sensors, polling a copy of the list
+  // since a module that stops answering is detached from the registry
+  LOG_DEBUG("Gathering sensor data.");
+  byte modules[MAX_SENSORS];
+  uint8_t moduleCount = registry.count();
+  for (uint8_t i = 0; i < moduleCount; i++)
+  {
+    modules[i] = registry.address(i);
+  }
+  for (uint8_t i = 0; i < moduleCount; i++)
+  {
+    bool answered = pollSensorModule(registry, modules[i], snapshot);
+    registry.pollResult(modules[i], answered);
+    if (answered)
+    {
+      snapshot.moduleCount++;
+    }
+  }
+  LOG_DEBUG("Read from %u sensors", snapshot.moduleCount);
+}
+
+// helper function to read the rest of a text reply so the module starts over on the next poll
+static void skipTextReply(byte sensorAddr, const uint8_t *chunk, uint8_t length)
+{
+  uint8_t skipped[MAX_SENSOR_REPLY_LENGTH];
+  uint8_t replyCount = 1;
+  while (memchr(chunk, CH_TERMINATE, length) == NULL && replyCount < DATA_TRANSMISSION_TIMEOUT)
+  {
+    length = requestChunk(sensorAddr, MAX_SENSOR_REPLY_LENGTH);
+    for (uint8_t i = 0; i < length; i++)
+    {
+      skipped[i] = Wire.read();
+    }
+    chunk = skipped;
+    replyCount++;
+  }
+}
+
+// helper function to ask a module for its poll intervals.
+// Modules that do not report them answer with text and get the defaults.
+ModuleTiming readModuleTiming(byte sensorAddr)
+{
+  ModuleTiming timing = {DEFAULT_MIN_INTERVAL, DEFAULT_PREFERRED_INTERVAL};
+
+  Wire.beginTransmission(sensorAddr);
+  Wire.write(CMD_READ_TIMING);
+  Wire.endTransmission(false);
+  metrics.moduleTransaction(sensorAddr, 1);
+
+  uint8_t reply[TIMING_LENGTH];
+  uint8_t length = requestChunk(sensorAddr, TIMING_LENGTH);
+  for (uint8_t i = 0; i < length; i++)
+  {
+    reply[i] = Wire.read();
+  }
+  if (decodeTiming(reply, length, timing.minInterval, timing.preferredInterval))
+  {
+    LOG_INFO("Module 0x%02X polls every %lu ms, at most every %lu ms.", sensorAddr, (unsigned long)timing.preferredInterval, (unsigned long)timing.minInterval);
+  }
+  else if (length > 0)
+  {
+    LOG_INFO("Module 0x%02X does not report its timing, using defaults.", sensorAddr);
+    skipTextReply(sensorAddr, reply, length);
+  }
+  return timing;
+}
+
+// helper function to ask a module for its descriptor.
+// Returns false if it does not have one, modules without descriptors answer with text.
+bool readModuleDescriptor(byte sensorAddr, ModuleDescriptor &descriptor)
+{
+  Wire.beginTransmission(sensorAddr);
+  Wire.write(CMD_READ_DESCRIPTOR);
+  Wire.endTransmission(false);
+  metrics.moduleTransaction(sensorAddr, 1);
+
+  uint8_t reply[DESCRIPTOR_MAX_LENGTH] = {0};
+  uint8_t length = requestChunk(sensorAddr, FRAME_CHUNK_LENGTH);
+  if (length == 0)
+  {
+    return false;
+  }
+  if (Wire.peek() != CH_IS_DESCRIPTOR)
+  {
+    for (uint8_t i = 0; i < length; i++)
+    {
+      reply[i] = Wire.read();
+    }
+    LOG_INFO("Module 0x%02X does not describe itself, polling it for frames.", sensorAddr);
+    skipTextReply(sensorAddr, reply, length);
+    return false;
+  }
+
+  length = readChunkedReply(sensorAddr, reply, descriptorLength);
+  if (!decodeDescriptor(reply, length, descriptor))
+  {
+    LOG_WARN("Invalid descriptor from module 0x%02X, polling it for frames.", sensorAddr);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,37 @@
+/*
+Polling of the sensor modules on the I2C bus.
+
+getSensorModuleReading() asks a module for a binary frame (SenseStackFrame.h)
+and falls back to the text fragments of protocol.h when the module answers
+with text. A module whose descriptor is cached in the registry is asked for a
+values frame by getSensorModuleValues() instead, pollSensorModule() picks
+between the two and reads the descriptor of a module it has not seen before.
+fetchData() polls every module in the registry into a snapshot and reports
+each outcome back to the registry, which detaches modules that stop answering.
+readModuleTiming() asks a newly attached module how often it wants to be
+polled, for the PollScheduler.
+
+Only the sampling task calls these, it is the single user of the bus.
+*/
+
+#ifndef Sampling_h
+#define Sampling_h
+
+#include <Arduino.h>
+#include "ModuleRegistry.h"
+#include "Snapshot.h"
+#include "PollScheduler.h"
+
+#define DATA_TRANSMISSION_TIMEOUT 32 // arbitrary number
+
+void readSensorFrame(byte sensorAddr, SensorSnapshot &snapshot);
+void readSensorText(byte sensorAddr, SensorSnapshot &snapshot);
+bool readSensorValues(byte sensorAddr, const ModuleDescriptor &descriptor, SensorSnapshot &snapshot);
+bool getSensorModuleReading(byte sensorAddr, SensorSnapshot &snapshot);
+bool getSensorModuleValues(byte sensorAddr, const ModuleDescriptor &descriptor, SensorSnapshot &snapshot, bool &stale);
+bool pollSensorModule(ModuleRegistry &registry, byte sensorAddr, SensorSnapshot &snapshot);
+void fetchData(ModuleRegistry &registry, SensorSnapshot &snapshot);
+ModuleTiming readModuleTiming(byte sensorAddr);
+bool readModuleDescriptor(byte sensorAddr, ModuleDescriptor &descriptor);
+
+#endif
@@ -0,0 +1,277 @@
+/*
+Node settings, kept in flash as a versioned binary record.
+See Settings.h for the record layout and the two slot scheme.
+*/
+
+#include "Settings.h"
+#include "Checksum.h"
+
+// config vars set to default values
+String nodeName = "MainModule";
+String nodeUUID = "1234567890";
+String nodeLat = "N/A";
+String nodeLong = "N/A";
+String currentEndPoint = "https://yourgisdb.com/apiforposting/";
+String currentToken = "N/A";
+String nodeLEDSetting = "On";
+String uplinkEncoding = "JSON";
+volatile unsigned long currentUpdateRate = DEFAULT_UPDATE_INTERVAL;
+unsigned long batchSize = DEFAULT_BATCH_SIZE;
+unsigned long batchMaxAge = DEFAULT_BATCH_AGE;
+String reportDeadbands = "";
+unsigned long reportHeartbeat = 0;
+unsigned long reportKeyframe = DEFAULT_REPORT_KEYFRAME;
+
+static uint32_t savedSequence = 0;  // sequence of the newest valid record
+static bool savedInSlotA = false;   // slot holding it, the next save goes to the other one
+
+static uint32_t recordCRC(const SettingsHeader &header, const uint8_t *payload)
+{
+  uint32_t crc = crc32Update(0xFFFFFFFF, (const uint8_t *)&header, offsetof(SettingsHeader, crc));
+  return crc32Update(crc, payload, header.length) ^ 0xFFFFFFFF;
+}
+
+// helper function to copy a setting into a fixed size field, true if it fit
+static bool storeText(char *field, size_t capacity, const String &value, const char *name)
+{
+  memset(field, 0, capacity);
+  strncpy(field, value.c_str(), capacity - 1);
+  if (value.length() >= capacity)
+  {
+    Serial.println(String("Setting ") + name + " is too long, truncated to " + String(capacity - 1) + " characters.");
+    return false;
+  }
+  return true;
+}
+
+// helper function to read a fixed size field that may not be terminated
+static String loadText(const char *field, size_t capacity)
+{
+  char text[SETTINGS_TOKEN_LENGTH + 1];
+  memcpy(text, field, capacity);
+  text[capacity] = 0;
+  return String(text);
+}
+
+// helper function to read one slot, true if it holds a valid record
+static bool readSlot(fs::FS &fs, const char *path, SettingsHeader &header, SettingsPayload &payload)
+{
+  if (!fs.exists(path))
+  {
+    return false;
+  }
+  File slot = fs.open(path, FILE_READ);
+  if (!slot)
+  {
+    return false;
+  }
+
+  uint8_t record[sizeof(SettingsPayload)];
+  bool valid = slot.read((uint8_t *)&header, sizeof(header)) == sizeof(header)
+            && header.magic == SETTINGS_MAGIC
+            && header.length > 0
+            && header.length <= sizeof(record)
+            && slot.read(record, header.length) == header.length
+            && recordCRC(header, record) == header.crc;
+  slot.close();
+  if (!valid)
+  {
+    Serial.println(String("Settings slot ") + path + " is damaged, ignoring it.");
+    return false;
+  }
+
+  // fields added after this record was written stay zeroed
+  memset(&payload, 0, sizeof(payload));
+  memcpy(&payload, record, header.length);
+  return true;
+}
+
+// helper function to read the text settings file of older firmware into the globals
+static void loadTextSettings(File &settingsFile)
+{
+  nodeUUID = settingsFile.readStringUntil('\n');
+  nodeName = settingsFile.readStringUntil('\n');
+  currentEndPoint = settingsFile.readStringUntil('\n');
+  currentToken = settingsFile.readStringUntil('\n');
+  currentUpdateRate = settingsFile.readStringUntil('\n').toInt();
+  nodeLat = settingsFile.readStringUntil('\n');
+  nodeLong = settingsFile.readStringUntil('\n');
+  nodeLEDSetting = settingsFile.readStringUntil('\n');
+  // missing from settings files saved before batching existed
+  batchSize = settingsFile.readStringUntil('\n').toInt();
+  batchMaxAge = settingsFile.readStringUntil('\n').toInt();
+
+  // trim to remove any unncessary whitespace
+  nodeUUID.trim();
+  nodeName.trim();
+  currentEndPoint.trim();
+  currentToken.trim();
+  nodeLat.trim();
+  nodeLong.trim();
+  nodeLEDSetting.trim();
+}
+
+// helper function to replace settings that are missing or out of range with defaults
+static void checkSettings()
+{
+  if (currentUpdateRate == 0)
+  {
+    currentUpdateRate = DEFAULT_UPDATE_INTERVAL;
+  }
+  if (batchSize == 0 || batchSize > MAX_BATCH_SIZE)
+  {
+    batchSize = DEFAULT_BATCH_SIZE;
+  }
+  if (batchMaxAge == 0)
+  {
+    batchMaxAge = DEFAULT_BATCH_AGE;
+  }
+  if (reportKeyframe == 0)
+  {
+    reportKeyframe = DEFAULT_REPORT_KEYFRAME;
+  }
+  if (uplinkEncoding != "MessagePack")
+  {
+    uplinkEncoding = "JSON";
+  }
+  if (nodeLEDSetting.length() == 0)
+  {
+    nodeLEDSetting = "On";
+  }
+}
+
+// helper function to write settings to the slot that does not hold the newest record.
+// Returns false if the record could not be written, the previous settings then stay in place.
+bool saveSettings(fs::FS &fs)
+{
+  // trim to remove any unncessary whitespace
+  nodeUUID.trim();
+  nodeName.trim();
+  currentEndPoint.trim();
+  currentToken.trim();
+  nodeLat.trim();
+  nodeLong.trim();
+  reportDeadbands.trim();
+
+  SettingsPayload payload;
+  storeText(payload.uuid, sizeof(payload.uuid), nodeUUID, "UUID");
+  storeText(payload.name, sizeof(payload.name), nodeName, "name");
+  storeText(payload.endpoint, sizeof(payload.endpoint), currentEndPoint, "endpoint");
+  storeText(payload.token, sizeof(payload.token), currentToken, "token");
+  storeText(payload.lat, sizeof(payload.lat), nodeLat, "latitude");
+  storeText(payload.lon, sizeof(payload.lon), nodeLong, "longitude");
+  storeText(payload.led, sizeof(payload.led), nodeLEDSetting, "LED");
+  payload.updateRate = currentUpdateRate;
+  payload.batchSize = batchSize;
+  payload.batchMaxAge = batchMaxAge;
+  storeText(payload.deadbands, sizeof(payload.deadbands), reportDeadbands, "deadbands");
+  payload.heartbeat = reportHeartbeat;
+  payload.keyframe = reportKeyframe;
+  storeText(payload.encoding, sizeof(payload.encoding), uplinkEncoding, "encoding");
+
+  SettingsHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = SETTINGS_MAGIC;
+  header.version = SETTINGS_VERSION;
+  header.sequence = savedSequence + 1;
+  header.length = sizeof(payload);
+  header.crc = recordCRC(header, (const uint8_t *)&payload);
+
+  const char *path = savedInSlotA ? SETTINGS_SLOT_B : SETTINGS_SLOT_A;
+  File slot = fs.open(path, FILE_WRITE);
+  if (!slot)
+  {
+    Serial.println("Failed to open file stream. Save failed.");
+    return false;
+  }
+  bool written = slot.write((const uint8_t *)&header, sizeof(header)) == sizeof(header)
+              && slot.write((const uint8_t *)&payload, sizeof(payload)) == sizeof(payload);
+  slot.close();
+  if (!written)
+  {
+    Serial.println("Settings could not be written completely. Save failed.");
+    return false;
+  }
+
+  savedSequence = header.sequence;
+  savedInSlotA = !savedInSlotA;
+  Serial.println(String("Wrote settings to ") + path + ".");
+  return true;
+}
+
+// helper function to load settings, from the newest valid slot or the text file of older firmware.
+void loadSettings(fs::FS &fs)
+{
+  SettingsHeader headerA, headerB;
+  SettingsPayload payloadA, payloadB;
+  bool validA = readSlot(fs, SETTINGS_SLOT_A, headerA, payloadA);
+  bool validB = readSlot(fs, SETTINGS_SLOT_B, headerB, payloadB);
+
+  if (validA || validB)
+  {
+    // the newer of the two, safe across a sequence rollover
+    bool useA = validA && (!validB || (int32_t)(headerA.sequence - headerB.sequence) > 0);
+    const SettingsPayload &payload = useA ? payloadA : payloadB;
+    savedSequence = useA ? headerA.sequence : headerB.sequence;
+    savedInSlotA = useA;
+
+    Serial.println(String("Reading settings from ") + (useA ? SETTINGS_SLOT_A : SETTINGS_SLOT_B) + ".");
+    nodeUUID = loadText(payload.uuid, sizeof(payload.uuid));
+    nodeName = loadText(payload.name, sizeof(payload.name));
+    currentEndPoint = loadText(payload.endpoint, sizeof(payload.endpoint));
+    currentToken = loadText(payload.token, sizeof(payload.token));
+    nodeLat = loadText(payload.lat, sizeof(payload.lat));
+    nodeLong = loadText(payload.lon, sizeof(payload.lon));
+    nodeLEDSetting = loadText(payload.led, sizeof(payload.led));
+    currentUpdateRate = payload.updateRate;
+    batchSize = payload.batchSize;
+    batchMaxAge = payload.batchMaxAge;
+    reportDeadbands = loadText(payload.deadbands, sizeof(payload.deadbands));
+    reportHeartbeat = payload.heartbeat;
+    reportKeyframe = payload.keyframe;
+    uplinkEncoding = loadText(payload.encoding, sizeof(payload.encoding));
+    checkSettings();
+  }
+  else if (fs.exists(SETTINGS_FILE))
+  {
+    // settings of older firmware, converted once and then removed
+    Serial.println("Migrating settings from " SETTINGS_FILE ".");
+    File settingsFile = fs.open(SETTINGS_FILE, FILE_READ);
+    if (settingsFile)
+    {
+      loadTextSettings(settingsFile);
+      settingsFile.close();
+    }
+    checkSettings();
+    if (saveSettings(fs))
+    {
+      fs.remove(SETTINGS_FILE);
+    }
+  }
+  else // no settings yet, or both slots damaged
+  {
+    Serial.println("No valid settings found. Writing default settings.");
+    saveSettings(fs);
+  }
+
+  Serial.println("Read UUID: " + nodeUUID);
+  Serial.println("Read Name: " + nodeName);
+  Serial.println("Read EndPoint: " + currentEndPoint);
+  Serial.println("Read current token: "+ currentToken);
+  Serial.println("Read UpdateRate: " + String(currentUpdateRate));
+  Serial.println("Read Position: " + nodeLat + "," + nodeLong);
+  Serial.println("Read LED Setting: " + nodeLEDSetting);
+  Serial.println("Read Encoding: " + uplinkEncoding);
+  Serial.println("Read Batch: " + String(batchSize) + " readings, " + String(batchMaxAge) + " ms");
+  Serial.println("Read Report: heartbeat " + String(reportHeartbeat) + " ms, keyframe " + String(reportKeyframe) + " ms, deadbands " + reportDeadbands);
+}
+
+// helper function to remove every saved setting, the next boot starts from the defaults
+void removeSettings(fs::FS &fs)
+{
+  fs.remove(SETTINGS_SLOT_A);
+  fs.remove(SETTINGS_SLOT_B);
+  fs.remove(SETTINGS_FILE);
+  savedSequence = 0;
+  savedInSlotA = false;
+}
@@ -0,0 +1,95 @@
+/*
+Node settings, kept in flash as a versioned binary record.
+
+The values live in the globals below, shared by the web handlers, the
+uplink and the sampling task. loadSettings() fills them at boot and
+saveSettings() writes them back after the config page changes them.
+
+A record is a fixed size SettingsPayload behind a header:
+	magic (2) | version (1) | reserved (1) | sequence (4) | length (2) | reserved (2) | CRC-32 (4)
+The CRC covers the header fields before it and the payload. Records are written
+to two slot files in turn, each save going to the slot that does not hold the
+newest record, so a save torn by a power cut leaves the previous settings intact
+and the next boot loads them. With no valid slot the defaults are used.
+
+Payloads only ever grow: a newer firmware reads an older record up to its
+length and leaves the new fields zeroed, which loadSettings() turns into
+defaults. Settings saved by older firmware as a text file are migrated once.
+*/
+
+#ifndef Settings_h
+#define Settings_h
+
+#include <Arduino.h>
+#include <FS.h>
+
+#define SETTINGS_FILE "/settings.txt"  // text settings of older firmware, migrated once
+#define SETTINGS_SLOT_A "/settings_a.bin"
+#define SETTINGS_SLOT_B "/settings_b.bin"
+#define SETTINGS_MAGIC 0x5353
+#define SETTINGS_VERSION 3
+#define DEFAULT_UPDATE_INTERVAL 60000
+#define DEFAULT_BATCH_SIZE 1 // readings per POST, 1 sends every reading on its own
+#define DEFAULT_BATCH_AGE 300000
+#define MAX_BATCH_SIZE 60
+#define DEFAULT_REPORT_KEYFRAME 3600000 // all readings are uploaded at least this often, see ReportFilter.h
+
+// longest values stored, including the terminator
+#define SETTINGS_UUID_LENGTH 48
+#define SETTINGS_NAME_LENGTH 64
+#define SETTINGS_URL_LENGTH 256
+#define SETTINGS_TOKEN_LENGTH 512
+#define SETTINGS_POSITION_LENGTH 24
+#define SETTINGS_LED_LENGTH 8
+#define SETTINGS_DEADBAND_LENGTH 256
+#define SETTINGS_ENCODING_LENGTH 16
+
+struct SettingsHeader {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  uint32_t sequence;   // incremented on every save, the higher valid slot wins
+  uint16_t length;     // payload bytes that follow
+  uint16_t reserved2;
+  uint32_t crc;
+};
+
+struct SettingsPayload {
+  char uuid[SETTINGS_UUID_LENGTH];
+  char name[SETTINGS_NAME_LENGTH];
+  char endpoint[SETTINGS_URL_LENGTH];
+  char token[SETTINGS_TOKEN_LENGTH];
+  char lat[SETTINGS_POSITION_LENGTH];
+  char lon[SETTINGS_POSITION_LENGTH];
+  char led[SETTINGS_LED_LENGTH];
+  uint32_t updateRate;
+  uint32_t batchSize;
+  uint32_t batchMaxAge;
+  // version 2
+  char deadbands[SETTINGS_DEADBAND_LENGTH];
+  uint32_t heartbeat;
+  uint32_t keyframe;
+  // version 3
+  char encoding[SETTINGS_ENCODING_LENGTH];
+};
+
+extern String nodeName;
+extern String nodeUUID;
+extern String nodeLat;
+extern String nodeLong;
+extern String currentEndPoint;
+extern String currentToken;
+extern String nodeLEDSetting;
+extern String uplinkEncoding;  // "JSON" or "MessagePack"
+extern volatile unsigned long currentUpdateRate; // the sampling task follows changes
+extern unsigned long batchSize;
+extern unsigned long batchMaxAge;
+extern String reportDeadbands;
+extern unsigned long reportHeartbeat; // 0 uploads every reading on every update
+extern unsigned long reportKeyframe;
+
+bool saveSettings(fs::FS &fs);
+void loadSettings(fs::FS &fs);
+void removeSettings(fs::FS &fs);
+
+#endif
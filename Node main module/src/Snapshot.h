@@ -0,0 +1,182 @@
+/*
+Sensor readings taken in one sampling cycle, and the buffer that hands them
+from the sampling task to the web handlers and the uploader.
+
+SnapshotBuffer is a double buffer where each slot is guarded by its own
+sequence lock. The single writer fills the slot that is not published and
+then publishes it with one atomic store. Readers copy the published slot and
+retry only if the writer lapped them in the meantime, so neither side ever
+waits for the other.
+*/
+
+#ifndef Snapshot_h
+#define Snapshot_h
+
+#include <Arduino.h>
+#include <atomic>
+
+#define SNAPSHOT_MAX_READINGS 32
+#define READING_KEY_LENGTH 24
+#define READING_TEXT_LENGTH 24
+
+// statistics of a reading over the current upload window, see WindowStats.h
+struct ReadingStats {
+  uint16_t count;                 // samples in the window, 0 if there are no statistics
+  float min;
+  float max;
+  float mean;
+  float stddev;
+};
+
+struct SensorReading {
+  char key[READING_KEY_LENGTH];
+  char text[READING_TEXT_LENGTH]; // value as sent by a text protocol module
+  float value;                    // value as sent in a binary frame
+  uint8_t unit;                   // SenseStackUnit of a binary frame value
+  bool numeric;                   // true if value and unit are set instead of text
+  byte module;                    // address of the module the reading came from
+  ReadingStats stats;
+
+  // the number the reading holds, false for text that is not a number
+  bool number(float &out) const
+  {
+    if (numeric)
+    {
+      out = value;
+      return true;
+    }
+    char *end;
+    out = strtod(text, &end);
+    return end != text && *end == 0;
+  }
+};
+
+struct SensorSnapshot {
+  uint32_t sequence;              // incremented for every published snapshot
+  unsigned long takenAt;          // millis() when the cycle finished
+  uint32_t timestamp;             // unix time when the cycle finished, 0 until NTP has synced
+  uint8_t moduleCount;            // modules that answered their last poll
+  uint8_t readingCount;
+  bool delta;                     // only readings that changed, see ReportFilter.h
+  SensorReading readings[SNAPSHOT_MAX_READINGS];
+
+  void clear()
+  {
+    moduleCount = 0;
+    readingCount = 0;
+    delta = false;
+  }
+
+  // append a reading with the given key, NULL once the snapshot is full
+  SensorReading* add(const char* key, byte module)
+  {
+    if (readingCount >= SNAPSHOT_MAX_READINGS)
+    {
+      return NULL;
+    }
+    SensorReading* reading = &readings[readingCount++];
+    strncpy(reading->key, key, READING_KEY_LENGTH - 1);
+    reading->key[READING_KEY_LENGTH - 1] = 0;
+    reading->text[0] = 0;
+    reading->value = 0;
+    reading->unit = 0;
+    reading->numeric = false;
+    reading->module = module;
+    reading->stats.count = 0;
+    return reading;
+  }
+
+  // replace the readings of one module with those in fresh, keeping their place in the order
+  void replaceModule(byte module, const SensorSnapshot &fresh)
+  {
+    uint8_t position = removeModule(module);
+    uint8_t incoming = fresh.readingCount;
+    if (incoming > SNAPSHOT_MAX_READINGS - readingCount)
+    {
+      incoming = SNAPSHOT_MAX_READINGS - readingCount;
+    }
+    memmove(&readings[position + incoming], &readings[position], (readingCount - position) * sizeof(SensorReading));
+    memcpy(&readings[position], fresh.readings, incoming * sizeof(SensorReading));
+    readingCount += incoming;
+  }
+
+  // drop the readings of one module, returns where they were or the end if there were none
+  uint8_t removeModule(byte module)
+  {
+    uint8_t position = SNAPSHOT_MAX_READINGS;
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < readingCount; i++)
+    {
+      if (readings[i].module == module)
+      {
+        if (position == SNAPSHOT_MAX_READINGS)
+        {
+          position = kept;
+        }
+        continue;
+      }
+      readings[kept++] = readings[i];
+    }
+    readingCount = kept;
+    return position < kept ? position : kept;
+  }
+};
+
+template <typename T>
+class SnapshotBuffer {
+  private:
+    struct Slot {
+      std::atomic<uint32_t> version; // odd while the writer is filling the slot
+      T data;
+    };
+    Slot slots[2];
+    std::atomic<uint8_t> published;
+    uint8_t writing;
+
+  public:
+    SnapshotBuffer() : published(0), writing(1)
+    {
+      slots[0].version.store(0);
+      slots[1].version.store(0);
+    }
+
+    // writer: start filling the unpublished slot
+    T& beginWrite()
+    {
+      writing = 1 - published.load(std::memory_order_relaxed);
+      Slot& slot = slots[writing];
+      slot.version.store(slot.version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      return slot.data;
+    }
+
+    // writer: make the slot filled since beginWrite() the published one
+    void publish()
+    {
+      Slot& slot = slots[writing];
+      slot.version.store(slot.version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+      published.store(writing, std::memory_order_release);
+    }
+
+    // reader: copy the latest published value
+    void read(T& out) const
+    {
+      for (;;)
+      {
+        const Slot& slot = slots[published.load(std::memory_order_acquire)];
+        uint32_t before = slot.version.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+          continue;
+        }
+        out = slot.data;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.version.load(std::memory_order_relaxed) == before)
+        {
+          return;
+        }
+      }
+    }
+};
+
+#endif
@@ -0,0 +1,29 @@
+/*
+How the lwIP sockets are shared out.
+
+The ESP32 core is built with CONFIG_LWIP_MAX_SOCKETS sockets, 10 by default.
+A few are always taken: the web server's listening socket, the uplink's
+kept-alive connection, the SSDP multicast socket and, while the portal runs
+as an access point, AutoConnect's DNS server. The rest are split between
+the web server's connections (ConcurrentWebServer.h) and the live viewers
+(EventStream.h). Handing out more than that would make accept() fail, and
+the uplink could no longer reconnect once its connection was closed.
+*/
+
+#ifndef SocketBudget_h
+#define SocketBudget_h
+
+#include <Arduino.h>
+
+#ifndef CONFIG_LWIP_MAX_SOCKETS
+#define CONFIG_LWIP_MAX_SOCKETS 10
+#endif
+
+#define SOCKETS_RESERVED 4 // listening socket, uplink, SSDP, portal DNS
+#define SOCKETS_FOR_CLIENTS (CONFIG_LWIP_MAX_SOCKETS - SOCKETS_RESERVED)
+#define SOCKETS_FOR_VIEWERS (SOCKETS_FOR_CLIENTS / 2)
+#define SOCKETS_FOR_WEB (SOCKETS_FOR_CLIENTS - SOCKETS_FOR_VIEWERS)
+
+static_assert(SOCKETS_FOR_VIEWERS >= 1 && SOCKETS_FOR_WEB >= 2, "lwIP has too few sockets for the web server and a live viewer");
+
+#endif
@@ -0,0 +1,159 @@
+/*
+Uplink to the data endpoint.
+See Uplink.h for how requests are handed to the uplink task.
+*/
+
+#include "Uplink.h"
+#include "Metrics.h"
+#include "Log.h"
+
+Uplink::Uplink() : state(UPLINK_IDLE)
+{
+  task = NULL;
+  bodyLength = 0;
+  responseCode = 0;
+}
+
+// start the uplink task, call once from setup()
+void Uplink::begin()
+{
+  // the default endpoints use certificates we do not ship, same as HTTPClient::begin(url)
+  secureClient.setInsecure();
+  http.setReuse(true);
+  http.setConnectTimeout(UPLINK_CONNECT_TIMEOUT);
+  http.setTimeout(UPLINK_READ_TIMEOUT);
+  xTaskCreatePinnedToCore(run, "uplink", UPLINK_TASK_STACK, this, UPLINK_TASK_PRIORITY, &task, UPLINK_TASK_CORE);
+}
+
+bool Uplink::idle() const
+{
+  return state.load(std::memory_order_acquire) == UPLINK_IDLE;
+}
+
+/*
+Queue a POST of data to the endpoint.
+
+@return false if the previous request is still in flight or not collected,
+        or if the body is larger than UPLINK_MAX_BODY
+*/
+bool Uplink::post(const char *data, size_t length, const String &endpoint, const String &bearerToken)
+{
+  if (!idle() || task == NULL || length > UPLINK_MAX_BODY)
+  {
+    return false;
+  }
+  memcpy(body, data, length);
+  bodyLength = length;
+  url = endpoint;
+  token = bearerToken;
+  state.store(UPLINK_SENDING, std::memory_order_release);
+  xTaskNotifyGive(task);
+  return true;
+}
+
+/*
+Take the status line of a finished request, in the format shown on the status page.
+
+@return true if a request finished since the last call
+*/
+bool Uplink::collect(String &status)
+{
+  if (state.load(std::memory_order_acquire) != UPLINK_DONE)
+  {
+    return false;
+  }
+  status = reply;
+  state.store(UPLINK_IDLE, std::memory_order_release);
+  return true;
+}
+
+// response code of the last finished request, negative values are HTTPClient errors
+int Uplink::lastResponseCode() const
+{
+  return responseCode;
+}
+
+// body of the last request, valid until the next post()
+const char *Uplink::lastBody() const
+{
+  return body;
+}
+
+size_t Uplink::lastBodyLength() const
+{
+  return bodyLength;
+}
+
+void Uplink::run(void *parameter)
+{
+  Uplink *uplink = (Uplink *)parameter;
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (uplink->state.load(std::memory_order_acquire) == UPLINK_SENDING)
+    {
+      uplink->send();
+      uplink->state.store(UPLINK_DONE, std::memory_order_release);
+    }
+  }
+}
+
+// POST the queued body, reusing the open connection when the endpoint did not change
+void Uplink::send()
+{
+  LOG_INFO("Sending data to %s", url.c_str());
+
+  if (url != connectedURL)
+  {
+    plainClient.stop();
+    secureClient.stop();
+    connectedURL = url;
+  }
+
+  bool begun;
+  if (url.startsWith("https"))
+  {
+    begun = http.begin(secureClient, url);
+  }
+  else
+  {
+    begun = http.begin(plainClient, url);
+  }
+  if (!begun)
+  {
+    responseCode = HTTPC_ERROR_CONNECTION_REFUSED;
+    metrics.httpResponse(responseCode);
+    reply = "Code: " + String(responseCode) + " Invalid endpoint URL";
+    LOG_ERROR("Invalid endpoint URL %s", url.c_str());
+    return;
+  }
+
+  // a JSON body is an object, anything else is a MessagePack map
+  http.addHeader("Content-Type", body[0] == '{' ? "application/json" : "application/msgpack");
+  http.addHeader("Authorization", "Bearer " + token);
+
+  unsigned long started = micros();
+  responseCode = http.POST((uint8_t *)body, bodyLength);
+  // read the whole body so the connection can be reused
+  String response = http.getString();
+  metrics.upload.observe(micros() - started);
+  metrics.httpResponse(responseCode);
+  reply = "Code: ";
+  reply += responseCode;
+  reply += " ";
+  reply += http.errorToString(responseCode);
+  reply += " Reply: ";
+  reply += response;
+
+  if (responseCode > 0)
+  {
+    LOG_INFO("Response from server: %d", responseCode);
+    LOG_DEBUG("%s", response.c_str());
+  }
+  else
+  {
+    LOG_ERROR("Error on sending POST: %s", http.errorToString(responseCode).c_str());
+  }
+  // keeps the connection open when the server allows it
+  http.end();
+}
@@ -0,0 +1,76 @@
+/*
+Uplink to the data endpoint, running on its own FreeRTOS task.
+
+The HTTP client and its WiFiClient or WiFiClientSecure are kept between
+requests with keep-alive, so a POST to the same endpoint reuses the open
+(TLS) connection instead of paying DNS, TCP and the handshake every time.
+The connection is closed when the endpoint URL changes or the server drops it.
+
+loop() hands a body over with post() and picks up the reply with collect(),
+nothing ever waits on the network. The body is copied into a buffer owned by
+the uplink, so the caller's buffer can be reused right away:
+
+	if (uplink.idle()) uplink.post(body, length, url, token);
+	if (uplink.collect(lastPOSTreply)) { ... }
+
+While a request is in flight, or its reply has not been collected yet, post()
+refuses new bodies.
+
+The Content-Type follows the body, JSON or MessagePack (ReplySerializer.h),
+so readings queued in the reading store keep their type when the encoding
+setting changes before they are sent.
+*/
+
+#ifndef Uplink_h
+#define Uplink_h
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include <atomic>
+
+#define UPLINK_CONNECT_TIMEOUT 5000 // ms to establish the TCP connection
+#define UPLINK_READ_TIMEOUT 5000    // ms to wait for the server to answer
+#define UPLINK_TASK_STACK 12288     // the TLS handshake needs a large stack
+#define UPLINK_TASK_PRIORITY 1
+#define UPLINK_TASK_CORE 0          // network stack core, loop() stays responsive on core 1
+#define UPLINK_MAX_BODY 4096        // largest body post() accepts
+
+class Uplink {
+	private:
+		enum State : uint8_t {
+			UPLINK_IDLE = 0,  // owned by loop(), ready for post()
+			UPLINK_SENDING,   // owned by the uplink task
+			UPLINK_DONE       // reply waiting for collect()
+		};
+
+		std::atomic<uint8_t> state;
+		TaskHandle_t task;
+		HTTPClient http;
+		WiFiClient plainClient;
+		WiFiClientSecure secureClient;
+		String connectedURL;    // endpoint the open connection belongs to
+
+		// request and reply, handed back and forth through state
+		char body[UPLINK_MAX_BODY];
+		size_t bodyLength;
+		String url;
+		String token;
+		int responseCode;
+		String reply;
+
+		static void run(void *parameter);
+		void send();
+	public:
+		Uplink();
+		void begin();
+		bool idle() const;
+		bool post(const char *data, size_t length, const String &endpoint, const String &bearerToken);
+		bool collect(String &status);
+		int lastResponseCode() const;
+		const char *lastBody() const;
+		size_t lastBodyLength() const;
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+Static web assets served from flash.
+See WebAssets.h for how assets are compressed, versioned and cached.
+*/
+
+#include "WebAssets.h"
+#include "generated/webAssetData.h"
+
+// request headers WebServer keeps for the handlers, it drops all others
+static const char *collectedHeaders[] = {"If-None-Match"};
+
+/*
+Register a GET handler for every embedded asset.
+Also makes the server keep If-None-Match, which revalidations are checked against.
+*/
+void serveWebAssets(WebServer &server)
+{
+  server.collectHeaders(collectedHeaders, sizeof(collectedHeaders) / sizeof(collectedHeaders[0]));
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++)
+  {
+    const WebAsset *asset = &webAssets[i];
+    server.on(asset->path, HTTP_GET, [&server, asset]() {
+      sendWebAsset(server, *asset);
+    });
+  }
+}
+
+/*
+Look up an embedded asset by the path it is served at.
+
+@return NULL if there is no such asset
+*/
+const WebAsset *findWebAsset(const char *path)
+{
+  for (size_t i = 0; i < WEB_ASSET_COUNT; i++)
+  {
+    if (strcmp(webAssets[i].path, path) == 0)
+    {
+      return &webAssets[i];
+    }
+  }
+  return NULL;
+}
+
+/*
+Send an asset as stored, gzipped.
+Only a 200 reply is cacheable, other codes (e.g. the 404 page) are sent without validators.
+*/
+void sendWebAsset(WebServer &server, const WebAsset &asset, int code)
+{
+  if (code == 200)
+  {
+    server.sendHeader("ETag", asset.etag);
+    server.sendHeader("Cache-Control", "public, max-age=" + String(WEB_ASSET_MAX_AGE) + ", immutable");
+    // the header may list several tags, weak ones prefixed with W/
+    if (server.header("If-None-Match").indexOf(asset.etag) >= 0)
+    {
+      server.send(304);
+      return;
+    }
+  }
+  else
+  {
+    server.sendHeader("Cache-Control", "no-cache");
+  }
+  server.sendHeader("Content-Encoding", "gzip");
+  server.send_P(code, asset.contentType, (PGM_P)asset.data, asset.length);
+}
@@ -0,0 +1,35 @@
+/*
+Static web assets served from flash.
+
+The files in src/html are gzipped at build time by tools/embedWebAssets.py,
+which writes them to src/generated/webAssetData.h with an ETag made from a hash
+of their content. They are sent as they are stored, with Content-Encoding gzip,
+so the web server never compresses or copies them.
+
+Pages reference assets through the versioned URLs in src/generated/webAssetUrls.h
+(e.g. /sensorviewer.js?v=<hash>). A new build of an asset changes its URL, so
+browsers may cache it as immutable. A revalidation that still carries the
+current ETag in If-None-Match is answered with 304 and no body.
+*/
+
+#ifndef WebAssets_h
+#define WebAssets_h
+
+#include <Arduino.h>
+#include <WebServer.h>
+
+#define WEB_ASSET_MAX_AGE 31536000 // seconds, a year as browsers treat that as forever
+
+struct WebAsset {
+	const char *path;
+	const char *contentType;
+	const uint8_t *data; // gzip stream
+	size_t length;
+	const char *etag;    // quoted, as sent in the ETag header
+};
+
+void serveWebAssets(WebServer &server);
+const WebAsset *findWebAsset(const char *path);
+void sendWebAsset(WebServer &server, const WebAsset &asset, int code = 200);
+
+#endif
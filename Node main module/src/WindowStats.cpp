@@ -0,0 +1,113 @@
+/*
+Statistics of every reading over the window between two uploads.
+See WindowStats.h for how the window is fed and reported.
+*/
+
+#include <math.h>
+#include "WindowStats.h"
+
+WindowStats::WindowStats() : entryCount(0) {}
+
+int8_t WindowStats::find(byte module, const char *key) const
+{
+  for (uint8_t i = 0; i < entryCount; i++)
+  {
+    if (entries[i].module == module && strcmp(entries[i].key, key) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// add the readings of one poll of a module to the window
+void WindowStats::observe(byte module, const SensorSnapshot &polled)
+{
+  for (uint8_t i = 0; i < polled.readingCount; i++)
+  {
+    const SensorReading &reading = polled.readings[i];
+    float value;
+    if (!reading.number(value))
+    {
+      continue;
+    }
+
+    int8_t index = find(module, reading.key);
+    if (index < 0)
+    {
+      if (entryCount >= SNAPSHOT_MAX_READINGS)
+      {
+        continue;
+      }
+      index = entryCount++;
+      Entry &entry = entries[index];
+      strncpy(entry.key, reading.key, READING_KEY_LENGTH);
+      entry.module = module;
+      entry.count = 0;
+    }
+
+    Entry &entry = entries[index];
+    if (entry.count == 0)
+    {
+      entry.min = value;
+      entry.max = value;
+      entry.mean = 0;
+      entry.m2 = 0;
+    }
+    else if (entry.count == UINT16_MAX)
+    {
+      continue; // a window this long has more samples than it needs
+    }
+    entry.min = min(entry.min, value);
+    entry.max = max(entry.max, value);
+    entry.count++;
+    float delta = value - entry.mean;
+    entry.mean += delta / entry.count;
+    entry.m2 += delta * (value - entry.mean);
+  }
+}
+
+// set the statistics of every reading in snapshot, readings not seen in this window get a count of 0
+void WindowStats::fill(SensorSnapshot &snapshot) const
+{
+  for (uint8_t i = 0; i < snapshot.readingCount; i++)
+  {
+    SensorReading &reading = snapshot.readings[i];
+    int8_t index = find(reading.module, reading.key);
+    if (index < 0 || entries[index].count == 0)
+    {
+      reading.stats.count = 0;
+      continue;
+    }
+    const Entry &entry = entries[index];
+    reading.stats.count = entry.count;
+    reading.stats.min = entry.min;
+    reading.stats.max = entry.max;
+    reading.stats.mean = entry.mean;
+    // population deviation, the window holds every sample of the period
+    reading.stats.stddev = sqrt(entry.m2 / entry.count);
+  }
+}
+
+// forget a detached module
+void WindowStats::removeModule(byte module)
+{
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < entryCount; i++)
+  {
+    if (entries[i].module != module)
+    {
+      entries[kept++] = entries[i];
+    }
+  }
+  entryCount = kept;
+}
+
+// start a new window, keys keep their entries so the next one costs no lookup of a free slot
+void WindowStats::reset()
+{
+  for (uint8_t i = 0; i < entryCount; i++)
+  {
+    entries[i].count = 0;
+  }
+}
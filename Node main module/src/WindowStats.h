@@ -0,0 +1,48 @@
+/*
+Statistics of every reading over the window between two uploads.
+
+The sampling task polls the modules on their own cadence all the time and
+feeds every poll to observe(), so an upload that only happens once a minute
+still reports what happened in between, such as a short CO spike. Each key
+keeps a running count, minimum, maximum, mean and sum of squared deviations
+(Welford's algorithm), so memory does not grow with the number of samples.
+
+fill() copies the statistics into the readings of a snapshot, where the
+serializer adds them to the JSON as
+	"stats":{"co_density":{"min":..., "max":..., "mean":..., "stddev":..., "count":...}}
+next to the last value in "data". reset() starts the next window.
+
+Text readings count only if they hold a number.
+*/
+
+#ifndef WindowStats_h
+#define WindowStats_h
+
+#include <Arduino.h>
+#include "Snapshot.h"
+
+class WindowStats {
+	private:
+		struct Entry {
+			char key[READING_KEY_LENGTH];
+			byte module;
+			uint16_t count;
+			float min;
+			float max;
+			float mean;
+			float m2;                 // sum of squared deviations from the mean
+		};
+
+		Entry entries[SNAPSHOT_MAX_READINGS];
+		uint8_t entryCount;
+
+		int8_t find(byte module, const char *key) const;
+	public:
+		WindowStats();
+		void observe(byte module, const SensorSnapshot &polled);
+		void fill(SensorSnapshot &snapshot) const;
+		void removeModule(byte module);
+		void reset();
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include <Arduino.h>
+#include "generated/webAssetUrls.h"
 
 // AutoconnectElements for viewing 
 const static char customPageJSON[] PROGMEM = R"raw(
@@ -63,6 +64,15 @@ const static char customPageJSON[] PROGMEM = R"raw(
                 "type": "ACInput",
                 "label": "Token"
             },
+            {
+                "name": "encodingRadio",
+                "type": "ACRadio",
+                "label": "Encoding of the data sent",
+                "value":[
+                    "JSON",
+                    "MessagePack"
+                ]
+            },
             {
                 "name": "header_interval",
                 "type": "ACText",
@@ -78,6 +88,46 @@ const static char customPageJSON[] PROGMEM = R"raw(
                 "type": "ACInput",
                 "label": "Update Interval (ms)"
             },
+            {
+                "name": "caption_batch",
+                "type": "ACText",
+                "value": "Readings can be sent to the endpoint in batches. A batch is sent once it holds the set number of readings or its oldest reading reaches the maximum age. A batch size of 1 sends every reading on its own."
+            },
+            {
+                "name": "batchSizeInput",
+                "type": "ACInput",
+                "label": "Readings per batch"
+            },
+            {
+                "name": "batchAgeInput",
+                "type": "ACInput",
+                "label": "Maximum batch age (ms)"
+            },
+            {
+                "name": "header_report",
+                "type": "ACText",
+                "value": "<h2>Change reporting<h2>"
+            },
+            {
+                "name": "caption_report",
+                "type": "ACText",
+                "value": "With a heartbeat set, only readings that moved past their deadband or were not sent for a heartbeat are uploaded, and all readings once every keyframe interval. Deadbands are a list such as temperature:0.2, humidity:2%, *:1% where % is relative to the value last sent and * applies to every other reading. A heartbeat of 0 sends every reading on every update."
+            },
+            {
+                "name": "deadbandInput",
+                "type": "ACInput",
+                "label": "Deadbands"
+            },
+            {
+                "name": "heartbeatInput",
+                "type": "ACInput",
+                "label": "Heartbeat (ms)"
+            },
+            {
+                "name": "keyframeInput",
+                "type": "ACInput",
+                "label": "Keyframe interval (ms)"
+            },
             {
                 "name": "ledSettingRadio",
                 "type": "ACRadio",
@@ -184,7 +234,7 @@ const static char customPageJSON[] PROGMEM = R"raw(
 ]
 )raw";
 
-// Live sensor viewing HTML and JS
+// Live sensor viewing HTML, the script is src/html/sensorviewer.js served gzipped from flash
 const char sensorViewerHTML[] PROGMEM = R"rawliteral(
 <div id=sensorStatus>
     <p>Getting sensor information...</p>
@@ -200,71 +250,5 @@ const char sensorViewerHTML[] PROGMEM = R"rawliteral(
 </div>
 
 
-<script>
-    loadData();                  //Load the data for first time
-    setInterval(loadData, 1000); //Reload the data every X milliseconds.
-    //Load the JSON data from API, and then replace the HTML element
-    function loadData(){
-        var xhttp = new XMLHttpRequest();
-        xhttp.onreadystatechange = function () {
-            if (this.readyState == 4 && this.status == 200) {
-                var sensorStatus = document.getElementById("sensorStatus");
-                var sensorTable = document.getElementById("sensorDataTable");
-             
-                var sensorsData = JSON.parse(this.response).data;                   //Parse the response to JSON object
-                if (Object.keys(sensorsData).length == 0 ) {                        //object is empty
-                    sensorStatus.style.display = "block";                          //Display the status text div
-                    sensorTable.style.display = "none"                              //Hide the table
-                    sensorStatus.textContent = "";                                 //Clear all elements in sensorElement div
-                    sensorStatus.innerHTML = "<p> No sensors connected. </p>"
-                    return;
-                }else{
-                    sensorStatus.style.display = "none";                           //Hide the status text div
-                    sensorTable.style.display = "block"                             //Show the table
-                    sensorTable.innerHTML = ""                                      //Clear the table
-
-                    for (sensorName of Object.keys(sensorsData)) {                       //iterate through each element and create table row for each sensor 
-                        var row = sensorTable.insertRow(0);
-                        var cell1 = row.insertCell(0);
-                        var cell2 = row.insertCell(1);
-                        cell1.style.fontWeight = "bold"
-                        cell2.style.paddingLeft = "40px";
-                        cell1.innerHTML = sensorName;
-                        cell2.innerHTML = sensorsData[sensorName];
-                     }
-
-                }
-             
-            }
-        };
-        xhttp.open("GET", "/getJSON", true);      //request JSON data from URI/getJSON
-        xhttp.send();
-    }
-</script>
+<script src=")rawliteral" WEB_ASSET_URL_SENSORVIEWER_JS R"rawliteral("></script>
 )rawliteral";
-
-// 404 page
-const char notFoundPage[] PROGMEM = R"rawliteral(
-<!DOCTYPE html>
-<html>
-  <head>
-    <meta name="viewport" content="width=device-width, initial-scale=1.0, user-scalable=no">
-    <title>
-        Page not found
-    </title>
-  </head>
-  <style>
-    html { 
-        font-family: Verdana; 
-        display: inline-block; 
-        margin: 0px auto; 
-        text-align: center;
-    }
-  </style>
-  <body>
-  <h1>404</h1>
-  <p>This page does not exist.</p>
-  <p><a href='/_ac'>Return to main page</a></p>
-  </body>
-</html>
-)rawliteral";
\ No newline at end of file
@@ -0,0 +1,54 @@
+//Readings are pushed from /events as they are taken, browsers without EventSource poll /getJSON instead
+if (window.EventSource) {
+    var source = new EventSource("/events");
+    source.onmessage = function (event) {
+        showData(JSON.parse(event.data));
+    };
+} else {
+    loadData();                  //Load the data for first time
+    setInterval(loadData, 1000); //Reload the data every X milliseconds.
+}
+//Load the JSON data from API, and then replace the HTML element
+function loadData(){
+    var xhttp = new XMLHttpRequest();
+    xhttp.onreadystatechange = function () {
+        if (this.readyState == 4 && this.status == 200) {
+            showData(JSON.parse(this.response));                           //Parse the response to JSON object
+        }
+    };
+    xhttp.open("GET", "/getJSON", true);      //request JSON data from URI/getJSON
+    xhttp.send();
+}
+//Replace the HTML element with the readings in a JSON reply
+function showData(sensorsReply){
+    var sensorStatus = document.getElementById("sensorStatus");
+    var sensorTable = document.getElementById("sensorDataTable");
+
+    var sensorsData = sensorsReply.data;
+    var sensorsUnits = sensorsReply.units || {};                        //Units of numeric readings from binary frames
+    if (Object.keys(sensorsData).length == 0 ) {                        //object is empty
+        sensorStatus.style.display = "block";                          //Display the status text div
+        sensorTable.style.display = "none"                              //Hide the table
+        sensorStatus.textContent = "";                                 //Clear all elements in sensorElement div
+        sensorStatus.innerHTML = "<p> No sensors connected. </p>"
+        return;
+    }else{
+        sensorStatus.style.display = "none";                           //Hide the status text div
+        sensorTable.style.display = "block"                             //Show the table
+        sensorTable.innerHTML = ""                                      //Clear the table
+
+        for (sensorName of Object.keys(sensorsData)) {                       //iterate through each element and create table row for each sensor 
+            var row = sensorTable.insertRow(0);
+            var cell1 = row.insertCell(0);
+            var cell2 = row.insertCell(1);
+            cell1.style.fontWeight = "bold"
+            cell2.style.paddingLeft = "40px";
+            cell1.innerHTML = sensorName;
+            cell2.innerHTML = sensorsData[sensorName];
+            if (sensorName in sensorsUnits) {
+                cell2.innerHTML += " " + sensorsUnits[sensorName];
+            }
+         }
+
+    }
+}
@@ -7,6 +7,7 @@
 #include <WiFi.h>
 #include <HTTPClient.h>
 #include <WebServer.h>
+#include "ConcurrentWebServer.h"
 #include <ESPmDNS.h>
 #include <AutoConnect.h>
 #include "HTTPUpdateServer.h"
@@ -16,46 +17,104 @@
 #include <WiFiUdp.h>
 
 #include "protocol.h"
+#include "SenseStackFrame.h"
+#include "ModuleRegistry.h"
+#include "Sampling.h"
+#include "PollScheduler.h"
+#include "Snapshot.h"
+#include "Uplink.h"
+#include "ReadingStore.h"
+#include "EventStream.h"
+#include "ReplySerializer.h"
+#include "Settings.h"
+#include "WindowStats.h"
+#include "ReportFilter.h"
+#include "Discovery.h"
+#include "Metrics.h"
+#include "Profiler.h"
+#include "Log.h"
+#include "WebAssets.h"
 #include "customPages.h" 
 
 // Time is in milliseconds
 #define LED_TICKER 33
 #define LED_BUILTIN 2
 #define BUTTON_PIN 32
-#define DEFAULT_UPDATE_INTERVAL 60000
+#define MAX_BATCH_LENGTH (STORE_MAX_PAYLOAD - SERIALIZER_HEADER_LENGTH - 16) // a batch that fails to send must still fit in the reading store
+#define NODE_INFO_LENGTH (JSON_REPLY_LENGTH + 512) // readings plus the node settings
+#define NODE_SETTINGS_LENGTH (MAX_JSON_REPLY + 512) // document of the node settings alone
+#define PROFILER_SUMMARY_LENGTH 1024
+#define PROFILER_CHUNK_LENGTH 1024
+#define METRICS_REPLY_LENGTH 12288 // every histogram plus counters for MAX_SENSORS modules
 #define LIVE_SENSOR_INTERVAL 1000
-#define SETTINGS_FILE "/settings.txt"
-#define DATA_TRANSMISSION_TIMEOUT 32 // arbitrary number
+#define MODULE_SWEEP_INTERVAL 250 // a full sweep of the address space takes about 8 seconds
 #define REBOOT_BUTTON_HOLD_DURATION 3000
 #define FACTORY_RESET_BUTTON_HOLD_DURATION 10000
-
-
-byte modules[MAX_SENSORS];      // array with address listings of connected sensor modules
+#define SAMPLING_TASK_STACK 8192
+#define SAMPLING_TASK_PRIORITY 1
+#define SAMPLING_TASK_CORE 0 // loop() and the web server run on core 1
+#define SAMPLING_TASK_TICK 10 // how often the sampling task checks its timers
+#define STORE_DRAIN_BATCH 10 // queued readings sent back to back before pausing
+#define STORE_DRAIN_INTERVAL 5000 // pause between batches so live readings get the uplink
+#define STORE_MAX_BACKOFF_SHIFT 5 // a failing endpoint is still retried every 32 drain intervals
+#define STORE_MAX_ATTEMPTS 8 // endpoint replies asking to retry the same queued reading before it is dropped
+#define CLOCK_VALID_AFTER 1577836800 // 2020-01-01, earlier times mean NTP has not synced yet
+
+static_assert(WEB_MAX_CONNECTIONS + EVENT_STREAM_MAX_CLIENTS + SOCKETS_RESERVED <= CONFIG_LWIP_MAX_SOCKETS,
+              "web connections and live viewers leave no socket for the uplink");
+
+
+// owned by the sampling task, which is the only user of the I2C bus after setup()
+ModuleRegistry registry;        // connected sensor modules
 AsyncDelay delay_sensor_update; // delay timer for asynchronous update interval
-AsyncDelay delay_sensor_view; // 1 second delay for real time sensor viewing
-bool sensorViewMode = false;
-
-String currentJSONReply = "{\"data\":[\"N/A\":\"No sensors connected.\"]}"; // string to hold JSON object to be sent to endpoint
+AsyncDelay delay_module_sweep; // delay timer for probing unknown I2C addresses
+uint32_t snapshotSequence = 0;  // sequence number of the last published snapshot
+PollScheduler schedule;         // when each module is polled next
+SensorSnapshot mergedReadings;  // latest readings of every module, merged as modules are polled
+SensorSnapshot polledReadings;  // readings of the module being polled
+WindowStats windowStats;        // every poll since the last upload
+uint32_t scheduledLayout = 0;   // registry version the schedule follows
+
+// shared between the sampling task and loop()
+SnapshotBuffer<SensorSnapshot> snapshots; // latest readings, published by the sampling task
+volatile unsigned long lastLiveViewRequest = 0; // millis() of the last live sensor view request
+volatile bool liveViewStreaming = false; // true while a live viewer is subscribed to /events
+volatile bool uploadPending = false; // set by the sampling task when a reading is due at the endpoint
+
+// owned by loop() and the web handlers
+SensorSnapshot latestSnapshot;       // copy of the latest published snapshot
+uint32_t serializedSequence = 0;     // snapshot sequence currently held in currentJSONReply
+uint32_t streamedSequence = 0;       // snapshot sequence last pushed to live viewers
+ReplySerializer serializer;           // renders snapshots with the node information rendered once
+char currentJSONReply[JSON_REPLY_LENGTH] = "{\"data\":{}}"; // JSON object of the latest snapshot, sent to the endpoint
+size_t currentJSONLength = 11;
+ReportFilter reportFilter;           // readings that moved past their deadband since they were uploaded
+SensorSnapshot reportSnapshot;       // readings of the latest snapshot due at the endpoint
 String lastPOSTreply = "N/A";        // string to save last POST status reply
+ReadingStore readingStore;           // readings that could not be sent, kept in flash
+AsyncDelay delay_store_drain;        // pause between batches of queued readings
+uint8_t drainedInBatch = 0;          // queued readings sent in the current batch
+uint8_t drainFailures = 0;           // failed POSTs of queued readings in a row, for the backoff
+uint8_t drainAttempts = 0;           // retryable endpoint replies to attemptedSequence
+uint32_t attemptedSequence = 0;      // queued reading drainAttempts counts for
+uint32_t postedSequence = 0;         // store sequence of the POST in flight, 0 for a live reading
+char batchSamples[MAX_BATCH_LENGTH]; // comma separated samples of the batch being collected
+size_t batchLength = 0;
+uint8_t batchCount = 0;              // samples in batchSamples
+bool batchPacked = false;            // true if batchSamples holds MessagePack samples
+unsigned long batchStartedAt = 0;    // millis() when the first sample of the batch was added
 
-// config vars set to default values
-String nodeName = "MainModule";
-String nodeUUID = "1234567890";
-String nodeLat = "N/A";
-String nodeLong = "N/A";
-String currentEndPoint = "https://yourgisdb.com/apiforposting/";
-String currentToken = "N/A";
-String nodeLEDSetting = "On";
-unsigned long currentUpdateRate = DEFAULT_UPDATE_INTERVAL;
 char packetBuffer[255]; //buffer to hold incoming udp packet
 
 
-WebServer server;           // HTTP server to serve web UI
+ConcurrentWebServer server; // HTTP server to serve web UI, several clients at once
 HTTPUpdateServer updateServer(true); // OTA update handler, true param is for serial debug
 AutoConnectAux update("/update", "Update");
 AutoConnect Portal(server); // AutoConnect handler object
 AutoConnectConfig portalConfig("MainModuleAP", "12345678");
 WiFiUDP senseStackUDP;
+Uplink uplink;              // keeps the endpoint connection open between POSTs
+EventStream liveStream;     // live sensor viewers subscribed to /events
 
 
 // NOTE: the data for the custom pages are in the customPages.h header file
@@ -64,36 +123,6 @@ AutoConnectElement viewerHTML("viewerhtml", sensorViewerHTML, AC_Tag_None); // s
 
 // -------------- Helper functions -------------- //
 
-// helper function to write settings to file in SPIFFS.
-void saveSettings()
-{
-  File settingsFile = SPIFFS.open(SETTINGS_FILE, FILE_WRITE);
-  if (!settingsFile)
-  {
-    Serial.println("Failed to open file stream. Save failed.");
-    return;
-  }
-
-  // trim to remove any unncessary whitespace
-  nodeUUID.trim();
-  nodeName.trim();
-  currentEndPoint.trim();
-  currentToken.trim();
-  nodeLat.trim();
-  nodeLong.trim();
-
-  settingsFile.println(nodeUUID);
-  settingsFile.println(nodeName);
-  settingsFile.println(currentEndPoint);
-  settingsFile.println(currentToken);
-  settingsFile.println(currentUpdateRate);
-  settingsFile.println(nodeLat);
-  settingsFile.println(nodeLong);
-  settingsFile.println(nodeLEDSetting);
-  Serial.println("Wrote existing settings to save file.");
-  settingsFile.close();
-}
-
 // Delete all Wi-Fi credentials that have been saved with AutoConnect Library.
 void deleteAllCredentials(void) {
   AutoConnectCredential credential;
@@ -117,7 +146,7 @@ void clearSettings(){
     delay(200);
   }
   deleteAllCredentials();         
-  SPIFFS.remove(SETTINGS_FILE);
+  removeSettings(SPIFFS);
 }
 
 // helper function to make LED blink asynchronously	
@@ -171,59 +200,50 @@ void checkButton(){
 }
 
 
-// helper function to load settings from save file in SPIFFS.
-void loadSettings()
+// -------------- Snapshot functions -------------- //
+
+// helper function to render the node information into every reply, call whenever the settings change
+void updateNodeInformation()
 {
-  File settingsFile = SPIFFS.open(SETTINGS_FILE, FILE_READ);
-  if (!SPIFFS.exists(SETTINGS_FILE) || !settingsFile) // settings file does not exist, set everything to default.
-  {
-    Serial.println("Settings file does not exist or could not be opened. Creating new setings file.");
-    File newSettingsFile = SPIFFS.open(SETTINGS_FILE, FILE_WRITE);
-    newSettingsFile.println(nodeUUID);
-    newSettingsFile.println(nodeName);
-    newSettingsFile.println(currentEndPoint);
-    newSettingsFile.println(currentToken);
-    newSettingsFile.println(currentUpdateRate);
-    newSettingsFile.println(nodeLat);
-    newSettingsFile.println(nodeLong);
-    newSettingsFile.println(nodeLEDSetting);
-    Serial.println("Wrote default settings to file.");
-    newSettingsFile.close();
-  }
-  else // read existing settings
-  {
-    if (SPIFFS.exists(SETTINGS_FILE))
-    {
-      Serial.println("Reading existing settings from file.");
-      nodeUUID = settingsFile.readStringUntil('\n');
-      nodeName = settingsFile.readStringUntil('\n');
-      currentEndPoint = settingsFile.readStringUntil('\n');
-      currentToken = settingsFile.readStringUntil('\n');
-      currentUpdateRate = settingsFile.readStringUntil('\n').toInt();
-      nodeLat = settingsFile.readStringUntil('\n');
-      nodeLong = settingsFile.readStringUntil('\n');
-      nodeLEDSetting = settingsFile.readStringUntil('\n');
-
-      // trim to remove any unncessary whitespace
-      nodeUUID.trim();
-      nodeName.trim();
-      currentEndPoint.trim();
-      currentToken.trim();
-      nodeLat.trim();
-      nodeLong.trim();
-      nodeLEDSetting.trim();
-
-      Serial.println("Read UUID: " + nodeUUID);
-      Serial.println("Read Name: " + nodeName);
-      Serial.println("Read EndPoint: " + currentEndPoint);
-      Serial.println("Read current token: "+ currentToken);
-      Serial.println("Read UpdateRate: " + String(currentUpdateRate));
-      Serial.println("Read Position: " + nodeLat + "," + nodeLong);
-      Serial.println("Read LED Setting: " + nodeLEDSetting);
+  nodeUUID.trim();
+  nodeName.trim();
+  nodeLat.trim();
+  nodeLong.trim();
+  serializer.setNode(nodeUUID, nodeName, nodeLat, nodeLong);
+  // rebuild currentJSONReply with the new node information
+  serializedSequence = 0;
+}
 
-    }
+// helper function to copy the latest snapshot from the sampling task, this never blocks.
+// Returns true if it is newer than the one currentJSONReply was built from.
+bool readSnapshot()
+{
+  snapshots.read(latestSnapshot);
+  return latestSnapshot.sequence != serializedSequence;
+}
+
+// helper function to bring currentJSONReply up to date with the latest snapshot
+void serializeSnapshot()
+{
+  if (!readSnapshot())
+  {
+    return;
+  }
+
+  size_t length = serializer.render(latestSnapshot, currentJSONReply, sizeof(currentJSONReply));
+  if (length == 0)
+  {
+    LOG_WARN("Readings do not fit in the JSON reply, keeping the previous one.");
+    return;
   }
-  settingsFile.close();
+  currentJSONLength = length;
+  serializedSequence = latestSnapshot.sequence;
+}
+
+// true if uploads are sent as MessagePack instead of JSON
+bool packedUplink()
+{
+  return uplinkEncoding == "MessagePack";
 }
 
 // -------------- Web functions -------------- //
@@ -239,6 +259,7 @@ String handle_Status(AutoConnectAux &aux, PageArgument &args)
   AutoConnectText &interval = aux.getElement<AutoConnectText>("currentUpdateRate");
   AutoConnectText &uptime = aux.getElement<AutoConnectText>("currentUpTime");
 
+  serializeSnapshot();
   title.value = "<h2>" + nodeName + " status<h2>";
   reply.value = currentJSONReply;
   endpoint.value = currentEndPoint;
@@ -260,6 +281,12 @@ String handle_Config(AutoConnectAux &aux, PageArgument &args)
   AutoConnectInput &endpoint = aux.getElement<AutoConnectInput>("urlInput");
   AutoConnectInput &token = aux.getElement<AutoConnectInput>("tokenInput");
   AutoConnectInput &interval = aux.getElement<AutoConnectInput>("intervalInput");
+  AutoConnectInput &batch = aux.getElement<AutoConnectInput>("batchSizeInput");
+  AutoConnectInput &batchAge = aux.getElement<AutoConnectInput>("batchAgeInput");
+  AutoConnectInput &deadbands = aux.getElement<AutoConnectInput>("deadbandInput");
+  AutoConnectInput &heartbeat = aux.getElement<AutoConnectInput>("heartbeatInput");
+  AutoConnectInput &keyframe = aux.getElement<AutoConnectInput>("keyframeInput");
+  AutoConnectRadio &encoding = aux.getElement<AutoConnectRadio>("encodingRadio");
   AutoConnectRadio &ledSetting = aux.getElement<AutoConnectRadio>("ledSettingRadio");
 
   name.value = nodeName;
@@ -269,6 +296,12 @@ String handle_Config(AutoConnectAux &aux, PageArgument &args)
   endpoint.value = currentEndPoint;
   token.value = currentToken;
   interval.value = String(currentUpdateRate);
+  batch.value = String(batchSize);
+  batchAge.value = String(batchMaxAge);
+  deadbands.value = reportDeadbands;
+  heartbeat.value = String(reportHeartbeat);
+  keyframe.value = String(reportKeyframe);
+  encoding.checked = packedUplink() ? 2 : 1;
   if (nodeLEDSetting == "On"){  
     ledSetting.checked = 1;
   }else{
@@ -281,44 +314,158 @@ String handle_Config(AutoConnectAux &aux, PageArgument &args)
 // Handle custom sensor viewer page
 String handle_sensorViewer(AutoConnectAux &aux, PageArgument &args)
 {
-  sensorViewMode = false;
   return String();
 }
 
-// used for updating live sensor view page
+// used for updating live sensor view page, keeps the sampling task at the live view rate
 void handle_getSensorJSON()
 {
-  sensorViewMode = true;
-  server.send(200, "application/json", currentJSONReply);
+  lastLiveViewRequest = millis();
+  serializeSnapshot();
+  server.send_P(200, "application/json", currentJSONReply, currentJSONLength);
+}
+
+// live sensor view stream, every new snapshot is pushed to all subscribed viewers
+void handle_events()
+{
+  serializeSnapshot();
+  if (!liveStream.subscribe(server.client(), currentJSONReply, latestSnapshot.sequence))
+  {
+    server.send(503, "text/plain", "Too many live viewers.");
+    return;
+  }
+  streamedSequence = latestSnapshot.sequence;
+  liveViewStreaming = true;
+}
+
+// push a newer snapshot to the live viewers, if any are subscribed
+void streamSnapshot()
+{
+  liveStream.service();
+  liveViewStreaming = liveStream.count() > 0;
+  if (!liveViewStreaming)
+  {
+    return;
+  }
+
+  serializeSnapshot();
+  if (latestSnapshot.sequence != streamedSequence)
+  {
+    liveStream.publish(currentJSONReply, latestSnapshot.sequence);
+    streamedSequence = latestSnapshot.sequence;
+  }
 }
 
 // for node config API
 void handle_getNodeInfo(){
-  StaticJsonDocument<MAX_JSON_REPLY> jsonDoc;
-  deserializeJson(jsonDoc,currentJSONReply);
+  static char nodeInfo[NODE_INFO_LENGTH];
+  serializeSnapshot();
+  memcpy(nodeInfo, currentJSONReply, currentJSONLength + 1);
 
-  nodeUUID.trim();
-  nodeName.trim();
-  nodeLat.trim();
-  nodeLong.trim();
-  jsonDoc["uuid"] = nodeUUID;
-  jsonDoc["name"] = nodeName;
-  jsonDoc["lat"] = nodeLat.toDouble();
-  jsonDoc["long"] = nodeLong.toDouble();
+  StaticJsonDocument<NODE_SETTINGS_LENGTH> jsonDoc;
   jsonDoc["currentEndpoint"] = currentEndPoint;
   jsonDoc["currentToken"] = currentToken;
   jsonDoc["latestPostReply"] = lastPOSTreply;
   jsonDoc["updateInterval"]  = String(currentUpdateRate);
+  jsonDoc["batchSize"] = String(batchSize);
+  jsonDoc["batchMaxAge"] = String(batchMaxAge);
+  jsonDoc["encoding"] = uplinkEncoding;
+  jsonDoc["deadbands"] = reportDeadbands;
+  jsonDoc["heartbeat"] = String(reportHeartbeat);
+  jsonDoc["keyframe"] = String(reportKeyframe);
   jsonDoc["uptime"] = String(millis() / 1000);
-  jsonDoc["connectedSensors"] = jsonDoc["data"].size();
-  
-  String nodeInfo;
-  // serialize JSON reply string
-  serializeJson(jsonDoc, nodeInfo);
-  // print out JSON output (for debug purposes)
-  Serial.println(nodeInfo);
+  jsonDoc["connectedSensors"] = latestSnapshot.readingCount;
+
+  size_t length = ReplySerializer::append(jsonDoc, nodeInfo, currentJSONLength, sizeof(nodeInfo));
+  if (length == 0)
+  {
+    server.send(500, "text/plain", "Node information too long.");
+    return;
+  }
+
+  server.send_P(200, "application/json", nodeInfo, length);
+}
+
+// counters, latency histograms and node gauges for Prometheus
+void handle_metrics(){
+  static char metricsReply[METRICS_REPLY_LENGTH];
+  size_t length = metrics.render(metricsReply, sizeof(metricsReply));
+  if (length == 0)
+  {
+    server.send(500, "text/plain", "Metrics too long.");
+    return;
+  }
+
+  // node gauges are read now rather than sampled in the background
+  length = appendMetric(metricsReply, length, sizeof(metricsReply),
+    "# TYPE sensestack_heap_free_bytes gauge\n# HELP sensestack_heap_free_bytes Free heap.\n"
+    "sensestack_heap_free_bytes %lu\n"
+    "# TYPE sensestack_heap_min_free_bytes gauge\n# HELP sensestack_heap_min_free_bytes Lowest free heap since boot.\n"
+    "sensestack_heap_min_free_bytes %lu\n"
+    "# TYPE sensestack_heap_largest_block_bytes gauge\n# HELP sensestack_heap_largest_block_bytes Largest block that can be allocated.\n"
+    "sensestack_heap_largest_block_bytes %lu\n"
+    "# TYPE sensestack_wifi_rssi_dbm gauge\n# HELP sensestack_wifi_rssi_dbm Signal strength of the access point.\n"
+    "sensestack_wifi_rssi_dbm %d\n"
+    "# TYPE sensestack_uptime_seconds gauge\n# HELP sensestack_uptime_seconds Time since boot.\n"
+    "sensestack_uptime_seconds %lu\n"
+    "# TYPE sensestack_log_dropped_bytes counter\n# HELP sensestack_log_dropped_bytes Log output overwritten before it reached Serial.\n"
+    "sensestack_log_dropped_bytes_total %lu\n"
+    "# EOF\n",
+    (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMinFreeHeap(), (unsigned long)ESP.getMaxAllocHeap(),
+    WiFi.status() == WL_CONNECTED ? (int)WiFi.RSSI() : 0, millis() / 1000, logDropped());
+  if (length >= sizeof(metricsReply))
+  {
+    server.send(500, "text/plain", "Metrics too long.");
+    return;
+  }
+
+  server.send_P(200, METRICS_CONTENT_TYPE, metricsReply, length);
+}
+
+// recent log lines, including those not yet written to Serial
+void handle_log(){
+  static char logReply[LOG_BUFFER_LENGTH];
+  size_t length = logHistory(logReply, sizeof(logReply));
+  server.send_P(200, "text/plain", logReply, length);
+}
+
+#ifdef LOOP_PROFILER
+// p50, p99 and max time of every loop() phase
+void handle_profile(){
+  static char summary[PROFILER_SUMMARY_LENGTH];
+  size_t length = profiler.renderSummary(summary, sizeof(summary));
+  if (length == 0)
+  {
+    server.send(500, "text/plain", "Profile too long.");
+    return;
+  }
+  server.send_P(200, "application/json", summary, length);
+}
 
-  server.send(200, "application/json", nodeInfo);
+// download the raw loop() trace as CSV, sent in chunks
+void handle_profileTrace(){
+  char chunk[PROFILER_CHUNK_LENGTH];
+  uint16_t row = 0;
+  server.sendHeader("Content-Disposition", "attachment; filename=\"loop-trace.csv\"");
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/csv", "");
+  size_t length;
+  while ((length = profiler.renderTrace(row, chunk, sizeof(chunk))) > 0)
+  {
+    server.sendContent_P(chunk, length);
+  }
+  server.sendContent("");
+}
+#endif
+
+// count connections to the access point after the first one
+void onWiFiConnected(WiFiEvent_t event){
+  static bool connectedBefore = false;
+  if (connectedBefore)
+  {
+    metrics.wifiReconnected();
+  }
+  connectedBefore = true;
 }
 
 // handle redirect to home
@@ -332,7 +479,7 @@ void handle_redirect()
 // handle 404
 void handle_NotFound()
 {
-  server.send(404, "text/html", notFoundPage);
+  sendWebAsset(server, *findWebAsset("/404.html"), 404);
 }
 
 // save the new settings from config page
@@ -345,18 +492,23 @@ void handle_SaveSettings()
   String newToken = server.arg("tokenInput");
   currentToken = newToken;
 
+  // the sampling task restarts its update timer when it sees the new interval
   unsigned long newinterval = server.arg("intervalInput").toInt();
-  if (currentUpdateRate != newinterval)
-  {
-    currentUpdateRate = newinterval;
+  currentUpdateRate = newinterval;
 
-    // reset update interval
-    if (delay_sensor_update.isExpired())
-    {
-      delay_sensor_update.restart();
-    }
-    delay_sensor_update.start(currentUpdateRate, AsyncDelay::MILLIS);
-  }
+  unsigned long newBatchSize = server.arg("batchSizeInput").toInt();
+  batchSize = constrain(newBatchSize, 1, MAX_BATCH_SIZE);
+
+  unsigned long newBatchAge = server.arg("batchAgeInput").toInt();
+  batchMaxAge = newBatchAge > 0 ? newBatchAge : DEFAULT_BATCH_AGE;
+
+  // the next upload is a keyframe, so the endpoint sees every reading under the new deadbands
+  reportDeadbands = server.arg("deadbandInput");
+  reportHeartbeat = server.arg("heartbeatInput").toInt();
+  unsigned long newKeyframe = server.arg("keyframeInput").toInt();
+  reportKeyframe = newKeyframe > 0 ? newKeyframe : DEFAULT_REPORT_KEYFRAME;
+  reportFilter.configure(reportDeadbands);
+  reportFilter.reset();
 
   String newName = server.arg("nameInput");
   nodeName = newName;
@@ -370,11 +522,15 @@ void handle_SaveSettings()
   String newLong = server.arg("longInput");
   nodeLong = newLong;
 
+  String newEncoding = server.arg("encodingRadio");
+  uplinkEncoding = newEncoding == "MessagePack" ? newEncoding : String("JSON");
+
   String newNodeLEDSetting = server.arg("ledSettingRadio");
   nodeLEDSetting = newNodeLEDSetting;
 
   // save settings to file
-  saveSettings();
+  saveSettings(SPIFFS);
+  updateNodeInformation();
 
   Serial.println("Saved new end point URL as " + currentEndPoint);
   Serial.println("Saved new token as " + currentToken);
@@ -383,265 +539,440 @@ void handle_SaveSettings()
   Serial.println("Saved UUID as " + nodeUUID);
   Serial.println("Saved location as " + nodeLat + " " + nodeLong);
   Serial.println("Saved LED setting as " + nodeLEDSetting);
-
+  Serial.println("Saved encoding as " + uplinkEncoding);
+  Serial.println("Saved batch as " + String(batchSize) + " readings or " + String(batchMaxAge) + " ms");
+  Serial.println("Saved report as heartbeat " + String(reportHeartbeat) + " ms, keyframe " + String(reportKeyframe) + " ms, deadbands " + reportDeadbands);
 
   // redirect back to main page after saving
   server.sendHeader("Location", "/status", true);
   server.send(302, "text/plain", "");
 }
 
-// POST latest JSON string to current URL endpoint
-void sendDataToEndpoint()
+// true if the node is connected to a network the endpoint can be reached through
+bool endpointReachable()
+{
+  return (WiFi.status() != WL_IDLE_STATUS) && (WiFi.status() != WL_DISCONNECTED) && (WiFi.getMode() == WIFI_MODE_STA);
+}
+
+// POST a JSON body to current URL endpoint on the uplink task.
+// A body that cannot be handed over now is queued in the reading store.
+bool sendDataToEndpoint(const char *body, size_t length)
+{
+  if (!endpointReachable() || !uplink.post(body, length, currentEndPoint, currentToken))
+  {
+    LOG_DEBUG("Cannot send now, queueing reading.");
+    readingStore.append(body, length);
+    return false;
+  }
+  postedSequence = 0;
+  return true;
+}
+
+// send the batch collected so far as
+// {"uuid":..., "name":..., "lat":..., "long":..., "samples":[{"timestamp":..., "data":{...}, "units":{...}}, ...]}
+// in the encoding its samples were rendered in
+void flushBatch()
+{
+  if (batchCount == 0)
+  {
+    return;
+  }
+
+  static char body[UPLINK_MAX_BODY];
+  size_t length = batchPacked ? serializer.renderPackedBatch(batchSamples, batchLength, batchCount, body, sizeof(body))
+                              : serializer.renderBatch(batchSamples, batchLength, body, sizeof(body));
+
+  LOG_DEBUG("Sending batch of %u readings.", batchCount);
+  // blink once data is sent
+  if (length > 0 && sendDataToEndpoint(body, length) && nodeLEDSetting == "On"){
+    asyncBlink(200);
+  }
+  batchLength = 0;
+  batchCount = 0;
+}
+
+// add a snapshot to the batch, sending it first if the sample would not fit
+void addToBatch(const SensorSnapshot &snapshot)
+{
+  static char sample[JSON_REPLY_LENGTH];
+  bool packed = packedUplink();
+  size_t length = packed ? serializer.renderPackedSample(snapshot, sample, sizeof(sample))
+                         : serializer.renderSample(snapshot, sample, sizeof(sample));
+  if (length == 0)
+  {
+    return;
+  }
+
+  // room for the separator and the terminating NUL, samples of another encoding are sent first
+  if (batchLength + length + 2 > MAX_BATCH_LENGTH || (batchCount > 0 && packed != batchPacked))
+  {
+    flushBatch();
+  }
+  if (batchCount == 0)
+  {
+    batchStartedAt = millis();
+    batchPacked = packed;
+  }
+  else if (!packed)
+  {
+    // packed samples follow each other without a separator
+    batchSamples[batchLength++] = ',';
+  }
+  memcpy(batchSamples + batchLength, sample, length);
+  batchLength += length;
+  batchCount++;
+}
+
+// upload the latest snapshot, or with change reporting on only the readings that are due.
+// Nothing is sent if no reading moved past its deadband and no heartbeat or keyframe is due.
+void uploadReading()
 {
-  Serial.println("Sending data to " + currentEndPoint);
+  serializeSnapshot();
+  const SensorSnapshot *report = &latestSnapshot;
+  const char *body = currentJSONReply;
+  size_t length = currentJSONLength;
 
-  HTTPClient http;
-  http.begin(currentEndPoint);
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("Authorization", "Bearer "+currentToken);
+  if (reportHeartbeat > 0)
+  {
+    if (!reportFilter.select(latestSnapshot, reportSnapshot, millis(), reportHeartbeat, reportKeyframe))
+    {
+      LOG_DEBUG("No reading moved past its deadband, skipping upload.");
+      return;
+    }
+    report = &reportSnapshot;
+  }
 
+  if (batchSize > 1)
+  {
+    addToBatch(*report);
+    return;
+  }
 
-  int httpResponseCode = http.POST(currentJSONReply);
-  String response = http.getString();
-  lastPOSTreply = "Code: ";
-  lastPOSTreply += httpResponseCode;
-  lastPOSTreply += " ";
-  lastPOSTreply += http.errorToString(httpResponseCode);
-  lastPOSTreply += " Reply: ";
-  lastPOSTreply += response;
+  // currentJSONReply already holds the full snapshot as JSON
+  bool packed = packedUplink();
+  if (packed || report != &latestSnapshot)
+  {
+    static char reportReply[JSON_REPLY_LENGTH];
+    length = packed ? serializer.renderPacked(*report, reportReply, sizeof(reportReply))
+                    : serializer.render(*report, reportReply, sizeof(reportReply));
+    if (length == 0)
+    {
+      LOG_WARN("Readings do not fit in the reply, skipping upload.");
+      return;
+    }
+    body = reportReply;
+  }
 
-  if (httpResponseCode > 0)
+  // print out the body (for debug purposes)
+  if (packed)
   {
-    Serial.println("Response from server:");
-    Serial.println(http.errorToString(httpResponseCode));
-    Serial.println(response);
+    LOG_DEBUG("Serialized %u bytes of MessagePack", (unsigned)length);
   }
   else
   {
-    Serial.print("Error on sending POST: ");
-    Serial.println(http.errorToString(httpResponseCode));
+    LOG_DEBUG("Serialized data string: %s", body);
+  }
+  // Send latest data if it is possible to do so, otherwise it is queued, blink once data is sent
+  if (sendDataToEndpoint(body, length) && nodeLEDSetting == "On"){
+    asyncBlink(200);
   }
-  http.end();
 }
 
-// -------------- Sensor Module functions -------------- //
+// send the batch once it is full or its oldest sample reaches the maximum age
+void checkBatch()
+{
+  if (batchCount > 0 && (batchCount >= batchSize || millis() - batchStartedAt >= batchMaxAge))
+  {
+    flushBatch();
+  }
+}
 
-// helper function to scan connected modules on I2C bus
-void scanDevices()
+// send the oldest queued reading if the uplink has nothing else to do,
+// in batches of STORE_DRAIN_BATCH so live readings are never held up for long
+void drainReadingStore()
 {
-  for (byte i = 0; i < MAX_SENSORS; i++) // fill modules array with zeroes
+  if (readingStore.pending() == 0 || uploadPending || !uplink.idle() || !delay_store_drain.isExpired() || !endpointReachable())
   {
-    
-    modules[i] = 0;
+    return;
+  }
+
+  static char reading[STORE_MAX_PAYLOAD + 1];
+  size_t length;
+  uint32_t sequence;
+  if (!readingStore.peek(reading, sizeof(reading), length, sequence) || !uplink.post(reading, length, currentEndPoint, currentToken))
+  {
+    return;
+  }
+  LOG_DEBUG("Sending queued reading %lu, %lu waiting.", (unsigned long)sequence, (unsigned long)readingStore.pending());
+  postedSequence = sequence;
+  if (sequence != attemptedSequence)
+  {
+    attemptedSequence = sequence;
+    drainAttempts = 0;
+  }
+  if (++drainedInBatch >= STORE_DRAIN_BATCH)
+  {
+    drainedInBatch = 0;
+    delay_store_drain.start(STORE_DRAIN_INTERVAL, AsyncDelay::MILLIS);
   }
+}
+
+// helper function to tell replies worth retrying from ones the endpoint will give again for the same body.
+// A 4xx other than 408 and 429 means the reading itself is refused, transport errors and 5xx are retried.
+bool retryableReply(int code)
+{
+  return code < 400 || code >= 500 || code == 408 || code == 429;
+}
 
-  byte error, address;
-  int nDevices;
-  Serial.println("Scanning for connected modules...");
-  nDevices = 0;
-  for (address = 1; address < TOP_ADDRESS; address++)
+// pick up the reply of the last POST, acknowledging, queueing or dropping its reading
+void collectEndpointReply()
+{
+  if (!uplink.collect(lastPOSTreply))
   {
-    if (address == 0x40){       //Prevent connection to built-in sensor on NB-IoT board.
-      continue;
+    return;
+  }
+
+  int code = uplink.lastResponseCode();
+  bool delivered = code >= 200 && code < 300;
+  bool refused = !delivered && !retryableReply(code);
+  if (postedSequence != 0)
+  {
+    // a queued reading that cannot be delivered must not hold up the ones behind it
+    if (!delivered && !refused && code > 0 && ++drainAttempts >= STORE_MAX_ATTEMPTS)
+    {
+      LOG_WARN("Endpoint answered queued reading %lu with %d %u times, dropping it.", (unsigned long)postedSequence, code, drainAttempts);
+      refused = true;
+    }
+    else if (refused)
+    {
+      LOG_WARN("Endpoint refused queued reading %lu with %d, dropping it.", (unsigned long)postedSequence, code);
     }
 
-    Wire.beginTransmission(address);
-    error = Wire.endTransmission();
-    if (error == 0) // success
+    if (delivered || refused)
     {
-      Serial.print("Module found at address 0x");
-      if (address < 16)
+      readingStore.acknowledge(postedSequence);
+      drainFailures = 0;
+      if (refused)
       {
-        Serial.print("0");
+        metrics.readingRejected();
       }
-      Serial.println(address, HEX);
-      modules[nDevices] = address;
-      nDevices++;
     }
-    else if (error == 4) // unknown error
+    else
     {
-      Serial.print("Unknown error at address 0x");
-      if (address < 16)
+      // try again after a pause that doubles with every failure instead of hammering a failing endpoint
+      if (drainFailures < STORE_MAX_BACKOFF_SHIFT)
       {
-        Serial.print("0");
+        drainFailures++;
       }
-      Serial.println(address, HEX);
-    }
-
-    if (nDevices > MAX_SENSORS) // maximum number of sensors allowed reached
-    {
-      Serial.print("Maximum of ");
-      Serial.print(MAX_SENSORS);
-      Serial.println(" sensors are connected. Terminating scan.");
-      break;
+      drainedInBatch = 0;
+      delay_store_drain.start(STORE_DRAIN_INTERVAL << drainFailures, AsyncDelay::MILLIS);
     }
+    postedSequence = 0;
   }
-  if (nDevices == 0)
+  else if (refused)
   {
-    Serial.println("No modules are connected.");
+    LOG_WARN("Endpoint refused reading with %d, dropping it.", code);
+    metrics.readingRejected();
   }
-  else
+  else if (!delivered)
   {
-    Serial.println("Scan complete.");
+    LOG_WARN("POST failed with %d, queueing reading.", code);
+    readingStore.append(uplink.lastBody(), uplink.lastBodyLength());
   }
 }
 
-// helper function to request data from a sensor module and add it to the JSON packet
-void getSensorModuleReading(byte sensorAddr, JsonObject dataObj)
+// -------------- Sensor Module functions -------------- //
+
+// true while a live sensor viewer is subscribed or has polled for data recently
+bool liveViewActive()
+{
+  return liveViewStreaming || millis() - lastLiveViewRequest < 2 * LIVE_SENSOR_INTERVAL;
+}
+
+// helper function to poll one module and merge its readings into the next snapshot
+void pollModule(byte address)
 {
-  // print out who we are communicating with
-  Serial.print("Sending request to 0x");
-  if (sensorAddr < 16)
+  polledReadings.clear();
+  bool answered = pollSensorModule(registry, address, polledReadings);
+  registry.pollResult(address, answered);
+  if (answered)
   {
-    Serial.print("0");
+    mergedReadings.replaceModule(address, polledReadings);
+    windowStats.observe(address, polledReadings);
   }
-  Serial.println(sensorAddr, HEX);
+  // modules sampling faster than the live view keep their own rate, slower ones follow it while it is open
+  schedule.polled(address, answered, millis(), liveViewActive() ? LIVE_SENSOR_INTERVAL : 0);
+}
 
-  bool endTransmission = false;
+// helper function to keep the poll schedule in step with the registry.
+// New modules report their timing and are polled right away so the JSON layout follows,
+// detached modules are dropped along with their readings. Returns true if anything changed.
+bool syncSchedule()
+{
+  if (registry.version() == scheduledLayout)
+  {
+    return false;
+  }
+  scheduledLayout = registry.version();
 
-  char replyData[MAX_SENSOR_REPLY_LENGTH] = {0};
-  char lastSpecifier = 0;
-  String dataKey = "";
-  String dataValue = "";
-  uint8_t replyCharIter = 0;
-  uint8_t replyCount = 0;
+  byte detached[MAX_SENSORS];
+  uint8_t detachedCount = 0;
+  for (uint8_t i = 0; i < schedule.count(); i++)
+  {
+    if (!registry.contains(schedule.address(i)))
+    {
+      detached[detachedCount++] = schedule.address(i);
+    }
+  }
+  for (uint8_t i = 0; i < detachedCount; i++)
+  {
+    schedule.remove(detached[i]);
+    mergedReadings.removeModule(detached[i]);
+    windowStats.removeModule(detached[i]);
+  }
 
-  // requst all data sensor module has to offer (with timeout)
-  while(lastSpecifier != CH_TERMINATE)
-  { 
-    // check timeout
-    if(replyCount >= DATA_TRANSMISSION_TIMEOUT)
+  for (uint8_t i = 0; i < registry.count(); i++)
+  {
+    byte address = registry.address(i);
+    if (!schedule.contains(address) && schedule.add(address, readModuleTiming(address), millis()))
     {
-      Serial.println("Too many transmissions from module. Terminating!");
-      break;
+      pollModule(address);
     }
-    // start i2c transmission to module
-    Wire.requestFrom(sensorAddr, MAX_SENSOR_REPLY_LENGTH);
-    endTransmission = false;
-    replyCount++;
-    // read until end of transmission
-    while (Wire.available() && !endTransmission)
+  }
+  return true;
+}
+
+// helper function to poll the modules whose poll is due, returns true if any was polled
+bool pollDueModules()
+{
+  unsigned long started = micros();
+  bool polled = false;
+  byte address;
+  while ((address = schedule.nextDue(millis())) != 0)
+  {
+    pollModule(address);
+    polled = true;
+  }
+  if (polled)
+  {
+    metrics.fetch.observe(micros() - started);
+  }
+  return polled;
+}
+
+// helper function to poll every module that can be read again, so an upload is fresh.
+// Modules already polled since passStarted, e.g. by pollDueModules(), are not read twice.
+void pollAllModules(unsigned long passStarted)
+{
+  unsigned long started = micros();
+  byte due[MAX_SENSORS];
+  uint8_t dueCount = 0;
+  for (uint8_t i = 0; i < schedule.count(); i++)
+  {
+    byte address = schedule.address(i);
+    if (schedule.canPoll(address, millis()) && !schedule.polledSince(address, passStarted))
     {
-      // read each individual character
-      char c = Wire.read();
-      switch(c) {
-        case CH_IS_KEY:
-          lastSpecifier = c;
-          replyCharIter = 0;
-          Serial.print("Reading key, ");
-          break;
-
-        case CH_IS_VALUE:
-          lastSpecifier = c;
-          replyCharIter = 0;
-          Serial.print("Reading value, ");
-          break;
-
-        case CH_MORE:
-          // terminate reply string
-          replyData[replyCharIter] = 0;
-          // print out reading to see what we got
-          Serial.print("Parsed reading: ");
-          Serial.println(replyData);
-          // put the parsed reading in the right string and add data to JSON
-          if(lastSpecifier == CH_IS_KEY)
-          {
-            dataKey = String(replyData);
-          }
-          else if(lastSpecifier == CH_IS_VALUE)
-          {
-            dataValue = String(replyData);
-            // add the pair to the data object
-            dataObj[dataKey] = dataValue;
-          }
-          else
-          {
-            Serial.println("Unknown reading, discarding.");
-          }
-          // clear the data buffer
-          memset(replyData,0,sizeof(replyData));
-          replyCharIter = 0;
-          lastSpecifier = c;
-          endTransmission = true;
-          break;
-
-        case CH_TERMINATE:
-          // same as CH_more
-          // terminate reply string
-          replyData[replyCharIter] = 0;
-          // print out reading to see what we got
-          Serial.print("Parsed reading: ");
-          Serial.println(replyData);
-          // put the parsed reading in the right string and add data to JSON
-          if(lastSpecifier == CH_IS_KEY)
-          {
-            dataKey = String(replyData);
-          }
-          else if(lastSpecifier == CH_IS_VALUE)
-          {
-            dataValue = String(replyData);
-            // add the pair to the data object
-            dataObj[dataKey] = dataValue;
-          }
-          else
-          {
-            Serial.println("Unknown reading, discarding.");
-          }
-          // clear the data buffer
-          memset(replyData,0,sizeof(replyData));
-          replyCharIter = 0;
-          lastSpecifier = c;
-          endTransmission = true;
-          break;
-
-        default:
-          // append the character into the reply data array and increment replyCharIter
-          replyData[replyCharIter++] = c;
-          break;
-      }
+      due[dueCount++] = address;
     }
   }
-  Serial.println("Request complete. Total of " + String(replyCount) + " transmissions.");
+  for (uint8_t i = 0; i < dueCount; i++)
+  {
+    pollModule(due[i]);
+  }
+  metrics.fetch.observe(micros() - started);
 }
 
-// helper function to request data from all connected modules and create a JSON object
-void fetchData()
+// helper function to hand the merged readings and the statistics of the window so far to loop() and the web handlers
+void publishSnapshot()
 {
-  byte sensorCount = 0;
+  SensorSnapshot &snapshot = snapshots.beginWrite();
+  snapshot = mergedReadings;
+  windowStats.fill(snapshot);
+  snapshot.moduleCount = schedule.answering();
+  snapshot.sequence = ++snapshotSequence;
+  snapshot.takenAt = millis();
+  time_t now = time(NULL);
+  snapshot.timestamp = now > CLOCK_VALID_AFTER ? now : 0;
+  snapshots.publish();
+  LOG_DEBUG("Published snapshot %lu.", (unsigned long)snapshotSequence);
+}
 
-  // create JSON document
-  StaticJsonDocument<MAX_JSON_REPLY> jsonDoc;
-  currentJSONReply = "";
-  nodeUUID.trim();
-  nodeName.trim();
-  nodeLat.trim();
-  nodeLong.trim();
-  jsonDoc["uuid"] = nodeUUID;
-  jsonDoc["name"] = nodeName;
-  jsonDoc["lat"] = nodeLat.toDouble();
-  jsonDoc["long"] = nodeLong.toDouble();
-  JsonObject dataObj = jsonDoc.createNestedObject("data");
+// FreeRTOS task that owns the I2C bus. It keeps the module registry up to date,
+// polls each module on its own cadence for the window statistics and the live view,
+// and polls all of them when a reading is due at the endpoint, so neither the web UI
+// nor a slow endpoint can hold up sampling and vice versa.
+void samplingTask(void *parameter)
+{
+  // modules described before the reboot are polled for values right away
+  registry.loadDescriptors(SPIFFS);
+
+  // perform initial device scan, afterwards the registry is kept up to date below
+  Serial.println("Performing initial device scan.");
+  unsigned long started = micros();
+  registry.scan();
+  metrics.scan.observe(micros() - started);
+  syncSchedule();
+  publishSnapshot();
+
+  unsigned long updateRate = currentUpdateRate;
+  delay_sensor_update.start(updateRate, AsyncDelay::MILLIS);
+  delay_module_sweep.start(MODULE_SWEEP_INTERVAL, AsyncDelay::MILLIS);
 
-  // obtain information from sensors
-  Serial.println("Gathering sensor data.");
-  for (int i = 0; i < MAX_SENSORS; i++)
+  for (;;)
   {
-    if (modules[i] != 0)
+    bool changed = false;
+    unsigned long passStarted = millis();
+
+    // restart the update timer when the interval is changed from the config page
+    if (updateRate != currentUpdateRate)
     {
-      getSensorModuleReading(modules[i], dataObj);
-      sensorCount++;
+      updateRate = currentUpdateRate;
+      delay_sensor_update.start(updateRate, AsyncDelay::MILLIS);
+    }
+
+    // look for newly attached modules a few addresses at a time
+    if (delay_module_sweep.isExpired())
+    {
+      unsigned long started = micros();
+      registry.sweep();
+      metrics.sweep.observe(micros() - started);
+      delay_module_sweep.restart();
+    }
+
+    // every module on its own cadence, the snapshot only follows while the live sensor view is open
+    bool polled = pollDueModules();
+    if (liveViewActive())
+    {
+      changed = polled;
+    }
+
+    // data update loop, the upload itself happens in loop()
+    bool upload = delay_sensor_update.isExpired();
+    if (upload)
+    {
+      pollAllModules(passStarted);
+    }
+
+    // modules found by the sweep or detached after missing their polls
+    if (syncSchedule())
+    {
+      changed = true;
+    }
+
+    if (changed || upload)
+    {
+      publishSnapshot();
+    }
+    if (upload)
+    {
+      // the published snapshot carries the window that just ended
+      windowStats.reset();
+      uploadPending = true;
+      delay_sensor_update.restart();
     }
-  }
-  Serial.print("Read from ");
-  Serial.print(sensorCount);
-  Serial.println(" sensors");
 
-  // serialize JSON reply string
-  serializeJson(jsonDoc, currentJSONReply);
-  // print out JSON output (for debug purposes)
-  Serial.println("Serialized data string:");
-  Serial.println(currentJSONReply);
-  Serial.println("Saved JSON to string.\n");
+    vTaskDelay(SAMPLING_TASK_TICK / portTICK_PERIOD_MS);
+  }
 }
 
  //respond to UDP SSDP M-SEARCH
@@ -694,13 +1025,24 @@ void setup()
   Serial.println("SPIFFS mounted.");
 
   // load settings on boot
-  loadSettings();
+  loadSettings(SPIFFS);
+  updateNodeInformation();
+  reportFilter.configure(reportDeadbands);
 
   // attach handlers for HTTPserver
   server.on("/", handle_redirect);
   server.on("/save_settings", handle_SaveSettings);
   server.on("/getJSON", handle_getSensorJSON);
+  server.on("/events", handle_events);
   server.on("/getNodeInfo", handle_getNodeInfo);
+  server.on("/metrics", handle_metrics);
+  server.on("/log", handle_log);
+  serveWebAssets(server);
+#ifdef LOOP_PROFILER
+  server.on("/profile", handle_profile);
+  server.on("/profile/trace", handle_profileTrace);
+#endif
+  WiFi.onEvent(onWiFiConnected, SYSTEM_EVENT_STA_GOT_IP);
 
   // setup update server
   updateServer.setup(&server);
@@ -782,6 +1124,9 @@ void setup()
 
     senseStackUDP.beginMulticast(IPAddress(239, 255, 255, 250), 1900);
 
+    // wall clock for timestamping readings, queued ones are sent long after they were taken
+    configTime(0, 0, "pool.ntp.org");
+
   }
   else
   {
@@ -789,11 +1134,13 @@ void setup()
     ESP.restart();
   }
 
-  // perform initial device scan
-  Serial.println("Performing initial device scan.");
-  scanDevices();
-  delay_sensor_update.start(currentUpdateRate, AsyncDelay::MILLIS);
-  delay_sensor_view.start(LIVE_SENSOR_INTERVAL, AsyncDelay::MILLIS);
+  // start the uplink task, POSTs no longer block loop()
+  uplink.begin();
+  readingStore.begin();
+  delay_store_drain.start(STORE_DRAIN_INTERVAL, AsyncDelay::MILLIS);
+
+  // start sampling, from here on only the sampling task uses the I2C bus
+  xTaskCreatePinnedToCore(samplingTask, "sampling", SAMPLING_TASK_STACK, NULL, SAMPLING_TASK_PRIORITY, NULL, SAMPLING_TASK_CORE);
 
   // Turn off LED to indicate finished of booting process
   digitalWrite(LED_TICKER, LOW);
@@ -801,62 +1148,60 @@ void setup()
 
 void loop()
 {
-  // handle web UI
+  unsigned long loopStarted = micros();
+  PROFILE_LOOP_BEGIN();
+
+  // handle web UI, every connection with a request waiting is answered in this pass
   server.handleClient();
+  PROFILE_PHASE(PHASE_WEB);
   Portal.handleRequest();
+  PROFILE_PHASE(PHASE_PORTAL);
+  streamSnapshot();
+  PROFILE_PHASE(PHASE_STREAM);
 
   // handle button press
   checkButton();
+  PROFILE_PHASE(PHASE_BUTTON);
 
   // handle LED state
   asyncBlink();
+  PROFILE_PHASE(PHASE_BLINK);
 
-  // if we are viewing the live sensor view page
-  if(delay_sensor_view.isExpired() && sensorViewMode == true)
+  // upload the reading the sampling task flagged for the endpoint
+  if (uploadPending)
   {
-    scanDevices();
-    fetchData();
-    delay_sensor_view.restart();
-    return;
+    uploadPending = false;
+    uploadReading();
   }
-  // this will be set to true while viewing the live sensor view page
-  sensorViewMode = false;
+  checkBatch();
+  PROFILE_PHASE(PHASE_UPLOAD);
 
-  // data update loop
-  if (delay_sensor_update.isExpired())
-  {
-    scanDevices();
-    fetchData();
-    // Send latest data if it is possible to do so
-    if ((currentJSONReply != NULL || currentJSONReply != "") && (WiFi.status() != WL_IDLE_STATUS) && (WiFi.status() != WL_DISCONNECTED))
-    {
-      if (WiFi.getMode() == WIFI_MODE_STA){
-        sendDataToEndpoint();
-        // blink once data is sent
-        if (nodeLEDSetting == "On"){
-          asyncBlink(200);
-        }
-      }
-    }
-    delay_sensor_update.restart();
-  }
+  // pick up the reply of the last POST once the uplink task has it,
+  // then backfill readings that were queued while the endpoint was unreachable
+  collectEndpointReply();
+  drainReadingStore();
+  PROFILE_PHASE(PHASE_UPLINK);
 
    //check incoming UDP packet for SSDP service
     int packetSize = senseStackUDP.parsePacket();    
     if (packetSize){
-      Serial.println("Got UDP");
+      LOG_DEBUG("Got UDP");
       int len = senseStackUDP.read(packetBuffer, 254);
       if (len > 0) {
         packetBuffer[len] = 0;
       }
       senseStackUDP.flush();      
-      String request = packetBuffer;
-      if(request.indexOf("M-SEA") >= 0) { //M-SEARCH
-        //match upnp:rootdevice, device:basic:1, ssdp:all and ssdp:discover
-        if(request.indexOf("np:rootd") > 0 || request.indexOf("asic:1") > 0 || request.indexOf("dp:all") > 0 || request.indexOf("dp:dis") > 0) {
-          Serial.println("Responding search req...");
-          respondToSearch();
-        }
+      if(isSearchRequest(packetBuffer)) {
+        LOG_DEBUG("Responding search req...");
+        respondToSearch();
       }
     }
+  PROFILE_PHASE(PHASE_DISCOVERY);
+
+  // write out what was logged, as far as Serial takes it without waiting
+  logFlush(Serial);
+  PROFILE_PHASE(PHASE_LOG);
+  PROFILE_LOOP_END();
+
+  metrics.loopTime(micros() - loopStarted);
 }
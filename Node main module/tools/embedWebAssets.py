@@ -0,0 +1,105 @@
+# Compresses the web assets in src/html and embeds them in the firmware.
+#
+# Runs before every build of the node32s environments (extra_scripts in
+# platformio.ini) and can also be run by hand: python3 tools/embedWebAssets.py
+#
+# Each asset is gzipped and written as a byte array to src/generated/webAssetData.h
+# together with an ETag taken from a hash of its content. The URLs with that
+# hash as version, which pages use to reference the assets, are written to
+# src/generated/webAssetUrls.h. Files are only rewritten when their content
+# changes so unchanged assets do not trigger a rebuild.
+
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+# file in src/html, URL it is served at, content type
+ASSETS = [
+    ("sensorviewer.js", "/sensorviewer.js", "application/javascript"),
+    ("404.html", "/404.html", "text/html"),
+]
+
+HASH_LENGTH = 16  # hex digits of the SHA-256 of an asset used as its ETag
+VERSION_LENGTH = 8  # hex digits of the hash used as ?v= in asset URLs
+BYTES_PER_LINE = 16
+
+
+def symbol(name):
+    return re.sub(r"[^A-Za-z0-9]", "_", name)
+
+
+def write_if_changed(path, text):
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == text:
+                return
+    with open(path, "w") as f:
+        f.write(text)
+    print("embedWebAssets: wrote " + os.path.relpath(path))
+
+
+def embed(project_dir):
+    html_dir = os.path.join(project_dir, "src", "html")
+    out_dir = os.path.join(project_dir, "src", "generated")
+    if not os.path.isdir(out_dir):
+        os.makedirs(out_dir)
+
+    data = ["// Generated by tools/embedWebAssets.py from src/html, do not edit.",
+            "",
+            "#ifndef webAssetData_h",
+            "#define webAssetData_h",
+            "",
+            "#include \"WebAssets.h\"",
+            ""]
+    urls = ["// Generated by tools/embedWebAssets.py from src/html, do not edit.",
+            "",
+            "#ifndef webAssetUrls_h",
+            "#define webAssetUrls_h",
+            ""]
+    table = []
+
+    for name, path, content_type in ASSETS:
+        with open(os.path.join(html_dir, name), "rb") as f:
+            content = f.read()
+        digest = hashlib.sha256(content).hexdigest()
+        # mtime 0 keeps the output identical between builds of the same content
+        packed = gzip.compress(content, compresslevel=9, mtime=0)
+        array = "asset_" + symbol(name)
+
+        data.append("// %s, %d bytes, %d gzipped" % (name, len(content), len(packed)))
+        data.append("static const uint8_t %s[] PROGMEM = {" % array)
+        for i in range(0, len(packed), BYTES_PER_LINE):
+            chunk = packed[i:i + BYTES_PER_LINE]
+            data.append("  " + ", ".join("0x%02x" % b for b in chunk) + ",")
+        data.append("};")
+        data.append("")
+        table.append("  {\"%s\", \"%s\", %s, sizeof(%s), \"\\\"%s\\\"\"},"
+                     % (path, content_type, array, array, digest[:HASH_LENGTH]))
+        urls.append("#define WEB_ASSET_URL_%s \"%s?v=%s\""
+                    % (symbol(name).upper(), path, digest[:VERSION_LENGTH]))
+
+    data.append("static const WebAsset webAssets[] = {")
+    data.extend(table)
+    data.append("};")
+    data.append("")
+    data.append("#define WEB_ASSET_COUNT (sizeof(webAssets) / sizeof(webAssets[0]))")
+    data.append("")
+    data.append("#endif")
+    urls.append("")
+    urls.append("#endif")
+
+    write_if_changed(os.path.join(out_dir, "webAssetData.h"), "\n".join(data) + "\n")
+    write_if_changed(os.path.join(out_dir, "webAssetUrls.h"), "\n".join(urls) + "\n")
+
+
+try:
+    Import("env")  # defined when run by PlatformIO
+except NameError:
+    env = None
+
+if env is not None:
+    embed(env.subst("$PROJECT_DIR"))
+elif __name__ == "__main__":
+    embed(os.path.dirname(os.path.dirname(os.path.abspath(sys.argv[0]))))
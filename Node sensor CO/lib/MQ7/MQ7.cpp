@@ -34,6 +34,18 @@ float MQ7::getPPM(){
   return (float)(coefficient_A * pow(getRatio(), coefficient_B));
 }
 
+/*
+Same as getPPM(), from a reading taken elsewhere, such as a filtered one
+
+@param value : reading of analogPin
+@param fullScale : what the reading is at v_in, 1023 for analogRead()
+
+@return ppm value of Carbon Monoxide concentration
+*/
+float MQ7::getPPM(uint16_t value, uint16_t fullScale){
+  return (float)(coefficient_A * pow(getRatio(value, fullScale), coefficient_B));
+}
+
 /*
 This function returns voltage from the analog input value
 Refer ADC Conversion for further reference
@@ -56,6 +68,22 @@ float MQ7::getRatio(){
   float v_out = voltageConversion(value);
   return (v_in - v_out) / v_out;
 }
+
+/*
+Same as getRatio(), from a reading taken elsewhere.
+v_in cancels out, so the ratio follows from the reading alone
+
+@param value : reading of analogPin
+@param fullScale : what the reading is at v_in
+
+@return The value of Rs/R_Load
+*/
+float MQ7::getRatio(uint16_t value, uint16_t fullScale){
+  if (value == 0){
+    value = 1; // an open sensor reads as the highest ratio instead of dividing by zero
+  }
+  return (float)(fullScale - value) / value;
+}
 /*
 To find the sensor resistance Rs
 
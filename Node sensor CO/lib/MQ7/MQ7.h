@@ -35,8 +35,10 @@ class MQ7 {
 	public:
 		MQ7(uint8_t, float);
 		float getPPM();
+		float getPPM(uint16_t value, uint16_t fullScale);
 		float getSensorResistance();
 		float getRatio();
+		float getRatio(uint16_t value, uint16_t fullScale);
 };
 
 #endif
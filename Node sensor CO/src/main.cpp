@@ -1,38 +1,57 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include "protocol.h"
+#include "SensorReply.h"
+#include "Log.h"
 
 #include "MQ7.h"
+#include "AnalogSampler.h"
 
 byte SELF_ADDR = SENSOR_CO;
-byte transmissionCounter = 0; // counter for what string to send
+SensorReply reply; // pre-serialized reply served to the main module
+
+#define PUBLISH_INTERVAL 1000 // ms between published samples
+#define FIRMWARE_VERSION 1 // reported in the module descriptor
 
 MQ7 mq7(A0,5.0);
+uint8_t coChannel; // filtered in the background by analogSampler
+unsigned long lastPublish = 0;
 float coPPM = 0.0;
 
+// -------------- Utility Functions -------------- //
+
+// encode the latest readings into the reply served to the main module
+void publishReading()
+{
+  if (reply.begin())
+  {
+    reply.add(CHANNEL_CO_DENSITY, UNIT_PPM, coPPM);
+    reply.publish();
+  }
+}
+
 // -------------- Protocol Function -------------- //
 // This function will be called when a request on I2C has been made
 // to this module. The main module will continue requesting until
-// the character CH_TERMINATE ('!') is recieved
+// the character CH_TERMINATE ('!') is recieved, or the whole binary
+// frame has been read if it wrote CMD_READ_FRAME beforehand.
+// It runs in interrupt context, so it only copies out the reply
+// that loop() last published.
 
 void sendData()
 {
-  char replyData[MAX_SENSOR_REPLY_LENGTH];
-  String reply = "";
-
-  switch(transmissionCounter) {
-  case 0:
-    reply = CH_IS_KEY + String("co_density") + CH_MORE;
-    transmissionCounter++;
-    break;
-  case 1:
-    reply = CH_IS_VALUE + String(coPPM) + " ppm" + CH_TERMINATE;
-    transmissionCounter = 0;
-    break;
+  reply.send();
+}
+
+// This function will be called when the main module writes a command
+// to this module before requesting data.
+
+void receiveCommand(int count)
+{
+  while (Wire.available())
+  {
+    reply.command(Wire.read());
   }
-  reply.toCharArray(replyData, MAX_SENSOR_REPLY_LENGTH);
-  Serial.println("Sent " + reply);
-  Wire.write(replyData); // send string on request
 }
 
 // -------------- Arduino framework main code -------------- //
@@ -41,11 +60,26 @@ void setup()
 {
   Wire.begin(SELF_ADDR);          // join i2c bus with defined address
   Wire.onRequest(sendData);       // register request event
+  Wire.onReceive(receiveCommand); // register command event
+  reply.setTiming(1000, 1000);    // a new CO sample every second
+  reply.describe(MODULE_CO, FIRMWARE_VERSION);
+  reply.describeChannel(CHANNEL_CO_DENSITY, UNIT_PPM, VALUE_UINT16, 1); // 0.1 ppm up to 6553 ppm
   Serial.begin(9600);             // start serial for debug
+  LOG_INFO("CO module started.");
+  // 16 samples per value, a median of 3 against spikes and an EMA over about 16 values
+  coChannel = analogSampler.add(A0, 2, 3, 4);
+  analogSampler.begin();
 }
 
 void loop()
 {
-  delay(1000);
-  coPPM = mq7.getPPM();
+  // the pow() of the conversion runs here once a second, never per sample
+  if (millis() - lastPublish >= PUBLISH_INTERVAL && analogSampler.ready(coChannel))
+  {
+    lastPublish = millis();
+    coPPM = mq7.getPPM(analogSampler.read(coChannel), analogSampler.fullScale(coChannel));
+    publishReading();
+    LOG_DEBUG("CO %ld d ppm", (long)(coPPM * 10)); // tenths, AVR printf has no %f
+  }
+  logFlush(Serial);
 }
\ No newline at end of file
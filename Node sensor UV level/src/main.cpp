@@ -1,53 +1,55 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include "protocol.h"
+#include "SensorReply.h"
+#include "Log.h"
+#include "AnalogSampler.h"
 
 byte SELF_ADDR = SENSOR_LIGHT_UV;
-byte transmissionCounter = 0; // counter for what string to send
+SensorReply reply; // pre-serialized reply served to the main module
+
+#define PUBLISH_INTERVAL 1000 // ms between published samples
+#define FIRMWARE_VERSION 1 // reported in the module descriptor
 
 int UVOUT = A0; //Output from the sensor
 int REF_3V3 = A1; //3.3V power on the Arduino board
+uint8_t uvChannel, refChannel; // filtered in the background by analogSampler
+unsigned long lastPublish = 0;
 float uvIntensity = 0;
 
 // -------------- Utility Functions -------------- //
 
-//Takes an average of readings on a given pin, returns the average
-int averageAnalogRead(int pinToRead) {
-  byte numberOfReadings = 8;
-  unsigned int runningValue = 0; 
-
-  for(int x = 0 ; x < numberOfReadings ; x++)
-    runningValue += analogRead(pinToRead);
-    runningValue /= numberOfReadings;
-    return(runningValue);  
-}
-
 float mapfloat(float x, float in_min, float in_max, float out_min, float out_max){
   return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
 }
 
+// encode the latest readings into the reply served to the main module
+void publishReading() {
+  if (reply.begin()) {
+    reply.add(CHANNEL_UV_INTENSITY, UNIT_MW_PER_CM2, uvIntensity);
+    reply.publish();
+  }
+}
+
 // -------------- Protocol Function -------------- //
 // This function will be called when a request on I2C has been made
 // to this module. The main module will continue requesting until
-// the character CH_TERMINATE ('!') is recieved
+// the character CH_TERMINATE ('!') is recieved, or the whole binary
+// frame has been read if it wrote CMD_READ_FRAME beforehand.
+// It runs in interrupt context, so it only copies out the reply
+// that loop() last published.
 
 void sendData() {
-  char replyData[MAX_SENSOR_REPLY_LENGTH];
-  String reply = "";
-
-  switch(transmissionCounter) {
-  case 0:
-    reply = CH_IS_KEY + String("uv_intensity") + CH_MORE;
-    transmissionCounter++;
-    break;
-  case 1:
-    reply = CH_IS_VALUE + String(uvIntensity) + " mw/cm^2" + CH_TERMINATE;
-    transmissionCounter = 0;
-    break;
+  reply.send();
+}
+
+// This function will be called when the main module writes a command
+// to this module before requesting data.
+
+void receiveCommand(int count) {
+  while (Wire.available()) {
+    reply.command(Wire.read());
   }
-  reply.toCharArray(replyData, MAX_SENSOR_REPLY_LENGTH);
-  Serial.println("Sent " + reply);
-  Wire.write(replyData); // send string on request
 }
 
 // -------------- Arduino framework main code -------------- //
@@ -55,27 +57,44 @@ void sendData() {
 void setup(){
   Wire.begin(SELF_ADDR);
   Wire.onRequest(sendData);
+  Wire.onReceive(receiveCommand);
+  reply.setTiming(1000, 1000); // a new UV sample every second
+  reply.describe(MODULE_UV, FIRMWARE_VERSION);
+  reply.describeChannel(CHANNEL_UV_INTENSITY, UNIT_MW_PER_CM2, VALUE_UINT16, 2); // 0.01 mW/cm^2 up to 655 mW/cm^2
   Serial.begin(9600);
   pinMode(UVOUT, INPUT);
   pinMode(REF_3V3, INPUT);
+  // 16 samples per value, a median of 3 against spikes and an EMA over about 8 values.
+  // Sharing the ADC, each channel gets about 30 values a second.
+  uvChannel = analogSampler.add(UVOUT, 2, 3, 3);
+  refChannel = analogSampler.add(REF_3V3, 2, 3, 3);
+  analogSampler.begin();
 }
 
 void loop(){
-  int uvLevel = averageAnalogRead(UVOUT);
-  int refLevel = averageAnalogRead(REF_3V3);
+  if (millis() - lastPublish < PUBLISH_INTERVAL || !analogSampler.ready(uvChannel) || !analogSampler.ready(refChannel)) {
+    logFlush(Serial);
+    return;
+  }
+  lastPublish = millis();
+
+  uint16_t uvLevel = analogSampler.read(uvChannel);
+  uint16_t refLevel = analogSampler.read(refChannel);
+  if (refLevel == 0) {
+    return; // no reference, the 3.3V pin is not connected
+  }
 
   //Use the 3.3V power pin as a reference to get a very accurate output value from sensor
 
   float outputVoltage = 3.3 / refLevel * uvLevel;
   uvIntensity = mapfloat(outputVoltage, 0.99, 2.8, 0.0, 15.0); //Convert the voltage to a UV intensity level
-  Serial.print("output: ");
-  Serial.print(refLevel);
-  Serial.print("ML8511 output: ");
-  Serial.print(uvLevel);
-  Serial.print(" / ML8511 voltage: ");
-  Serial.print(outputVoltage);
-  Serial.print(" / UV Intensity (mW/cm^2): ");
-  Serial.print(uvIntensity);
-  Serial.println();
-  delay(1000);
-}
\ No newline at end of file
+  // below 0.99 V (low light) the map goes negative, clamped here so the text reply,
+  // the frame and the unsigned values frame all report the same 0
+  if (uvIntensity < 0) {
+    uvIntensity = 0;
+  }
+  publishReading();
+  // AVR printf has no %f, so millivolts and uW/cm^2
+  LOG_DEBUG("ref %u ML8511 %u %d mV %d uW/cm2", refLevel, uvLevel, (int)(outputVoltage * 1000), (int)(uvIntensity * 1000));
+  logFlush(Serial);
+}
@@ -0,0 +1,118 @@
+/*
+Decoder for the frames of the Plantower PMS particulate sensors.
+See PMS.h for the frame layout.
+*/
+
+#include "PMS.h"
+
+PMSDecoder::PMSDecoder(){
+  position = 0;
+  frameLength = 0;
+  rejectedLength = 0;
+  sum = 0;
+  badFrames = 0;
+  memset(&latest, 0, sizeof(latest));
+}
+
+/*
+Takes the next byte from the sensor.
+Returns true when it completes a frame with a valid checksum, which data() then holds.
+*/
+bool PMSDecoder::feed(uint8_t c){
+  int8_t result = step(c);
+  if (result < 0){
+    // a frame cut short swallows the start of the next one, so look for it in the rejected bytes.
+    // A second rejection among them is dropped, two broken frames in a row only cost one more frame.
+    uint8_t rejected[PMS_MAX_FRAME_LENGTH];
+    uint8_t count = rejectedLength - 1;
+    memcpy(rejected, frame + 1, count);
+    result = 0;
+    for (uint8_t i = 0; i < count; i++){
+      if (step(rejected[i]) > 0){
+        result = 1;
+      }
+    }
+  }
+  return result > 0;
+}
+
+// helper function to advance the state machine, 1 for a valid frame, -1 for rejected bytes
+int8_t PMSDecoder::step(uint8_t c){
+  if (position == 0){
+    if (c != PMS_HEADER_1){
+      return 0;
+    }
+    sum = 0;
+  }
+  else if (position == 1 && c != PMS_HEADER_2){
+    // a repeated first header byte may still start the frame
+    position = (c == PMS_HEADER_1) ? 1 : 0;
+    return 0;
+  }
+
+  // the checksum covers everything up to its own two bytes
+  frame[position] = c;
+  if (position < 4 || position < frameLength - 2){
+    sum += c;
+  }
+  position++;
+
+  if (position == 4){
+    uint16_t length = ((uint16_t)frame[2] << 8) | frame[3];
+    // at least the three mass concentrations and the checksum
+    if (length < 8 || length > PMS_MAX_FRAME_LENGTH - 4 || length % 2 != 0){
+      return reject();
+    }
+    frameLength = length + 4;
+  }
+  else if (position > 4 && position == frameLength){
+    uint16_t checksum = ((uint16_t)frame[frameLength - 2] << 8) | frame[frameLength - 1];
+    if (checksum != sum){
+      return reject();
+    }
+    position = 0;
+    decode();
+    return 1;
+  }
+  return 0;
+}
+
+// helper function to drop the frame being read, keeping its bytes for feed() to search
+int8_t PMSDecoder::reject(){
+  badFrames++;
+  rejectedLength = position;
+  position = 0;
+  return -1;
+}
+
+uint16_t PMSDecoder::word(uint8_t index) const{
+  return ((uint16_t)frame[4 + index * 2] << 8) | frame[5 + index * 2];
+}
+
+// helper function to copy the fields of a validated frame, the counts only when it has them
+void PMSDecoder::decode(){
+  uint8_t words = (frameLength - 6) / 2;
+  memset(&latest, 0, sizeof(latest));
+  latest.pm1Standard = word(0);
+  latest.pm2_5Standard = word(1);
+  latest.pm10Standard = word(2);
+  if (words >= 6){
+    latest.pm1 = word(3);
+    latest.pm2_5 = word(4);
+    latest.pm10 = word(5);
+  }
+  if (words >= 6 + PMS_PARTICLE_SIZES){
+    for (uint8_t i = 0; i < PMS_PARTICLE_SIZES; i++){
+      latest.particles[i] = word(6 + i);
+    }
+  }
+}
+
+const PMSData& PMSDecoder::data() const{
+  return latest;
+}
+
+// frames dropped for a bad length or checksum since startup
+uint16_t PMSDecoder::errors() const{
+  return badFrames;
+}
@@ -0,0 +1,67 @@
+/*
+Decoder for the frames of the Plantower PMS particulate sensors.
+
+In active mode the sensor sends a frame about once a second:
+	[0..2)     0x42 0x4D
+	[2..4)     frame length, the data words plus the checksum
+	[4..)      data words, big endian
+	[last 2]   checksum, the sum of every byte before it
+
+The PMS5003 and PMS7003 send 13 data words:
+	PM1.0, PM2.5 and PM10 in ug/m3 with CF=1 (standard particle)
+	PM1.0, PM2.5 and PM10 in ug/m3 under atmospheric environment
+	particles above 0.3, 0.5, 1.0, 2.5, 5.0 and 10 um per 0.1 L of air
+	reserved
+The PMS3003 sends 9 words, only the mass concentrations, and leaves the counts zero.
+
+feed() takes one byte at a time, so loop() can hand it whatever the serial
+port has buffered and never wait for a whole frame. It resynchronizes on the
+header after noise, a short read or a frame with a bad checksum.
+
+Feed it from a hardware UART. SoftwareSerial receives with interrupts off for
+a whole byte, which would hold off the I2C interrupt of the module for about
+33 ms per frame at 9600 baud.
+*/
+
+#ifndef PMS_h
+#define PMS_h
+
+#include <Arduino.h>
+
+#define PMS_HEADER_1 0x42
+#define PMS_HEADER_2 0x4D
+#define PMS_MAX_FRAME_LENGTH 32   // the longest frame of the supported sensors, header included
+#define PMS_PARTICLE_SIZES 6
+
+struct PMSData {
+	uint16_t pm1Standard;        // CF=1
+	uint16_t pm2_5Standard;
+	uint16_t pm10Standard;
+	uint16_t pm1;                // atmospheric environment
+	uint16_t pm2_5;
+	uint16_t pm10;
+	uint16_t particles[PMS_PARTICLE_SIZES]; // above 0.3, 0.5, 1.0, 2.5, 5.0 and 10 um
+};
+
+class PMSDecoder {
+	private:
+		uint8_t frame[PMS_MAX_FRAME_LENGTH];
+		uint8_t position;
+		uint8_t frameLength;   // bytes of the whole frame being read
+		uint16_t sum;          // running checksum of the bytes read so far
+		uint8_t rejectedLength;
+		uint16_t badFrames;
+		PMSData latest;
+
+		int8_t step(uint8_t c);
+		int8_t reject();
+		uint16_t word(uint8_t index) const;
+		void decode();
+	public:
+		PMSDecoder();
+		bool feed(uint8_t c);
+		const PMSData& data() const;
+		uint16_t errors() const;
+};
+
+#endif
@@ -2,53 +2,65 @@
 #include <SoftwareSerial.h>
 #include <Wire.h>
 #include "protocol.h"
+#include "SensorReply.h"
+#include "Log.h"
+#include "PMS.h"
 
 byte SELF_ADDR = SENSOR_PM25;
-byte transmissionCounter = 0; // counter for what string to send
+SensorReply reply; // pre-serialized reply served to the main module
 
-SoftwareSerial mySerial(2,3); // RX, TX
-unsigned int pm1 = 0;
-unsigned int pm2_5 = 0;
-unsigned int pm10 = 0;
+#define FIRMWARE_VERSION 1 // reported in the module descriptor
+
+// The PMS is read on the hardware UART (sensor TX to D0). SoftwareSerial receives every
+// byte with interrupts off, about 1 ms at 9600 baud, which would hold the I2C interrupt off for
+// the length of a frame. The log goes out on a TX-only software port instead (D3), whose
+// bytes are short at its higher rate and sent only as loop() allows.
+// Unplug the sensor TX from D0 while uploading, it shares the line with the bootloader.
+#define PMS_BAUD 9600
+#define LOG_BAUD 57600
+#define LOG_BYTES_PER_LOOP 8 // log bytes sent per pass, each holds interrupts off for about 170 us
+SoftwareSerial logSerial(2, 3); // RX unused, TX
+PMSDecoder pms;
+bool unpublished = false; // a decoded frame is waiting for the reply buffer
+
+// -------------- Utility Functions -------------- //
+
+// encode the latest frame into the reply served to the main module.
+// Returns false if a reply in progress holds the back buffer, the frame is then published on a later try.
+bool publishReading() {
+  if (!reply.begin()) {
+    return false;
+  }
+  const PMSData& data = pms.data();
+  reply.add(CHANNEL_PM1, UNIT_UG_PER_M3, data.pm1Standard, 0);
+  reply.add(CHANNEL_PM2_5, UNIT_UG_PER_M3, data.pm2_5Standard, 0);
+  reply.add(CHANNEL_PM10, UNIT_UG_PER_M3, data.pm10Standard, 0);
+  for (uint8_t i = 0; i < PMS_PARTICLE_SIZES; i++) {
+    reply.add(CHANNEL_PARTICLES_0_3 + i, UNIT_PER_DECILITRE, data.particles[i], 0);
+  }
+  reply.publish();
+  return true;
+}
 
 // -------------- Protocol Function -------------- //
 // This function will be called when a request on I2C has been made
 // to this module. The main module will continue requesting until
-// the character CH_TERMINATE ('!') is recieved
+// the character CH_TERMINATE ('!') is recieved, or the whole binary
+// frame has been read if it wrote CMD_READ_FRAME beforehand.
+// It runs in interrupt context, so it only copies out the reply
+// that loop() last published.
 
 void sendData() {
-  char replyData[MAX_SENSOR_REPLY_LENGTH];
-  String reply = "";
+  reply.send();
+}
 
-  switch(transmissionCounter) {
-  case 0:
-    reply = CH_IS_KEY + String("pm1") + CH_MORE;
-    transmissionCounter++;
-    break;
-  case 1:
-    reply = CH_IS_VALUE + String(pm1) + " μg/m^3" + CH_MORE;
-    transmissionCounter++;
-    break;
-  case 2:
-    reply = CH_IS_KEY + String("pm2_5") + CH_MORE;
-    transmissionCounter++;
-    break;
-  case 3:
-    reply = CH_IS_VALUE + String(pm2_5) + " μg/m^3" + CH_MORE;
-    transmissionCounter++;
-    break;
-  case 4:
-    reply = CH_IS_KEY + String("pm10") + CH_MORE;
-    transmissionCounter++;
-    break;
-  case 5:
-    reply = CH_IS_VALUE + String(pm10) + " μg/m^3" + CH_TERMINATE;
-    transmissionCounter = 0;
-    break;
+// This function will be called when the main module writes a command
+// to this module before requesting data.
+
+void receiveCommand(int count) {
+  while (Wire.available()) {
+    reply.command(Wire.read());
   }
-  reply.toCharArray(replyData, MAX_SENSOR_REPLY_LENGTH);
-  Serial.println("Sent " + reply);
-  Wire.write(replyData); // send string on request
 }
 
 // -------------- Arduino framework main code -------------- //
@@ -56,50 +68,33 @@ void sendData() {
 void setup() {
   Wire.begin(SELF_ADDR);
   Wire.onRequest(sendData);
-  Serial.begin(9600);
-  while (!Serial);
-  mySerial.begin(9600);
+  Wire.onReceive(receiveCommand);
+  reply.setTiming(1000, 1000); // the PMS sensor reports about once a second
+  // the PMS sends whole numbers of 16 bits
+  reply.describe(MODULE_AIR_QUALITY, FIRMWARE_VERSION);
+  reply.describeChannel(CHANNEL_PM1, UNIT_UG_PER_M3, VALUE_UINT16, 0);
+  reply.describeChannel(CHANNEL_PM2_5, UNIT_UG_PER_M3, VALUE_UINT16, 0);
+  reply.describeChannel(CHANNEL_PM10, UNIT_UG_PER_M3, VALUE_UINT16, 0);
+  for (uint8_t i = 0; i < PMS_PARTICLE_SIZES; i++) {
+    reply.describeChannel(CHANNEL_PARTICLES_0_3 + i, UNIT_PER_DECILITRE, VALUE_UINT16, 0);
+  }
+  Serial.begin(PMS_BAUD);
+  logSerial.begin(LOG_BAUD);
+  logSerial.stopListening(); // transmit only, no pin change interrupt on the RX pin
 }
 
 void loop() {
-  int index = 0;
-  char value;
-  char previousValue;
-  
-  while (mySerial.available()) {
-    value = mySerial.read();
-    if ((index == 0 && value != 0x42) || (index == 1 && value != 0x4d)){
-    Serial.println("Cannot find the data header.");
-    break;
-    }
-
-    if (index == 4 || index == 6 || index == 8 || index == 10 || index == 12 || index == 14) {
-      previousValue = value;
-    } else if (index == 5) {
-      pm1 = 256 * previousValue + value;
-      Serial.print("{ ");
-      Serial.print("\"pm1\": ");
-      Serial.print(pm1);
-      Serial.print(" ug/m3");
-      Serial.print(", ");
-    } else if (index == 7) {
-      pm2_5 = 256 * previousValue + value;
-      Serial.print("\"pm2_5\": ");
-      Serial.print(pm2_5);
-      Serial.print(" ug/m3");
-      Serial.print(", ");
-    } else if (index == 9) {
-      pm10 = 256 * previousValue + value;
-      Serial.print("\"pm10\": ");
-      Serial.print(pm10);
-      Serial.print(" ug/m3");
-    } else if (index > 15) {
-      break;
+  // take whatever the sensor has sent so far, a frame may span several passes
+  while (Serial.available()) {
+    if (pms.feed(Serial.read())) {
+      const PMSData& data = pms.data();
+      LOG_DEBUG("pm %u %u %u atm %u %u %u", data.pm1Standard, data.pm2_5Standard,
+                data.pm10Standard, data.pm1, data.pm2_5, data.pm10);
+      unpublished = true;
     }
-    index++;
   }
-  
-  while(mySerial.available()) mySerial.read();
-  Serial.println(" }");
-  delay(1000);
-}
\ No newline at end of file
+  if (unpublished && publishReading()) {
+    unpublished = false;
+  }
+  logFlush(logSerial, LOG_BYTES_PER_LOOP);
+}
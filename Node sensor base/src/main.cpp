@@ -1,39 +1,49 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include "protocol.h"
+#include "SensorReply.h"
+#include "Log.h"
 
 byte SELF_ADDR = 126; // test value (1 below top addr)
-byte transmissionCounter = 0; // counter for what string to send
+SensorReply reply; // pre-serialized reply served to the main module
+
+#define FIRMWARE_VERSION 1 // reported in the module descriptor
 
 // -------------- Utility Functions -------------- //
 // Good idea to define any utlity funcitions for dealing with sensors here.
 
+// encode the latest readings into the reply served to the main module
+void publishReading()
+{
+  if (reply.begin())
+  {
+    reply.add(CHANNEL_TEST, UNIT_NONE, 0);
+    reply.publish();
+  }
+}
+
 // -------------- Protocol Function -------------- //
 // This function will be called when a request on I2C has been made
 // to this module. The main module will continue requesting until
-// the character CH_TERMINATE ('!') is recieved
+// the character CH_TERMINATE ('!') is recieved, or the whole binary
+// frame has been read if it wrote CMD_READ_FRAME beforehand.
+// It runs in interrupt context, so it only copies out the reply
+// that loop() last published.
 
 void sendData()
 {
-  char replyData[MAX_SENSOR_REPLY_LENGTH];
-  String reply = "";
-
-  switch(transmissionCounter) {
-  case 0:
-    reply = CH_IS_KEY + String("test_key") + CH_MORE;
-    // ALWAYS set to the next part of transmission
-    transmissionCounter++;
-    break;
-  
-  case 1:
-    reply = CH_IS_VALUE + String("test_value") + CH_TERMINATE;
-    // ALWAYS set counter to 0 when done sending everything
-    transmissionCounter = 0;
-    break;
+  reply.send();
+}
+
+// This function will be called when the main module writes a command
+// to this module before requesting data.
+
+void receiveCommand(int count)
+{
+  while (Wire.available())
+  {
+    reply.command(Wire.read());
   }
-  reply.toCharArray(replyData, MAX_SENSOR_REPLY_LENGTH);
-  Serial.println("Sent " + reply);
-  Wire.write(replyData); // send string on request
 }
 
 // -------------- Arduino framework main code -------------- //
@@ -42,10 +52,17 @@ void setup()
 {
   Wire.begin(SELF_ADDR);          // join i2c bus with defined address
   Wire.onRequest(sendData);       // register request event
+  Wire.onReceive(receiveCommand); // register command event
+  reply.setTiming(0, 60000);      // nothing to sample, once a minute is plenty
+  reply.describe(MODULE_BASE, FIRMWARE_VERSION);
+  reply.describeChannel(CHANNEL_TEST, UNIT_NONE, VALUE_INT16, 0);
   Serial.begin(9600);             // start serial for debug
+  publishReading();               // the test reading never changes
+  LOG_INFO("Base module started at 0x%02X.", SELF_ADDR);
 }
 
 void loop()
 {
+  logFlush(Serial);
   delay(100); // loop forever, waiting for commands
 }
\ No newline at end of file
@@ -0,0 +1,157 @@
+/*
+Interrupt driven driver for the DHT22 (AM2302) temperature and humidity sensor.
+See DHT22.h for how the start signal and the bits are timed.
+*/
+
+#include "DHT22.h"
+
+enum CaptureState : uint8_t {
+  STATE_IDLE = 0,
+  STATE_START,     // data line held low
+  STATE_CAPTURE,   // timestamping the sensor's edges
+  STATE_DONE       // waiting for available()
+};
+
+// shared with the interrupt handlers, there is only one sensor per module
+static uint8_t dataPin;
+static volatile uint8_t state = STATE_IDLE;
+static volatile DHT22Result lastResult = DHT22_BUSY;
+static volatile uint8_t edges;
+static volatile uint16_t lastEdge;
+static volatile uint8_t bits[5];
+static uint8_t reading[5];   // bits of the last good measurement
+
+// helper function to stop the timer and the edge interrupt once a measurement is over
+static void finish(DHT22Result result)
+{
+  detachInterrupt(digitalPinToInterrupt(dataPin));
+  TIMSK1 &= ~_BV(OCIE1A);
+  TCCR1B = 0;
+  lastResult = result;
+  state = STATE_DONE;
+}
+
+// falling edge on the data line, the time since the previous one is the bit that just ended
+static void onEdge()
+{
+  uint16_t now = TCNT1;
+  uint8_t edge = edges;
+  if (edge >= 2)
+  {
+    uint8_t bit = edge - 2;
+    bits[bit >> 3] = (bits[bit >> 3] << 1) | ((uint16_t)(now - lastEdge) > DHT22_ONE_TICKS ? 1 : 0);
+  }
+  lastEdge = now;
+  edges = ++edge;
+
+  if (edge == DHT22_EDGES)
+  {
+    bool valid = bits[4] == (uint8_t)(bits[0] + bits[1] + bits[2] + bits[3]);
+    finish(valid ? DHT22_OK : DHT22_CHECKSUM);
+  }
+}
+
+// Timer1 compare, either the start signal is over or the sensor took too long
+ISR(TIMER1_COMPA_vect)
+{
+  if (state == STATE_START)
+  {
+    // release the line, the pull-up raises it and the sensor answers within 40 us
+    pinMode(dataPin, INPUT_PULLUP);
+    edges = 0;
+    EIFR = _BV(digitalPinToInterrupt(dataPin)); // forget the edge of our own start signal
+    attachInterrupt(digitalPinToInterrupt(dataPin), onEdge, FALLING);
+    state = STATE_CAPTURE;
+    OCR1A = TCNT1 + DHT22_CAPTURE_TICKS;
+  }
+  else
+  {
+    finish(DHT22_TIMEOUT);
+  }
+}
+
+DHT22::DHT22(uint8_t pin)
+{
+  this->pin = pin;
+  lastStart = 0;
+}
+
+void DHT22::begin()
+{
+  dataPin = pin;
+  pinMode(pin, INPUT_PULLUP);
+  // the sensor needs a moment after power up, so the first measurement waits a full interval
+  lastStart = millis();
+}
+
+/*
+Starts a measurement, the start signal is timed by Timer1 so this returns at once.
+Returns false if one is still running or the last started less than DHT22_MIN_INTERVAL ago.
+*/
+bool DHT22::start()
+{
+  if (state == STATE_START || state == STATE_CAPTURE || millis() - lastStart < DHT22_MIN_INTERVAL)
+  {
+    return false;
+  }
+  lastStart = millis();
+  lastResult = DHT22_BUSY;
+  state = STATE_START;
+
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, LOW);
+
+  // Timer1 in normal mode at 0.5 us per tick, one compare interrupt per phase
+  TCCR1A = 0;
+  TCCR1B = 0;
+  TCNT1 = 0;
+  OCR1A = DHT22_START_TICKS;
+  TIFR1 = _BV(OCF1A);
+  TIMSK1 |= _BV(OCIE1A);
+  TCCR1B = _BV(CS11);
+  return true;
+}
+
+bool DHT22::busy() const
+{
+  return state == STATE_START || state == STATE_CAPTURE;
+}
+
+/*
+True once after each measurement ends, result() then tells whether it succeeded.
+A good measurement replaces the values temperature() and humidity() return.
+*/
+bool DHT22::available()
+{
+  if (state != STATE_DONE)
+  {
+    return false;
+  }
+  if (lastResult == DHT22_OK)
+  {
+    for (uint8_t i = 0; i < 5; i++)
+    {
+      reading[i] = bits[i];
+    }
+  }
+  state = STATE_IDLE;
+  return true;
+}
+
+DHT22Result DHT22::result() const
+{
+  return lastResult;
+}
+
+// degrees Celsius of the last good measurement
+float DHT22::temperature() const
+{
+  float value = (((uint16_t)(reading[2] & 0x7F)) << 8 | reading[3]) * 0.1;
+  return (reading[2] & 0x80) ? -value : value;
+}
+
+// relative humidity in percent of the last good measurement
+float DHT22::humidity() const
+{
+  return (((uint16_t)reading[0]) << 8 | reading[1]) * 0.1;
+}
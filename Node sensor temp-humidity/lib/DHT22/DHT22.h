@@ -0,0 +1,64 @@
+/*
+Interrupt driven driver for the DHT22 (AM2302) temperature and humidity sensor.
+
+Datasheet : https://www.sparkfun.com/datasheets/Sensors/Temperature/DHT22.pdf
+
+A measurement runs in the background without masking interrupts, so the module
+keeps answering I2C requests while the sensor sends its 40 bits:
+	Timer1 times the start signal, the data line is held low for 1.1 ms and then released.
+	The external interrupt of the data pin timestamps every falling edge against Timer1.
+	The time between two falling edges is a 50 us low pulse plus a high pulse of
+	26-28 us for a 0 or 70 us for a 1, so each bit is decided as its edge arrives.
+	Timer1 also ends a measurement the sensor never finishes.
+
+Uses Timer1 and the external interrupt of the data pin, so the data line must be
+on pin 2 or 3 of the ATmega328P and only one sensor can be driven.
+
+Usage:
+	DHT22 dht(2);
+
+	dht.begin();                    // setup()
+
+	dht.start();                    // loop(), refused while busy or within 2 s of the last one
+	if (dht.available()) {
+		if (dht.result() == DHT22_OK) {
+			temperature = dht.temperature();
+			humidity = dht.humidity();
+		}
+	}
+*/
+
+#ifndef DHT22_h
+#define DHT22_h
+
+#include <Arduino.h>
+
+#define DHT22_MIN_INTERVAL 2000     // ms, the sensor cannot be read more often
+#define DHT22_START_TICKS 2200      // Timer1 ticks of 0.5 us, the 1.1 ms start signal
+#define DHT22_CAPTURE_TICKS 12000   // 6 ms for the response and 40 bits, about 5 ms when all bits are 1
+#define DHT22_ONE_TICKS 200         // edges further apart than 100 us carry a 1
+#define DHT22_EDGES 42              // response, 40 bits and the final low pulse
+
+enum DHT22Result : uint8_t {
+	DHT22_BUSY = 0,
+	DHT22_OK,
+	DHT22_TIMEOUT,    // the sensor did not answer or stopped sending
+	DHT22_CHECKSUM
+};
+
+class DHT22 {
+	private:
+		uint8_t pin;
+		uint32_t lastStart;
+	public:
+		DHT22(uint8_t pin);
+		void begin();
+		bool start();
+		bool busy() const;
+		bool available();
+		DHT22Result result() const;
+		float temperature() const;
+		float humidity() const;
+};
+
+#endif
@@ -1,46 +1,58 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include "protocol.h"
+#include "SensorReply.h"
+#include "Log.h"
 
-#include "DHT.h"
+#include "DHT22.h"
 
 byte SELF_ADDR = SENSOR_TEMP_HUM;
-byte transmissionCounter = 0; // counter for what string to send
+SensorReply reply; // pre-serialized reply served to the main module
 
-DHT dht(PIND2,DHT22);
+#define FIRMWARE_VERSION 1 // reported in the module descriptor
+
+DHT22 dht(2); // data line on INT0
 float humidity = 0.0, temperature = 0.0;
+bool unpublished = false; // a measurement is waiting for the reply buffer
+
+// -------------- Utility Functions -------------- //
+
+// encode the latest readings into the reply served to the main module.
+// Returns false if a reply in progress holds the back buffer, the readings are then published on a later try.
+bool publishReading()
+{
+  if (!reply.begin())
+  {
+    return false;
+  }
+  reply.add(CHANNEL_TEMPERATURE, UNIT_CELSIUS, temperature);
+  reply.add(CHANNEL_HUMIDITY, UNIT_PERCENT, humidity);
+  reply.publish();
+  return true;
+}
 
 // -------------- Protocol Function -------------- //
 // This function will be called when a request on I2C has been made
 // to this module. The main module will continue requesting until
-// the character CH_TERMINATE ('!') is recieved
+// the character CH_TERMINATE ('!') is recieved, or the whole binary
+// frame has been read if it wrote CMD_READ_FRAME beforehand.
+// It runs in interrupt context, so it only copies out the reply
+// that loop() last published.
 
 void sendData()
 {
-  char replyData[MAX_SENSOR_REPLY_LENGTH];
-  String reply = "";
-
-  switch(transmissionCounter) {
-  case 0:
-    reply = CH_IS_KEY + String("temperature") + CH_MORE;
-    transmissionCounter++;
-    break;
-  case 1:
-    reply = CH_IS_VALUE + String(temperature) + " c" + CH_MORE;
-    transmissionCounter++;
-    break;
-  case 2:
-    reply = CH_IS_KEY + String("humidity") + CH_MORE;
-    transmissionCounter++;
-    break;
-  case 3:
-    reply = CH_IS_VALUE + String(humidity) + " %" + CH_TERMINATE;
-    transmissionCounter = 0;
-    break;
+  reply.send();
+}
+
+// This function will be called when the main module writes a command
+// to this module before requesting data.
+
+void receiveCommand(int count)
+{
+  while (Wire.available())
+  {
+    reply.command(Wire.read());
   }
-  reply.toCharArray(replyData, MAX_SENSOR_REPLY_LENGTH);
-  Serial.println("Sent " + reply);
-  Wire.write(replyData); // send string on request
 }
 
 // -------------- Arduino framework main code -------------- //
@@ -50,14 +62,36 @@ void setup()
   dht.begin();
   Wire.begin(SELF_ADDR);          // join i2c bus with defined address
   Wire.onRequest(sendData);       // register request event
+  Wire.onReceive(receiveCommand); // register command event
+  reply.setTiming(2000, 2000);    // the DHT22 cannot be read more often than every 2 seconds
+  reply.describe(MODULE_TEMP_HUMIDITY, FIRMWARE_VERSION);
+  reply.describeChannel(CHANNEL_TEMPERATURE, UNIT_CELSIUS, VALUE_INT16, 1); // the DHT22 resolves 0.1
+  reply.describeChannel(CHANNEL_HUMIDITY, UNIT_PERCENT, VALUE_UINT16, 1);
   Serial.begin(9600);             // start serial for debug
-  Serial.println("Temperature/Humidity module started.");
+  LOG_INFO("Temperature/Humidity module started.");
 }
 
 void loop()
 {
-  delay(1000);
-  humidity = dht.readHumidity();
-  delay(100);
-  temperature = dht.readTemperature();
+  // measurements run in the background, this only picks up the finished ones
+  if (dht.available())
+  {
+    if (dht.result() == DHT22_OK)
+    {
+      temperature = dht.temperature();
+      humidity = dht.humidity();
+      unpublished = true;
+      LOG_DEBUG("%d dC, %d d%%", (int)(temperature * 10), (int)(humidity * 10)); // tenths, AVR printf has no %f
+    }
+    else
+    {
+      LOG_WARN("DHT22 measurement failed (%d).", dht.result());
+    }
+  }
+  dht.start(); // refused until the sensor may be read again
+  if (unpublished && publishReading())
+  {
+    unpublished = false;
+  }
+  logFlush(Serial);
 }
\ No newline at end of file
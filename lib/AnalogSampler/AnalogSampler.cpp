@@ -0,0 +1,131 @@
+/*
+Background ADC sampling for the analog sensor modules (ATmega328P).
+See AnalogSampler.h for the filter pipeline.
+*/
+
+#include <util/atomic.h>
+#include "AnalogSampler.h"
+
+AnalogSampler analogSampler;
+
+AnalogSampler::AnalogSampler(){
+  channelCount = 0;
+  current = 0;
+}
+
+/*
+Adds an analog pin, returns the channel to read it with.
+oversampleBits : 4^n samples make one value of 10 + n bits, 0 to ANALOG_MAX_OVERSAMPLE_BITS
+medianWindow : 1 for none, 3 or 5
+emaShift : weight of a new value is 1 / 2^k, 0 for none
+*/
+uint8_t AnalogSampler::add(uint8_t pin, uint8_t oversampleBits, uint8_t medianWindow, uint8_t emaShift){
+  if (channelCount >= ANALOG_MAX_CHANNELS){
+    return channelCount - 1;
+  }
+  Channel& channel = channels[channelCount];
+  memset(&channel, 0, sizeof(channel));
+  uint8_t input = (pin >= A0) ? pin - A0 : pin;
+  channel.mux = _BV(REFS0) | (input & 0x07);   // AVcc reference
+  channel.oversampleBits = min(oversampleBits, (uint8_t)ANALOG_MAX_OVERSAMPLE_BITS);
+  channel.medianWindow = min(max(medianWindow, (uint8_t)1), (uint8_t)ANALOG_MAX_MEDIAN);
+  channel.emaShift = emaShift;
+  DIDR0 |= _BV(input & 0x07);                   // the digital input buffer only adds noise
+  return channelCount++;
+}
+
+/*
+Hands the ADC to the sampler, conversions then run until the module is reset.
+*/
+void AnalogSampler::begin(){
+  if (channelCount == 0){
+    return;
+  }
+  current = 0;
+  ADMUX = channels[0].mux;
+  ADCSRB = _BV(ADTS2);                            // triggered by Timer0 overflow
+  // 125 kHz ADC clock, a conversion takes 104 us of the 1 ms between triggers
+  ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+
+bool AnalogSampler::ready(uint8_t channel) const{
+  return channel < channelCount && channels[channel].ready;
+}
+
+// newest filtered value, 0 until ready()
+uint16_t AnalogSampler::read(uint8_t channel) const{
+  if (channel >= channelCount){
+    return 0;
+  }
+  uint16_t value;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+    value = channels[channel].value;
+  }
+  return value;
+}
+
+// the value a channel reads at the reference voltage
+uint16_t AnalogSampler::fullScale(uint8_t channel) const{
+  if (channel >= channelCount){
+    return 1023;
+  }
+  return 1023 << channels[channel].oversampleBits;
+}
+
+// helper function to take the median of the last values without disturbing their order
+uint16_t AnalogSampler::median(const Channel &channel) const{
+  uint16_t sorted[ANALOG_MAX_MEDIAN];
+  uint8_t count = channel.historyCount;
+  for (uint8_t i = 0; i < count; i++){
+    uint16_t value = channel.history[i];
+    uint8_t j = i;
+    while (j > 0 && sorted[j - 1] > value){
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = value;
+  }
+  return sorted[count / 2];
+}
+
+// helper function to run a decimated value through the median and the EMA
+void AnalogSampler::filter(Channel &channel, uint16_t decimated){
+  channel.history[channel.historyNext] = decimated;
+  channel.historyNext = (channel.historyNext + 1) % channel.medianWindow;
+  if (channel.historyCount < channel.medianWindow){
+    channel.historyCount++;
+  }
+  uint16_t filtered = median(channel);
+
+  if (!channel.ready){
+    // start the average at the first value instead of climbing up from 0
+    channel.ema = (uint32_t)filtered << channel.emaShift;
+  }
+  else{
+    channel.ema = channel.ema - (channel.ema >> channel.emaShift) + filtered;
+  }
+  channel.value = channel.ema >> channel.emaShift;
+  channel.ready = true;
+}
+
+/*
+Takes the conversion of the current channel and moves the ADC on to the next one.
+The next trigger is a millisecond away, so the multiplexer has settled by then.
+*/
+void AnalogSampler::convert(uint16_t sample){
+  Channel& channel = channels[current];
+  channel.sum += sample;
+  if (++channel.count >= (1 << (2 * channel.oversampleBits))){
+    uint16_t decimated = channel.sum >> channel.oversampleBits;
+    channel.sum = 0;
+    channel.count = 0;
+    filter(channel, decimated);
+  }
+
+  current = (current + 1) % channelCount;
+  ADMUX = channels[current].mux;
+}
+
+ISR(ADC_vect){
+  analogSampler.convert(ADC);
+}
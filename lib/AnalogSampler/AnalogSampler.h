@@ -0,0 +1,71 @@
+/*
+Background ADC sampling for the analog sensor modules (ATmega328P).
+
+Conversions are started by the hardware on every Timer0 overflow, the tick
+millis() already counts, so about 976 samples per second are shared round robin
+between the added channels without a timer of our own and without the CPU
+waiting for a conversion. The ADC interrupt runs every sample through the
+channel's pipeline, all in integer arithmetic:
+	oversampling   4^n samples are summed and decimated to 10 + n bits
+	median         a median of the last 3 or 5 decimated values drops spikes
+	EMA            value += (sample - value) / 2^k smooths what remains
+read() returns the newest filtered value at once, so loop() can publish it
+whenever it likes and the I2C handler keeps serving the published reply.
+
+Once begin() is called the ADC belongs to the sampler, analogRead() must not be used.
+
+Usage:
+	uint8_t uvChannel = analogSampler.add(A0);        // setup(), before begin()
+	uint8_t refChannel = analogSampler.add(A1, 2, 3, 3);
+	analogSampler.begin();
+
+	if (analogSampler.ready(uvChannel)) {             // loop()
+		uint16_t uv = analogSampler.read(uvChannel);  // 0 .. analogSampler.fullScale(uvChannel)
+	}
+*/
+
+#ifndef AnalogSampler_h
+#define AnalogSampler_h
+
+#include <Arduino.h>
+
+#define ANALOG_MAX_CHANNELS 4
+#define ANALOG_MAX_OVERSAMPLE_BITS 3   // 64 samples per value, 13 bits
+#define ANALOG_MAX_MEDIAN 5
+
+class AnalogSampler {
+	private:
+		struct Channel {
+			uint8_t mux;             // ADMUX input selection
+			uint8_t oversampleBits;
+			uint8_t medianWindow;
+			uint8_t emaShift;
+			uint8_t count;           // samples summed so far
+			uint16_t sum;
+			uint16_t history[ANALOG_MAX_MEDIAN];
+			uint8_t historyCount;
+			uint8_t historyNext;
+			uint32_t ema;            // filtered value << emaShift
+			volatile uint16_t value;
+			volatile bool ready;
+		};
+
+		Channel channels[ANALOG_MAX_CHANNELS];
+		uint8_t channelCount;
+		volatile uint8_t current;
+
+		uint16_t median(const Channel &channel) const;
+		void filter(Channel &channel, uint16_t decimated);
+	public:
+		AnalogSampler();
+		uint8_t add(uint8_t pin, uint8_t oversampleBits = 2, uint8_t medianWindow = 3, uint8_t emaShift = 3);
+		void begin();
+		bool ready(uint8_t channel) const;
+		uint16_t read(uint8_t channel) const;
+		uint16_t fullScale(uint8_t channel) const;
+		void convert(uint16_t sample);   // called by the ADC interrupt
+};
+
+extern AnalogSampler analogSampler;
+
+#endif
@@ -0,0 +1,172 @@
+/*
+Logging shared by the main module and the sensor modules.
+See Log.h for the levels and how the ring buffer is drained.
+*/
+
+#include <stdarg.h>
+#include "Log.h"
+
+#if (LOG_BUFFER_LENGTH & (LOG_BUFFER_LENGTH - 1)) != 0
+#error "LOG_BUFFER_LENGTH must be a power of two"
+#endif
+
+#define LOG_FLUSH_CHUNK 64 // bytes copied out of the ring per write to the port
+
+// helper functions to keep the ring consistent against interrupts and other tasks
+#if defined(__AVR__)
+static inline uint8_t logLock()
+{
+  uint8_t state = SREG;
+  cli();
+  return state;
+}
+static inline void logUnlock(uint8_t state) { SREG = state; }
+#elif defined(ESP32)
+static portMUX_TYPE logMux = portMUX_INITIALIZER_UNLOCKED;
+static inline uint8_t logLock()
+{
+  portENTER_CRITICAL_SAFE(&logMux);
+  return 0;
+}
+static inline void logUnlock(uint8_t state) { portEXIT_CRITICAL_SAFE(&logMux); }
+#else
+static inline uint8_t logLock() { return 0; } // host builds log from a single thread
+static inline void logUnlock(uint8_t state) {}
+#endif
+
+// head and tail count bytes ever written and flushed, their difference is what
+// still waits for the port. Both wrap, which is fine as the length divides the range.
+static char ring[LOG_BUFFER_LENGTH];
+static size_t head = 0;
+static size_t tail = 0;
+static size_t stored = 0;  // bytes of history, up to the buffer length
+static unsigned long dropped = 0;
+
+void logPrintf(char level, const char *format, ...)
+{
+  char line[LOG_LINE_LENGTH];
+  int length = snprintf(line, sizeof(line), "%lu %c ", (unsigned long)millis(), level);
+
+  va_list args;
+  va_start(args, format);
+#if defined(__AVR__)
+  vsnprintf_P(line + length, sizeof(line) - length, format, args);
+#else
+  vsnprintf(line + length, sizeof(line) - length, format, args);
+#endif
+  va_end(args);
+
+  // a line cut short still ends with a newline
+  length = strlen(line);
+  if (length > (int)sizeof(line) - 2)
+  {
+    length = sizeof(line) - 2;
+  }
+  line[length++] = '\n';
+
+  uint8_t state = logLock();
+  for (int i = 0; i < length; i++)
+  {
+    ring[head++ & (LOG_BUFFER_LENGTH - 1)] = line[i];
+  }
+  stored = stored + length < LOG_BUFFER_LENGTH ? stored + length : LOG_BUFFER_LENGTH;
+  if (head - tail > LOG_BUFFER_LENGTH)
+  {
+    dropped += head - tail - LOG_BUFFER_LENGTH;
+    tail = head - LOG_BUFFER_LENGTH;
+  }
+  logUnlock(state);
+}
+
+// helper function moving up to room bytes out of the ring into chunk, returns how many
+static size_t logTake(char *chunk, size_t room)
+{
+  uint8_t state = logLock();
+  size_t count = head - tail;
+  if (count > room)
+  {
+    count = room;
+  }
+  if (count > LOG_FLUSH_CHUNK)
+  {
+    count = LOG_FLUSH_CHUNK;
+  }
+  for (size_t i = 0; i < count; i++)
+  {
+    chunk[i] = ring[(tail + i) & (LOG_BUFFER_LENGTH - 1)];
+  }
+  tail += count;
+  logUnlock(state);
+  return count;
+}
+
+void logFlush(HardwareSerial &port)
+{
+  char chunk[LOG_FLUSH_CHUNK];
+  for (;;)
+  {
+    int room = port.availableForWrite();
+    if (room <= 0)
+    {
+      return;
+    }
+    size_t count = logTake(chunk, room);
+    if (count == 0)
+    {
+      return;
+    }
+    port.write((const uint8_t *)chunk, count);
+  }
+}
+
+void logFlush(Print &port, size_t limit)
+{
+  char chunk[LOG_FLUSH_CHUNK];
+  while (limit > 0)
+  {
+    size_t count = logTake(chunk, limit);
+    if (count == 0)
+    {
+      return;
+    }
+    port.write((const uint8_t *)chunk, count);
+    limit -= count;
+  }
+}
+
+size_t logHistory(char *buffer, size_t capacity)
+{
+  if (capacity == 0)
+  {
+    return 0;
+  }
+
+  uint8_t state = logLock();
+  size_t length = stored < capacity - 1 ? stored : capacity - 1;
+  bool wrapped = length < stored || stored == LOG_BUFFER_LENGTH;
+  size_t start = head - length;
+  for (size_t i = 0; i < length; i++)
+  {
+    buffer[i] = ring[(start + i) & (LOG_BUFFER_LENGTH - 1)];
+  }
+  logUnlock(state);
+
+  // the first line may have been partly overwritten, start after it
+  size_t skip = 0;
+  if (wrapped)
+  {
+    while (skip < length && buffer[skip++] != '\n');
+  }
+  memmove(buffer, buffer + skip, length - skip);
+  length -= skip;
+  buffer[length] = 0;
+  return length;
+}
+
+unsigned long logDropped()
+{
+  uint8_t state = logLock();
+  unsigned long count = dropped;
+  logUnlock(state);
+  return count;
+}
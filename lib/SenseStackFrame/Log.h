@@ -0,0 +1,111 @@
+/*
+Logging shared by the main module and the sensor modules.
+
+Statements below LOG_LEVEL are removed by the preprocessor, arguments included,
+so debug logging costs nothing in a normal build. Set the level per project:
+	build_flags = -D LOG_LEVEL=LOG_LEVEL_DEBUG
+
+Enabled statements are formatted into a line and appended to a RAM ring buffer,
+which never waits for the serial port and is safe to call from interrupts and
+from any task. logFlush() moves what the port can take without blocking, so
+call it where the firmware has time to spare, once per loop(). When the port
+falls behind the oldest lines are overwritten and counted by logDropped().
+The buffer also keeps the most recent lines for logHistory().
+
+Usage:
+	LOG_INFO("Module attached at address 0x%02X", address);
+	LOG_DEBUG("Parsed reading: %s = %s", key, value);
+
+	void loop() {
+		...
+		logFlush(Serial);
+	}
+
+A port without a transmit buffer waits for every byte it sends, give it a budget:
+	logFlush(logSerial, 8);
+
+On AVR the format strings stay in flash and printf has no %f, so log floats
+as scaled integers there.
+*/
+
+#ifndef Log_h
+#define Log_h
+
+#include <Arduino.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// ring buffer size, a power of two, and the longest single line
+#ifndef LOG_BUFFER_LENGTH
+#if defined(__AVR__)
+#define LOG_BUFFER_LENGTH 128
+#else
+#define LOG_BUFFER_LENGTH 4096
+#endif
+#endif
+
+#ifndef LOG_LINE_LENGTH
+#if defined(__AVR__)
+#define LOG_LINE_LENGTH 48
+#else
+#define LOG_LINE_LENGTH 160
+#endif
+#endif
+
+#if defined(__AVR__)
+#define LOG_TEXT(format) PSTR(format)
+#else
+#define LOG_TEXT(format) (format)
+#endif
+
+#define LOG_NOTHING do {} while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(format, ...) logPrintf('E', LOG_TEXT(format), ##__VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...) LOG_NOTHING
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(format, ...) logPrintf('W', LOG_TEXT(format), ##__VA_ARGS__)
+#else
+#define LOG_WARN(format, ...) LOG_NOTHING
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(format, ...) logPrintf('I', LOG_TEXT(format), ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...) LOG_NOTHING
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(format, ...) logPrintf('D', LOG_TEXT(format), ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...) LOG_NOTHING
+#endif
+
+// formats one line, prefixed with millis() and the level letter, into the ring buffer
+void logPrintf(char level, const char *format, ...);
+
+// writes buffered lines to the port, only as much as it accepts without blocking
+void logFlush(HardwareSerial &port);
+
+// for ports without a transmit buffer, such as SoftwareSerial, which send every
+// byte with interrupts off: writes at most limit bytes, so loop() can bound the stall
+void logFlush(Print &port, size_t limit);
+
+// copies the most recent whole lines into buffer, returns the length without terminator
+size_t logHistory(char *buffer, size_t capacity);
+
+// bytes overwritten before they reached the port
+unsigned long logDropped();
+
+#endif
@@ -0,0 +1,396 @@
+/*
+SenseStack binary frame protocol (version 2).
+See SenseStackFrame.h for the frame layout.
+*/
+
+#include "SenseStackFrame.h"
+
+static const char channelTest[] PROGMEM = "test_key";
+static const char channelCO[] PROGMEM = "co_density";
+static const char channelUV[] PROGMEM = "uv_intensity";
+static const char channelPM1[] PROGMEM = "pm1";
+static const char channelPM2_5[] PROGMEM = "pm2_5";
+static const char channelPM10[] PROGMEM = "pm10";
+static const char channelTemperature[] PROGMEM = "temperature";
+static const char channelHumidity[] PROGMEM = "humidity";
+static const char channelParticles0_3[] PROGMEM = "particles_0_3";
+static const char channelParticles0_5[] PROGMEM = "particles_0_5";
+static const char channelParticles1_0[] PROGMEM = "particles_1_0";
+static const char channelParticles2_5[] PROGMEM = "particles_2_5";
+static const char channelParticles5_0[] PROGMEM = "particles_5_0";
+static const char channelParticles10[] PROGMEM = "particles_10";
+
+static const char* const channelNames[CHANNEL_COUNT] PROGMEM = {
+  channelTest,
+  channelCO,
+  channelUV,
+  channelPM1,
+  channelPM2_5,
+  channelPM10,
+  channelTemperature,
+  channelHumidity,
+  channelParticles0_3,
+  channelParticles0_5,
+  channelParticles1_0,
+  channelParticles2_5,
+  channelParticles5_0,
+  channelParticles10
+};
+
+static const char unitNone[] PROGMEM = "";
+static const char unitPPM[] PROGMEM = "ppm";
+static const char unitUV[] PROGMEM = "mw/cm^2";
+static const char unitDensity[] PROGMEM = "μg/m^3";
+static const char unitCelsius[] PROGMEM = "c";
+static const char unitPercent[] PROGMEM = "%";
+static const char unitPerDecilitre[] PROGMEM = "/0.1L";
+
+static const char* const unitNames[UNIT_COUNT] PROGMEM = {
+  unitNone,
+  unitPPM,
+  unitUV,
+  unitDensity,
+  unitCelsius,
+  unitPercent,
+  unitPerDecilitre
+};
+
+const char* channelName(uint8_t channel){
+  if (channel >= CHANNEL_COUNT){
+    return PSTR("unknown");
+  }
+  return (const char*)pgm_read_ptr(&channelNames[channel]);
+}
+
+const char* unitName(uint8_t unit){
+  if (unit >= UNIT_COUNT){
+    return unitNone;
+  }
+  return (const char*)pgm_read_ptr(&unitNames[unit]);
+}
+
+/*
+CRC-8 with polynomial 0x07, computed bitwise so it needs no lookup table
+in the RAM of the sensor modules.
+*/
+uint8_t frameCRC(const uint8_t* data, uint8_t length){
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < length; i++){
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++){
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// -------------- Poll timing -------------- //
+
+void encodeTiming(uint8_t* buffer, uint16_t minInterval, uint16_t preferredInterval){
+  buffer[0] = CH_IS_TIMING;
+  buffer[1] = minInterval & 0xFF;
+  buffer[2] = minInterval >> 8;
+  buffer[3] = preferredInterval & 0xFF;
+  buffer[4] = preferredInterval >> 8;
+  buffer[5] = frameCRC(buffer, TIMING_LENGTH - 1);
+}
+
+/*
+Reads a poll timing reply.
+
+@return false if the buffer does not hold a valid timing reply
+*/
+bool decodeTiming(const uint8_t* buffer, uint8_t length, uint16_t& minInterval, uint16_t& preferredInterval){
+  if (length < TIMING_LENGTH || buffer[0] != CH_IS_TIMING){
+    return false;
+  }
+  if (frameCRC(buffer, TIMING_LENGTH - 1) != buffer[TIMING_LENGTH - 1]){
+    return false;
+  }
+  minInterval = buffer[1] | (uint16_t)buffer[2] << 8;
+  preferredInterval = buffer[3] | (uint16_t)buffer[4] << 8;
+  return true;
+}
+
+// -------------- Module descriptor -------------- //
+
+/*
+Encodes a descriptor and sets its id.
+
+@return total length of the descriptor in bytes
+*/
+uint8_t encodeDescriptor(uint8_t* buffer, ModuleDescriptor& descriptor){
+  if (descriptor.channelCount > FRAME_MAX_RECORDS){
+    descriptor.channelCount = FRAME_MAX_RECORDS;
+  }
+  buffer[0] = CH_IS_DESCRIPTOR;
+  buffer[1] = DESCRIPTOR_VERSION;
+  buffer[2] = descriptor.moduleType;
+  buffer[3] = descriptor.firmwareVersion & 0xFF;
+  buffer[4] = descriptor.firmwareVersion >> 8;
+  buffer[5] = descriptor.channelCount;
+  uint8_t* channel = buffer + DESCRIPTOR_HEADER_LENGTH;
+  for (uint8_t i = 0; i < descriptor.channelCount; i++){
+    channel[0] = descriptor.channels[i].channel;
+    channel[1] = descriptor.channels[i].unit;
+    channel[2] = descriptor.channels[i].type;
+    channel[3] = descriptor.channels[i].decimals;
+    channel += DESCRIPTOR_CHANNEL_LENGTH;
+  }
+  uint8_t crcIndex = channel - buffer;
+  buffer[crcIndex] = frameCRC(buffer, crcIndex);
+  descriptor.id = buffer[crcIndex];
+  return crcIndex + 1;
+}
+
+/*
+Reads a module descriptor.
+
+@return false if the buffer does not hold a valid descriptor
+*/
+bool decodeDescriptor(const uint8_t* buffer, uint8_t length, ModuleDescriptor& descriptor){
+  if (length < DESCRIPTOR_HEADER_LENGTH + 1 || descriptorLength(buffer) != length || buffer[1] != DESCRIPTOR_VERSION){
+    return false;
+  }
+  if (frameCRC(buffer, length - 1) != buffer[length - 1]){
+    return false;
+  }
+  descriptor.moduleType = buffer[2];
+  descriptor.firmwareVersion = buffer[3] | (uint16_t)buffer[4] << 8;
+  descriptor.channelCount = buffer[5];
+  const uint8_t* channel = buffer + DESCRIPTOR_HEADER_LENGTH;
+  for (uint8_t i = 0; i < descriptor.channelCount; i++){
+    if (channel[2] >= VALUE_TYPE_COUNT){
+      return false;
+    }
+    descriptor.channels[i].channel = channel[0];
+    descriptor.channels[i].unit = channel[1];
+    descriptor.channels[i].type = channel[2];
+    descriptor.channels[i].decimals = channel[3];
+    channel += DESCRIPTOR_CHANNEL_LENGTH;
+  }
+  descriptor.id = buffer[length - 1];
+  return true;
+}
+
+/*
+Total length announced by a descriptor header, 0 if the header is not a descriptor.
+*/
+uint8_t descriptorLength(const uint8_t* header){
+  if (header[0] != CH_IS_DESCRIPTOR || header[5] > FRAME_MAX_RECORDS){
+    return 0;
+  }
+  return DESCRIPTOR_HEADER_LENGTH + header[5] * DESCRIPTOR_CHANNEL_LENGTH + 1;
+}
+
+// -------------- Values frame -------------- //
+
+// helper function to get 10^decimals without pulling in pow()
+static float decimalScale(uint8_t decimals){
+  float scale = 1;
+  while (decimals-- > 0){
+    scale *= 10;
+  }
+  return scale;
+}
+
+// bytes a value of the given type takes in a values frame
+uint8_t valueSize(uint8_t type){
+  switch (type){
+    case VALUE_INT16:
+    case VALUE_UINT16:
+      return 2;
+    case VALUE_FLOAT32:
+    case VALUE_INT32:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+// helper function to pack one value, integers are rounded and clamped to their type
+static void packValue(uint8_t* buffer, const ChannelDescriptor& channel, float value){
+  if (channel.type == VALUE_FLOAT32){
+    memcpy(buffer, &value, sizeof(float));
+    return;
+  }
+  float scaled = value * decimalScale(channel.decimals);
+  float low = channel.type == VALUE_INT16 ? -32768.0 : (channel.type == VALUE_UINT16 ? 0.0 : -2147483648.0);
+  float high = channel.type == VALUE_INT16 ? 32767.0 : (channel.type == VALUE_UINT16 ? 65535.0 : 2147483520.0);
+  scaled = scaled < low ? low : (scaled > high ? high : scaled);
+  int32_t raw = lround(scaled);
+  for (uint8_t i = 0; i < valueSize(channel.type); i++){
+    buffer[i] = (uint32_t)raw >> (8 * i);
+  }
+}
+
+// helper function to unpack one value
+static float unpackValue(const uint8_t* buffer, const ChannelDescriptor& channel){
+  float value;
+  switch (channel.type){
+    case VALUE_FLOAT32:
+      memcpy(&value, buffer, sizeof(float));
+      return value;
+    case VALUE_INT16:
+      value = (int16_t)(buffer[0] | (uint16_t)buffer[1] << 8);
+      break;
+    case VALUE_UINT16:
+      value = (uint16_t)(buffer[0] | (uint16_t)buffer[1] << 8);
+      break;
+    default:
+      value = (int32_t)(buffer[0] | (uint32_t)buffer[1] << 8 | (uint32_t)buffer[2] << 16 | (uint32_t)buffer[3] << 24);
+      break;
+  }
+  return value / decimalScale(channel.decimals);
+}
+
+/*
+Encodes the values of the channels set in present into a values frame
+of up to VALUES_MAX_LENGTH bytes.
+
+@return total length of the frame in bytes
+*/
+uint8_t encodeValues(uint8_t* buffer, const ModuleDescriptor& descriptor, const float* values, uint16_t present){
+  buffer[0] = CH_IS_VALUES;
+  buffer[1] = descriptor.id;
+  uint8_t position = VALUES_HEADER_LENGTH;
+  uint16_t packed = 0;
+  for (uint8_t i = 0; i < descriptor.channelCount; i++){
+    if (present & (1 << i)){
+      packValue(buffer + position, descriptor.channels[i], values[i]);
+      position += valueSize(descriptor.channels[i].type);
+      packed |= 1 << i;
+    }
+  }
+  buffer[2] = position - VALUES_HEADER_LENGTH;
+  buffer[3] = packed & 0xFF;
+  buffer[4] = packed >> 8;
+  buffer[position] = frameCRC(buffer, position);
+  return position + 1;
+}
+
+/*
+Reads the values out of a values frame.
+
+@return false if the frame is damaged or does not follow the descriptor
+*/
+bool decodeValues(const uint8_t* buffer, uint8_t length, const ModuleDescriptor& descriptor, float* values, uint16_t& present){
+  if (length < VALUES_HEADER_LENGTH + 1 || valuesLength(buffer) != length || buffer[1] != descriptor.id){
+    return false;
+  }
+  if (frameCRC(buffer, length - 1) != buffer[length - 1]){
+    return false;
+  }
+  present = buffer[3] | (uint16_t)buffer[4] << 8;
+  if (present >> descriptor.channelCount != 0){
+    return false;
+  }
+  uint8_t position = VALUES_HEADER_LENGTH;
+  for (uint8_t i = 0; i < descriptor.channelCount; i++){
+    if (present & (1 << i)){
+      if (position + valueSize(descriptor.channels[i].type) > length - 1){
+        return false;
+      }
+      values[i] = unpackValue(buffer + position, descriptor.channels[i]);
+      position += valueSize(descriptor.channels[i].type);
+    }
+  }
+  return position == length - 1;
+}
+
+/*
+Total length announced by a values frame header, 0 if the header is not a values frame.
+*/
+uint8_t valuesLength(const uint8_t* header){
+  if (header[0] != CH_IS_VALUES || header[2] > VALUES_MAX_LENGTH - VALUES_HEADER_LENGTH - 1){
+    return 0;
+  }
+  return VALUES_HEADER_LENGTH + header[2] + 1;
+}
+
+// -------------- Encoder -------------- //
+
+FrameEncoder::FrameEncoder(uint8_t* frameBuffer){
+  buffer = frameBuffer;
+  count = 0;
+}
+
+void FrameEncoder::begin(){
+  count = 0;
+  buffer[0] = CH_IS_FRAME;
+  buffer[1] = FRAME_VERSION;
+  buffer[2] = 0;
+  buffer[3] = 0;
+}
+
+bool FrameEncoder::add(uint8_t channel, uint8_t unit, float value){
+  if (count >= FRAME_MAX_RECORDS){
+    return false;
+  }
+  uint8_t* record = buffer + FRAME_HEADER_LENGTH + count * FRAME_RECORD_LENGTH;
+  record[0] = channel;
+  record[1] = unit;
+  memcpy(record + 2, &value, sizeof(float));
+  count++;
+  return true;
+}
+
+/*
+Fills in the header and CRC.
+
+@return total length of the frame in bytes
+*/
+uint8_t FrameEncoder::finish(){
+  uint8_t payloadLength = count * FRAME_RECORD_LENGTH;
+  buffer[2] = payloadLength;
+  buffer[3] = count;
+  uint8_t crcIndex = FRAME_HEADER_LENGTH + payloadLength;
+  buffer[crcIndex] = frameCRC(buffer, crcIndex);
+  return crcIndex + 1;
+}
+
+// -------------- Decoder -------------- //
+
+FrameDecoder::FrameDecoder(const uint8_t* frameBuffer, uint8_t length){
+  buffer = frameBuffer;
+  count = 0;
+  isValid = false;
+  if (length < FRAME_HEADER_LENGTH + 1 || expectedLength(frameBuffer) != length){
+    return;
+  }
+  if (buffer[1] != FRAME_VERSION || buffer[2] != buffer[3] * FRAME_RECORD_LENGTH){
+    return;
+  }
+  if (frameCRC(buffer, length - 1) != buffer[length - 1]){
+    return;
+  }
+  count = buffer[3];
+  isValid = true;
+}
+
+bool FrameDecoder::valid() const {
+  return isValid;
+}
+
+uint8_t FrameDecoder::records() const {
+  return count;
+}
+
+FrameRecord FrameDecoder::record(uint8_t index) const {
+  FrameRecord result;
+  const uint8_t* record = buffer + FRAME_HEADER_LENGTH + index * FRAME_RECORD_LENGTH;
+  result.channel = record[0];
+  result.unit = record[1];
+  memcpy(&result.value, record + 2, sizeof(float));
+  return result;
+}
+
+/*
+Total frame length announced by a frame header, 0 if the header is not a frame.
+*/
+uint8_t FrameDecoder::expectedLength(const uint8_t* header){
+  if (header[0] != CH_IS_FRAME || header[2] > FRAME_MAX_RECORDS * FRAME_RECORD_LENGTH){
+    return 0;
+  }
+  return FRAME_HEADER_LENGTH + header[2] + 1;
+}
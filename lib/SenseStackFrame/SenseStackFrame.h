@@ -0,0 +1,202 @@
+/*
+SenseStack binary frame protocol (version 2).
+
+Sent alongside the text protocol in protocol.h. The main module selects it by
+writing CMD_READ_FRAME to a sensor module before requesting data. A module that
+does not understand the command keeps answering with text fragments, and the
+main module tells the two apart by the first byte of the reply.
+
+Frame layout (multi byte fields are little endian):
+	[0]        CH_IS_FRAME
+	[1]        FRAME_VERSION
+	[2]        payload length in bytes (count * FRAME_RECORD_LENGTH)
+	[3]        record count
+	[4..4+n)   records: channel id (1), unit id (1), float32 value (4)
+	[4+n]      CRC-8 over bytes [0, 4+n)
+
+A frame longer than FRAME_CHUNK_LENGTH is read in consecutive chunks, the
+sensor module keeps a cursor that is reset by every CMD_READ_FRAME.
+
+CMD_READ_TIMING selects the poll timing reply instead, read once when the
+main module attaches a module so it can poll every module on its own cadence:
+	[0]        CH_IS_TIMING
+	[1..3)     minimum poll interval in ms, the module cannot be read faster
+	[3..5)     preferred poll interval in ms, how often it has a new sample
+	[5]        CRC-8 over bytes [0, 5)
+
+CMD_READ_DESCRIPTOR selects the module descriptor, read once when the main
+module first sees a module and cached from then on (ModuleRegistry.h):
+	[0]        CH_IS_DESCRIPTOR
+	[1]        DESCRIPTOR_VERSION
+	[2]        module type (SenseStackModule)
+	[3..5)     firmware version
+	[5]        channel count n
+	[6..6+4n)  channels: channel id (1), unit id (1), value type (1), decimals (1)
+	[6+4n]     CRC-8 over bytes [0, 6+4n), which is also the descriptor id
+
+CMD_READ_VALUES selects the values frame, which carries only the values of the
+channels in the descriptor, in its order and each in its value type scaled by
+10^decimals, so names and units are not sent on every poll:
+	[0]        CH_IS_VALUES
+	[1]        id of the descriptor the values follow
+	[2]        payload length in bytes
+	[3..5)     presence mask, bit i set if channel i of the descriptor has a value
+	[5..5+n)   values of the present channels
+	[5+n]      CRC-8 over bytes [0, 5+n)
+A main module that gets a different descriptor id reads the descriptor again.
+Both replies are read in FRAME_CHUNK_LENGTH chunks like a long frame.
+
+Sensor modules serve all of these through SensorReply (SensorReply.h).
+*/
+
+#ifndef SenseStackFrame_h
+#define SenseStackFrame_h
+
+#include <Arduino.h>
+
+#define CH_IS_FRAME 0x02          // first byte of a binary frame, never used by the text protocol
+#define CMD_READ_FRAME 0x52       // command written by the main module to select the binary frame
+#define CH_IS_TIMING 0x03         // first byte of a poll timing reply
+#define CMD_READ_TIMING 0x54      // command written by the main module to select the poll timing reply
+#define CH_IS_DESCRIPTOR 0x04      // first byte of a module descriptor
+#define CMD_READ_DESCRIPTOR 0x44  // command written by the main module to select the module descriptor
+#define CH_IS_VALUES 0x05         // first byte of a values frame
+#define CMD_READ_VALUES 0x56      // command written by the main module to select the values frame
+#define TIMING_LENGTH 6
+#define FRAME_VERSION 2
+#define FRAME_HEADER_LENGTH 4
+#define FRAME_RECORD_LENGTH 6
+#define FRAME_CHUNK_LENGTH 32     // TWI buffer size of the ATmega328P sensor modules
+#define FRAME_MAX_RECORDS 12
+#define FRAME_MAX_LENGTH (FRAME_HEADER_LENGTH + FRAME_MAX_RECORDS * FRAME_RECORD_LENGTH + 1)
+#define DESCRIPTOR_VERSION 1
+#define DESCRIPTOR_HEADER_LENGTH 6
+#define DESCRIPTOR_CHANNEL_LENGTH 4
+#define DESCRIPTOR_MAX_LENGTH (DESCRIPTOR_HEADER_LENGTH + FRAME_MAX_RECORDS * DESCRIPTOR_CHANNEL_LENGTH + 1)
+#define VALUES_HEADER_LENGTH 5
+#define VALUES_MAX_LENGTH (VALUES_HEADER_LENGTH + FRAME_MAX_RECORDS * 4 + 1)
+
+// Channel identifiers, the main module turns these into JSON keys.
+enum SenseStackChannel : uint8_t {
+	CHANNEL_TEST = 0,
+	CHANNEL_CO_DENSITY,
+	CHANNEL_UV_INTENSITY,
+	CHANNEL_PM1,
+	CHANNEL_PM2_5,
+	CHANNEL_PM10,
+	CHANNEL_TEMPERATURE,
+	CHANNEL_HUMIDITY,
+	CHANNEL_PARTICLES_0_3,   // particles above the size in um, per 0.1 L of air
+	CHANNEL_PARTICLES_0_5,
+	CHANNEL_PARTICLES_1_0,
+	CHANNEL_PARTICLES_2_5,
+	CHANNEL_PARTICLES_5_0,
+	CHANNEL_PARTICLES_10,
+	CHANNEL_COUNT
+};
+
+// Module types reported in the descriptor.
+enum SenseStackModule : uint8_t {
+	MODULE_UNKNOWN = 0,
+	MODULE_BASE,
+	MODULE_CO,
+	MODULE_UV,
+	MODULE_AIR_QUALITY,
+	MODULE_TEMP_HUMIDITY
+};
+
+// How a channel's value is packed in a values frame, all but VALUE_FLOAT32 are scaled by 10^decimals.
+enum SenseStackValueType : uint8_t {
+	VALUE_FLOAT32 = 0,
+	VALUE_INT16,
+	VALUE_UINT16,
+	VALUE_INT32,
+	VALUE_TYPE_COUNT
+};
+
+// Unit identifiers, the main module turns these into unit strings.
+enum SenseStackUnit : uint8_t {
+	UNIT_NONE = 0,
+	UNIT_PPM,
+	UNIT_MW_PER_CM2,
+	UNIT_UG_PER_M3,
+	UNIT_CELSIUS,
+	UNIT_PERCENT,
+	UNIT_PER_DECILITRE,
+	UNIT_COUNT
+};
+
+struct FrameRecord {
+	uint8_t channel;
+	uint8_t unit;
+	float value;
+};
+
+struct ChannelDescriptor {
+	uint8_t channel;
+	uint8_t unit;
+	uint8_t type;
+	uint8_t decimals;
+};
+
+struct ModuleDescriptor {
+	uint8_t moduleType;
+	uint16_t firmwareVersion;
+	uint8_t channelCount;
+	ChannelDescriptor channels[FRAME_MAX_RECORDS];
+	uint8_t id;               // CRC of the encoded descriptor, set by encodeDescriptor() and decodeDescriptor()
+};
+
+// Names are kept in program memory, on AVR read them with the _P string functions.
+const char* channelName(uint8_t channel);
+const char* unitName(uint8_t unit);
+uint8_t frameCRC(const uint8_t* data, uint8_t length);
+
+// Poll timing reply, encodeTiming() fills TIMING_LENGTH bytes.
+void encodeTiming(uint8_t* buffer, uint16_t minInterval, uint16_t preferredInterval);
+bool decodeTiming(const uint8_t* buffer, uint8_t length, uint16_t& minInterval, uint16_t& preferredInterval);
+
+// Module descriptor, encodeDescriptor() fills up to DESCRIPTOR_MAX_LENGTH bytes and returns the length.
+uint8_t encodeDescriptor(uint8_t* buffer, ModuleDescriptor& descriptor);
+bool decodeDescriptor(const uint8_t* buffer, uint8_t length, ModuleDescriptor& descriptor);
+uint8_t descriptorLength(const uint8_t* header);
+
+// Values frame, values[] and the presence mask follow the channel order of the descriptor.
+uint8_t valueSize(uint8_t type);
+uint8_t encodeValues(uint8_t* buffer, const ModuleDescriptor& descriptor, const float* values, uint16_t present);
+bool decodeValues(const uint8_t* buffer, uint8_t length, const ModuleDescriptor& descriptor, float* values, uint16_t& present);
+uint8_t valuesLength(const uint8_t* header);
+
+/*
+Builds a frame into a caller supplied buffer of at least FRAME_MAX_LENGTH bytes.
+Records beyond FRAME_MAX_RECORDS are dropped.
+*/
+class FrameEncoder {
+	private:
+		uint8_t* buffer;
+		uint8_t count;
+	public:
+		FrameEncoder(uint8_t* frameBuffer);
+		void begin();
+		bool add(uint8_t channel, uint8_t unit, float value);
+		uint8_t finish();
+};
+
+/*
+Validates a complete frame and reads the records out of it.
+expectedLength() returns 0 for anything that is not a frame header.
+*/
+class FrameDecoder {
+	private:
+		const uint8_t* buffer;
+		uint8_t count;
+		bool isValid;
+	public:
+		FrameDecoder(const uint8_t* frameBuffer, uint8_t length);
+		bool valid() const;
+		uint8_t records() const;
+		FrameRecord record(uint8_t index) const;
+		static uint8_t expectedLength(const uint8_t* header);
+};
+
+#endif
@@ -0,0 +1,269 @@
+/*
+Pre-serialized replies for sensor modules.
+See SensorReply.h for how the buffers are shared with the request handler.
+*/
+
+#include <Wire.h>
+#include "protocol.h"
+#include "SensorReply.h"
+
+SensorReply::SensorReply() : encoder(NULL){
+  published = 0;
+  serving = 0;
+  inProgress = false;
+  mode = REPLY_TEXT;
+  descriptor.channelCount = 0;
+  descriptorLength = 0;
+  cursor = 0;
+  writing = 0;
+  present = 0;
+  // modules that never call setTiming() are polled as fast as the main module likes
+  encodeTiming(timing, 0, 0);
+
+  // both buffers start out as an empty reply until the first sample is published
+  for (uint8_t i = 0; i < 2; i++){
+    FrameEncoder empty(buffers[i].frame);
+    empty.begin();
+    buffers[i].frameLength = empty.finish();
+    buffers[i].valuesLength = 0;
+    buffers[i].text[0] = CH_TERMINATE;
+    buffers[i].textLength = 1;
+  }
+}
+
+/*
+Sets the poll intervals reported to the main module, call once from setup().
+
+@param minInterval : ms the module needs between two reads
+@param preferredInterval : ms between two new samples of the module
+*/
+void SensorReply::setTiming(uint16_t minInterval, uint16_t preferredInterval){
+  noInterrupts();
+  encodeTiming(timing, minInterval, preferredInterval);
+  interrupts();
+}
+
+/*
+Sets the module type and firmware version of the descriptor and clears its channels,
+call once from setup() before describeChannel().
+*/
+void SensorReply::describe(uint8_t moduleType, uint16_t firmwareVersion){
+  noInterrupts();
+  descriptor.moduleType = moduleType;
+  descriptor.firmwareVersion = firmwareVersion;
+  descriptor.channelCount = 0;
+  descriptorLength = encodeDescriptor(descriptorFrame, descriptor);
+  interrupts();
+}
+
+/*
+Adds a channel to the descriptor, call from setup() after describe().
+
+@param type : SenseStackValueType the value is packed as in values frames
+@param decimals : digits after the decimal point kept by integer types
+
+@return false if the descriptor is full
+*/
+bool SensorReply::describeChannel(uint8_t channel, uint8_t unit, uint8_t type, uint8_t decimals){
+  if (descriptorLength == 0 || descriptor.channelCount >= FRAME_MAX_RECORDS){
+    return false;
+  }
+  noInterrupts();
+  ChannelDescriptor& described = descriptor.channels[descriptor.channelCount++];
+  described.channel = channel;
+  described.unit = unit;
+  described.type = type;
+  described.decimals = decimals;
+  descriptorLength = encodeDescriptor(descriptorFrame, descriptor);
+  interrupts();
+  return true;
+}
+
+/*
+Starts encoding a new sample into the back buffer.
+
+@return false if the back buffer is still being read by the main module
+*/
+bool SensorReply::begin(){
+  noInterrupts();
+  uint8_t next = 1 - published;
+  bool busy = inProgress && serving == next;
+  interrupts();
+  if (busy){
+    return false;
+  }
+
+  writing = next;
+  encoder = FrameEncoder(buffers[writing].frame);
+  encoder.begin();
+  buffers[writing].textLength = 0;
+  present = 0;
+  return true;
+}
+
+/*
+Adds one reading to both encodings of the back buffer.
+
+@param decimals : digits after the decimal point in the text protocol
+
+@return false if the reading does not fit in the reply
+*/
+bool SensorReply::add(uint8_t channel, uint8_t unit, float value, uint8_t decimals){
+  char valueText[16];
+  dtostrf(value, 1, decimals, valueText);
+
+  // two specifiers, two delimiters and the space before the unit
+  uint8_t needed = strlen_P(channelName(channel)) + strlen(valueText) + strlen_P(unitName(unit)) + 5;
+  if (buffers[writing].textLength + needed > REPLY_TEXT_LENGTH){
+    return false;
+  }
+  if (!encoder.add(channel, unit, value)){
+    return false;
+  }
+
+  appendFragment(CH_IS_KEY, channelName(channel), NULL);
+  appendFragment(CH_IS_VALUE, unitName(unit), valueText);
+
+  for (uint8_t i = 0; i < descriptor.channelCount && descriptorLength > 0; i++){
+    if (descriptor.channels[i].channel == channel){
+      values[i] = value;
+      present |= 1 << i;
+      break;
+    }
+  }
+  return true;
+}
+
+/*
+Finishes the back buffer and makes it the one new replies start on.
+*/
+void SensorReply::publish(){
+  Buffer& buffer = buffers[writing];
+  buffer.frameLength = encoder.finish();
+  buffer.valuesLength = descriptorLength > 0 ? encodeValues(buffer.values, descriptor, values, present) : 0;
+  if (buffer.textLength == 0){
+    buffer.textLength = 1;
+  }
+  // the last fragment ends the reply
+  buffer.text[buffer.textLength - 1] = CH_TERMINATE;
+  published = writing;
+}
+
+/*
+Handles a command byte from the main module, every command restarts the reply.
+Called from the Wire.onReceive handler.
+*/
+void SensorReply::command(uint8_t cmd){
+  switch (cmd){
+    case CMD_READ_FRAME:
+      mode = REPLY_FRAME;
+      break;
+    case CMD_READ_TIMING:
+      mode = REPLY_TIMING;
+      break;
+    case CMD_READ_DESCRIPTOR:
+    case CMD_READ_VALUES:
+      // a module that was never described answers with text, like one that does not know the command
+      mode = descriptorLength == 0 ? REPLY_TEXT : (cmd == CMD_READ_DESCRIPTOR ? REPLY_DESCRIPTOR : REPLY_VALUES);
+      break;
+    default:
+      mode = REPLY_TEXT;
+      break;
+  }
+  inProgress = false;
+  cursor = 0;
+}
+
+/*
+Writes the next piece of the reply, a chunk of the frame or one text fragment.
+Called from the Wire.onRequest handler.
+*/
+void SensorReply::send(){
+  if (mode == REPLY_TIMING){
+    // a single chunk, then back to the text protocol
+    Wire.write(timing, TIMING_LENGTH);
+    mode = REPLY_TEXT;
+    return;
+  }
+  if (mode == REPLY_DESCRIPTOR){
+    if (sendChunk(descriptorFrame, descriptorLength)){
+      mode = REPLY_TEXT;
+    }
+    return;
+  }
+
+  if (!inProgress){
+    serving = published;
+    cursor = 0;
+    inProgress = true;
+  }
+  const Buffer& buffer = buffers[serving];
+
+  if (mode == REPLY_VALUES && buffer.valuesLength == 0){
+    // nothing was published since the module was described, the frame is all there is
+    mode = REPLY_FRAME;
+  }
+  if (mode == REPLY_FRAME || mode == REPLY_VALUES){
+    bool finished = mode == REPLY_FRAME ? sendChunk(buffer.frame, buffer.frameLength)
+                                        : sendChunk(buffer.values, buffer.valuesLength);
+    if (finished){
+      // back to the text protocol until the next command
+      inProgress = false;
+      mode = REPLY_TEXT;
+    }
+    return;
+  }
+
+  uint8_t end = cursor;
+  while (end < buffer.textLength && buffer.text[end] != CH_MORE && buffer.text[end] != CH_TERMINATE){
+    end++;
+  }
+  if (end < buffer.textLength){
+    end++; // include the delimiter
+  }
+  Wire.write((const uint8_t*)buffer.text + cursor, end - cursor);
+  cursor = end;
+  if (cursor >= buffer.textLength){
+    inProgress = false;
+  }
+}
+
+/*
+Writes the next chunk of a binary reply, starting at the cursor.
+
+@return true once the whole reply has been written
+*/
+bool SensorReply::sendChunk(const uint8_t* data, uint8_t length){
+  uint8_t chunk = length - cursor;
+  if (chunk > FRAME_CHUNK_LENGTH){
+    chunk = FRAME_CHUNK_LENGTH;
+  }
+  Wire.write(data + cursor, chunk);
+  cursor += chunk;
+  return cursor >= length;
+}
+
+void SensorReply::appendText(const char* text, bool progmem){
+  Buffer& buffer = buffers[writing];
+  char c;
+  while ((c = progmem ? pgm_read_byte(text) : *text) != 0){
+    buffer.text[buffer.textLength++] = c;
+    text++;
+  }
+}
+
+/*
+Appends a text fragment "<specifier>[valueText ]<progmemText><CH_MORE>".
+*/
+void SensorReply::appendFragment(char specifier, const char* progmemText, const char* valueText){
+  Buffer& buffer = buffers[writing];
+  buffer.text[buffer.textLength++] = specifier;
+  if (valueText != NULL){
+    appendText(valueText, false);
+    if (pgm_read_byte(progmemText) != 0){
+      buffer.text[buffer.textLength++] = ' ';
+    }
+  }
+  appendText(progmemText, true);
+  buffer.text[buffer.textLength++] = CH_MORE;
+}
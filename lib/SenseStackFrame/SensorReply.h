@@ -0,0 +1,95 @@
+/*
+Pre-serialized replies for sensor modules.
+
+loop() encodes every new sample into the back buffer as a binary frame, a
+values frame and the text fragments of protocol.h, then publishes it. The I2C request
+handler only copies bytes out of the published buffer, so no String is built
+and nothing is formatted in interrupt context.
+
+A reply in progress keeps reading from the buffer it started on. If that is
+the buffer loop() wants to write next, begin() refuses and the sample is
+skipped, so a multi chunk reply never mixes two samples.
+
+A module that describes its channels in setup() also serves the module
+descriptor, and the main module then polls it for values frames, which leave
+out channel names and units (SenseStackFrame.h). Channels added to a sample
+that are not in the descriptor are only sent in the frame and the text.
+
+Usage:
+	SensorReply reply;
+
+	void sendData() { reply.send(); }                 // Wire.onRequest
+	void receiveCommand(int count) {                  // Wire.onReceive
+		while (Wire.available()) reply.command(Wire.read());
+	}
+
+	reply.setTiming(1000, 1000);                      // setup(), poll intervals in ms
+	reply.describe(MODULE_CO, FIRMWARE_VERSION);      // setup(), optional
+	reply.describeChannel(CHANNEL_CO_DENSITY, UNIT_PPM, VALUE_UINT16, 1);
+
+	if (reply.begin()) {                              // loop()
+		reply.add(CHANNEL_CO_DENSITY, UNIT_PPM, coPPM);
+		reply.publish();
+	}
+*/
+
+#ifndef SensorReply_h
+#define SensorReply_h
+
+#include <Arduino.h>
+#include "SenseStackFrame.h"
+
+#ifndef REPLY_TEXT_LENGTH
+#define REPLY_TEXT_LENGTH 192  // text fragments of one full reply, including specifiers, at most 255
+#endif
+
+class SensorReply {
+	private:
+		struct Buffer {
+			uint8_t frame[FRAME_MAX_LENGTH];
+			uint8_t frameLength;
+			uint8_t values[VALUES_MAX_LENGTH];
+			uint8_t valuesLength;
+			char text[REPLY_TEXT_LENGTH];
+			uint8_t textLength;
+		};
+
+		enum Mode : uint8_t {
+			REPLY_TEXT = 0,
+			REPLY_FRAME,
+			REPLY_TIMING,
+			REPLY_DESCRIPTOR,
+			REPLY_VALUES
+		};
+
+		Buffer buffers[2];
+		volatile uint8_t published;   // buffer new replies start on
+		volatile uint8_t serving;     // buffer the reply in progress reads from
+		volatile bool inProgress;
+		volatile uint8_t mode;        // reply selected by the last command
+		uint8_t timing[TIMING_LENGTH];
+		ModuleDescriptor descriptor;
+		uint8_t descriptorFrame[DESCRIPTOR_MAX_LENGTH];
+		uint8_t descriptorLength;     // 0 until describe() is called
+		volatile uint8_t cursor;
+		uint8_t writing;
+		FrameEncoder encoder;
+		float values[FRAME_MAX_RECORDS]; // values of the sample being encoded, in descriptor order
+		uint16_t present;
+
+		bool sendChunk(const uint8_t* data, uint8_t length);
+		void appendText(const char* text, bool progmem);
+		void appendFragment(char specifier, const char* progmemText, const char* valueText);
+	public:
+		SensorReply();
+		void setTiming(uint16_t minInterval, uint16_t preferredInterval);
+		void describe(uint8_t moduleType, uint16_t firmwareVersion);
+		bool describeChannel(uint8_t channel, uint8_t unit, uint8_t type, uint8_t decimals);
+		bool begin();
+		bool add(uint8_t channel, uint8_t unit, float value, uint8_t decimals = 2);
+		void publish();
+		void command(uint8_t cmd);
+		void send();
+};
+
+#endif